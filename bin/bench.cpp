@@ -0,0 +1,599 @@
+#include "bench.hpp"
+
+#include <microscopes/common/random_fwd.hpp>
+#include <microscopes/common/random.hpp>
+#include <microscopes/common/util.hpp>
+#include <microscopes/common/group_manager.hpp>
+#include <microscopes/common/recarray/dataview.hpp>
+#include <microscopes/common/workload.hpp>
+#include <microscopes/common/zmatrix.hpp>
+#include <microscopes/common/timer.hpp>
+#include <microscopes/common/profiler.hpp>
+#include <microscopes/models/distributions.hpp>
+#include <microscopes/models/bbnc.hpp>
+#include <microscopes/models/dm.hpp>
+#include <microscopes/models/niw.hpp>
+#include <microscopes/models/mixture.hpp>
+#include <microscopes/io/schema.pb.h>
+
+#include <random>
+
+using namespace std;
+using namespace distributions;
+using namespace microscopes;
+using namespace microscopes::common;
+using namespace microscopes::common::recarray;
+using microscopes::models::group;
+using microscopes::models::hypers;
+using microscopes::models::model;
+
+// writes a random value of the model's runtime type
+typedef function<void(value_mutator &, rng_t &)> value_gen_fn;
+
+namespace {
+
+const size_t NValues = 1024;
+const size_t NGroups = 32;
+
+/**
+ * Hypers of a model, and NValues values for it
+ */
+struct model_fixture {
+  model_fixture(const model &m, const hyperparam_bag_t &hp, value_gen_fn gen)
+    : r_(7841), h_(m.create_hypers()), type_(m.get_runtime_type()),
+      data_(NValues * type_.size())
+  {
+    h_->set_hp(hp);
+    for (size_t i = 0; i < NValues; i++) {
+      value_mutator mut(&data_[i * type_.size()], type_);
+      gen(mut, r_);
+    }
+  }
+
+  inline value_accessor
+  value(size_t i) const
+  {
+    return value_accessor(&data_[(i % NValues) * type_.size()], nullptr, type_);
+  }
+
+  rng_t r_;
+  shared_ptr<hypers> h_;
+  runtime_type type_;
+  vector<uint8_t> data_;
+};
+
+} // namespace
+
+/**
+ * name/add_remove, name/score_value, name/score_data and
+ * name/score_all_groups (a mixture of NGroups groups)
+ */
+static void
+add_model_benchmarks(const string &name,
+                     function<shared_ptr<model>()> model_fn,
+                     const hyperparam_bag_t &hp,
+                     value_gen_fn gen)
+{
+  auto fixture = [=]() {
+    return make_shared<model_fixture>(*model_fn(), hp, gen);
+  };
+
+  bench::add(name + "/add_remove", 1, [=]() -> bench::body_fn {
+    auto f = fixture();
+    auto g = f->h_->create_group(f->r_);
+    return [f, g](size_t n) {
+      for (size_t i = 0; i < n; i++) {
+        g->add_value(*f->h_, f->value(i), f->r_);
+        g->remove_value(*f->h_, f->value(i), f->r_);
+      }
+    };
+  });
+
+  bench::add(name + "/score_value", 1, [=]() -> bench::body_fn {
+    auto f = fixture();
+    auto g = f->h_->create_group(f->r_);
+    for (size_t i = 0; i < NValues; i += 2)
+      g->add_value(*f->h_, f->value(i), f->r_);
+    return [f, g](size_t n) {
+      float sum = 0.;
+      for (size_t i = 0; i < n; i++)
+        sum += g->score_value(*f->h_, f->value(i), f->r_);
+      bench::do_not_optimize(sum);
+    };
+  });
+
+  bench::add(name + "/score_data", 1, [=]() -> bench::body_fn {
+    auto f = fixture();
+    auto g = f->h_->create_group(f->r_);
+    for (size_t i = 0; i < NValues; i += 2)
+      g->add_value(*f->h_, f->value(i), f->r_);
+    return [f, g](size_t n) {
+      float sum = 0.;
+      for (size_t i = 0; i < n; i++)
+        sum += g->score_data(*f->h_, f->r_);
+      bench::do_not_optimize(sum);
+    };
+  });
+
+  bench::add(name + "/score_all_groups", NGroups, [=]() -> bench::body_fn {
+    auto f = fixture();
+    auto mix = f->h_->create_mixture();
+    for (size_t gid = 0; gid < NGroups; gid++)
+      mix->create_group(gid, *f->h_, f->r_);
+    for (size_t i = 0; i < NValues; i++)
+      mix->add_value(i % NGroups, *f->h_, f->value(i), f->r_);
+    auto scores = make_shared<vector<float>>(NGroups);
+    return [f, mix, scores](size_t n) {
+      for (size_t i = 0; i < n; i++) {
+        mix->score_value_all_groups(*f->h_, f->value(i), scores->data(), f->r_);
+        bench::do_not_optimize(*scores);
+      }
+    };
+  });
+}
+
+template <typename Message>
+static inline hyperparam_bag_t
+to_bag(const Message &m)
+{
+  return util::protobuf_to_string(m);
+}
+
+static void
+add_all_model_benchmarks()
+{
+  {
+    protobuf::BetaBernoulli_Shared m;
+    m.set_alpha(1.);
+    m.set_beta(2.);
+    add_model_benchmarks("bb",
+        []() { return make_shared<models::distributions_model<BetaBernoulli>>(); },
+        to_bag(m),
+        [](value_mutator &v, rng_t &r) {
+          v.set<bool>(bernoulli_distribution(0.3)(r), 0);
+        });
+  }
+
+  {
+    protobuf::BetaNegativeBinomial_Shared m;
+    m.set_alpha(1.);
+    m.set_beta(2.);
+    m.set_r(5);
+    add_model_benchmarks("bnb",
+        []() { return make_shared<models::distributions_model<BetaNegativeBinomial>>(); },
+        to_bag(m),
+        [](value_mutator &v, rng_t &r) {
+          v.set<uint32_t>(poisson_distribution<uint32_t>(4.)(r), 0);
+        });
+  }
+
+  {
+    protobuf::GammaPoisson_Shared m;
+    m.set_alpha(1.);
+    m.set_inv_beta(1.);
+    add_model_benchmarks("gp",
+        []() { return make_shared<models::distributions_model<GammaPoisson>>(); },
+        to_bag(m),
+        [](value_mutator &v, rng_t &r) {
+          v.set<uint32_t>(poisson_distribution<uint32_t>(4.)(r), 0);
+        });
+  }
+
+  {
+    protobuf::NormalInverseChiSq_Shared m;
+    m.set_mu(0.);
+    m.set_kappa(1.);
+    m.set_sigmasq(1.);
+    m.set_nu(1.);
+    add_model_benchmarks("nich",
+        []() { return make_shared<models::distributions_model<NormalInverseChiSq>>(); },
+        to_bag(m),
+        [](value_mutator &v, rng_t &r) {
+          v.set<float>(normal_distribution<float>(1., 2.)(r), 0);
+        });
+  }
+
+  // every DirichletDiscrete size, see dd_model
+  for (unsigned k : {2, 4, 8, 16, 32, 128, 1000}) {
+    protobuf::DirichletDiscrete_Shared m;
+    for (unsigned i = 0; i < k; i++)
+      m.add_alphas(1.);
+    add_model_benchmarks("dd" + to_string(k),
+        [k]() { return make_shared<models::dd_model>(k); },
+        to_bag(m),
+        [k](value_mutator &v, rng_t &r) {
+          v.set<uint32_t>(uniform_int_distribution<uint32_t>(0, k - 1)(r), 0);
+        });
+  }
+
+  for (unsigned d : {3, 16}) {
+    protobuf::NormalInverseWishart_Shared m;
+    for (unsigned i = 0; i < d; i++)
+      m.add_mu(0.);
+    m.set_kappa(1.);
+    for (unsigned i = 0; i < d; i++)
+      for (unsigned j = 0; j < d; j++)
+        m.add_psi(i == j ? 1. : 0.);
+    m.set_nu(d + 1.);
+    auto gen = [d](value_mutator &v, rng_t &r) {
+      for (unsigned i = 0; i < d; i++)
+        v.set<float>(normal_distribution<float>(i, 1.)(r), i);
+    };
+    add_model_benchmarks("niwv" + to_string(d),
+        [d]() { return make_shared<models::distributions_model_niwv>(d); },
+        to_bag(m), gen);
+    add_model_benchmarks("niw" + to_string(d),
+        [d]() { return make_shared<models::niw_model>(d); },
+        to_bag(m), gen);
+  }
+
+  for (unsigned k : {10, 2000}) {
+    io::DirichletMultinomial_Shared m;
+    for (unsigned i = 0; i < k; i++)
+      m.add_alphas(0.5);
+    add_model_benchmarks("dm" + to_string(k),
+        [k]() { return make_shared<models::dm_model>(k); },
+        to_bag(m),
+        [k](value_mutator &v, rng_t &r) {
+          for (unsigned i = 0; i < k; i++)
+            v.set<int32_t>(0, i);
+          for (unsigned n = 0; n < 10; n++) {
+            const unsigned i = uniform_int_distribution<unsigned>(0, k - 1)(r);
+            v.set<int32_t>(v.accessor().get<int32_t>(i) + 1, i);
+          }
+        });
+  }
+
+  {
+    io::BetaBernoulliNonConj_Shared m;
+    m.set_alpha(1.);
+    m.set_beta(2.);
+    add_model_benchmarks("bbnc",
+        []() { return make_shared<models::bbnc_model>(); },
+        to_bag(m),
+        [](value_mutator &v, rng_t &r) {
+          v.set<bool>(bernoulli_distribution(0.3)(r), 0);
+        });
+  }
+}
+
+static void
+add_group_manager_benchmarks()
+{
+  typedef group_manager<vector<shared_ptr<group>>> group_manager_t;
+  const size_t n = 10000;
+
+  auto populated = [=](rng_t &r) {
+    auto gm = make_shared<group_manager_t>(n);
+    gm->set_hp(to_bag([]() { io::CRP m; m.set_alpha(2.); return m; }()));
+    vector<size_t> gids;
+    for (size_t i = 0; i < 50; i++)
+      gids.push_back(gm->create_group().first);
+    for (size_t eid = 0; eid < n; eid++)
+      gm->add_value(util::sample_choice(gids, r), eid);
+    return gm;
+  };
+
+  bench::add("group_manager/reassign", 1, [=]() -> bench::body_fn {
+    auto r = make_shared<rng_t>(53);
+    auto gm = populated(*r);
+    return [r, gm](size_t iters) {
+      for (size_t i = 0; i < iters; i++) {
+        const size_t eid = i % n;
+        const size_t gid = gm->remove_value(eid).first;
+        gm->add_value(gid, eid);
+      }
+    };
+  });
+
+  bench::add("group_manager/create_delete", 1, [=]() -> bench::body_fn {
+    auto r = make_shared<rng_t>(53);
+    auto gm = populated(*r);
+    return [gm](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        gm->delete_group(gm->create_group().first);
+    };
+  });
+
+  bench::add("group_manager/score_assignment", n, [=]() -> bench::body_fn {
+    auto r = make_shared<rng_t>(53);
+    auto gm = populated(*r);
+    return [gm](size_t iters) {
+      float sum = 0.;
+      for (size_t i = 0; i < iters; i++)
+        sum += gm->score_assignment();
+      bench::do_not_optimize(sum);
+    };
+  });
+}
+
+namespace {
+
+// n rows of 20 mixed type features, 10% of them masked
+struct dataview_fixture {
+  explicit dataview_fixture(size_t n)
+    : r_(91)
+  {
+    workload::recarray_config config;
+    config.rows_ = n;
+    config.types_ = workload::mixed_types(20);
+    config.mask_density_ = 0.1;
+    config.clustering_ = workload::clustering(10, 1.);
+    workload_.reset(new workload::recarray_workload(config, r_));
+    view_ = workload_->dataview();
+  }
+
+  // touches every feature of the current row
+  inline float
+  consume(const row_accessor &row) const
+  {
+    row_accessor acc = row;
+    float sum = 0.;
+    for (acc.reset(); !acc.end(); acc.bump())
+      if (!acc.ismasked(0))
+        sum += acc.get().get<float>(0);
+    return sum;
+  }
+
+  rng_t r_;
+  unique_ptr<workload::recarray_workload> workload_;
+  shared_ptr<row_major_dataview> view_;
+};
+
+} // namespace
+
+static void
+add_dataview_benchmarks()
+{
+  const size_t n = 10000;
+
+  bench::add("dataview/iterate", n, [=]() -> bench::body_fn {
+    auto f = make_shared<dataview_fixture>(n);
+    return [f](size_t iters) {
+      float sum = 0.;
+      for (size_t i = 0; i < iters; i++)
+        for (f->view_->reset(); !f->view_->end(); f->view_->next())
+          sum += f->consume(f->view_->get());
+      bench::do_not_optimize(sum);
+    };
+  });
+
+  bench::add("dataview/permute_iterate", n, [=]() -> bench::body_fn {
+    auto f = make_shared<dataview_fixture>(n);
+    return [f](size_t iters) {
+      float sum = 0.;
+      for (size_t i = 0; i < iters; i++) {
+        f->view_->permute(f->r_);
+        for (f->view_->reset(); !f->view_->end(); f->view_->next())
+          sum += f->consume(f->view_->get());
+      }
+      bench::do_not_optimize(sum);
+    };
+  });
+
+  bench::add("dataview/blocked_permute_iterate", n, [=]() -> bench::body_fn {
+    auto f = make_shared<dataview_fixture>(n);
+    return [f](size_t iters) {
+      float sum = 0.;
+      for (size_t i = 0; i < iters; i++) {
+        f->view_->permute_blocked(f->r_);
+        for (f->view_->reset(); !f->view_->end(); f->view_->next())
+          sum += f->consume(f->view_->get());
+      }
+      bench::do_not_optimize(sum);
+    };
+  });
+
+  // random access through get(idx)
+  bench::add("dataview/get_index", 1, [=]() -> bench::body_fn {
+    auto f = make_shared<dataview_fixture>(n);
+    f->view_->reset_permutation();
+    auto idxs = make_shared<vector<size_t>>(util::permute(n, f->r_));
+    return [f, idxs, n](size_t iters) {
+      float sum = 0.;
+      for (size_t i = 0; i < iters; i++)
+        sum += f->consume(f->view_->get((*idxs)[i % n]));
+      bench::do_not_optimize(sum);
+    };
+  });
+}
+
+static void
+add_relation_benchmarks()
+{
+  // every row and then every column slice of a 1000 x 1000 relation
+  for (bool sparse : {false, true}) {
+    const string name = string("relation/slice/") + (sparse ? "sparse" : "dense");
+    bench::add(name, 2000, [sparse]() -> bench::body_fn {
+      rng_t r(17);
+      workload::relation_config config;
+      config.rows_ = config.cols_ = 1000;
+      config.density_ = sparse ? 0.01 : 0.9;
+      config.sparse_ = sparse;
+      config.row_clustering_ = config.col_clustering_ = workload::clustering(10, 1.);
+      auto w = make_shared<workload::relation_workload>(config, r);
+      auto view = w->dataview();
+      return [w, view](size_t iters) {
+        size_t sum = 0;
+        for (size_t i = 0; i < iters; i++)
+          for (size_t dim = 0; dim < 2; dim++)
+            for (size_t idx = 0; idx < view->shape()[dim]; idx++)
+              for (auto &p : view->slice(dim, idx))
+                sum += p.second.get<bool>(0);
+        bench::do_not_optimize(sum);
+      };
+    });
+  }
+}
+
+// 32 posterior samples of the assignments of n entities to 50 groups
+static shared_ptr<vector<vector<ssize_t>>>
+zmatrix_samples(size_t n)
+{
+  rng_t r(41);
+  auto samples = make_shared<vector<vector<ssize_t>>>();
+  for (size_t s = 0; s < 32; s++) {
+    const auto a = workload::sample_assignments(n, workload::clustering(50, 1.), r);
+    samples->emplace_back(a.begin(), a.end());
+  }
+  return samples;
+}
+
+static void
+add_zmatrix_benchmarks()
+{
+  // items are (i, j) pairs, per sample
+  const size_t n = 2000;
+  bench::add("zmatrix/dense", 32 * n * n, [=]() -> bench::body_fn {
+    auto samples = zmatrix_samples(n);
+    auto z = make_shared<vector<float>>(n * n);
+    return [=](size_t iters) {
+      for (size_t i = 0; i < iters; i++) {
+        dense_zmatrix zmat(n, 1);
+        for (const auto &a : *samples)
+          zmat.add(a);
+        zmat.copy_to(z->data());
+      }
+      bench::do_not_optimize(*z);
+    };
+  });
+
+  for (size_t k : {0, 10}) {
+    const string name = k ? "zmatrix/sparse_top_k" : "zmatrix/sparse_thresholded";
+    bench::add(name, 32 * n * n, [=]() -> bench::body_fn {
+      auto samples = zmatrix_samples(n);
+      return [=](size_t iters) {
+        for (size_t i = 0; i < iters; i++) {
+          sparse_zmatrix zmat(n, 1);
+          for (const auto &a : *samples)
+            zmat.add(a);
+          if (k) {
+            vector<ssize_t> neighbors(n * k);
+            vector<float> scores(n * k);
+            zmat.top_k(k, neighbors.data(), scores.data());
+            bench::do_not_optimize(scores);
+          } else {
+            vector<size_t> indptr;
+            vector<uint32_t> indices;
+            vector<float> data;
+            zmat.thresholded(0.5, indptr, indices, data);
+            bench::do_not_optimize(data);
+          }
+        }
+      };
+    });
+  }
+}
+
+static void
+add_sampling_benchmarks()
+{
+  bench::add("util/permute/10000", 10000, []() -> bench::body_fn {
+    auto r = make_shared<rng_t>(12);
+    auto pi = make_shared<vector<size_t>>();
+    return [r, pi](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        util::inplace_permute(*pi, 10000, *r);
+      bench::do_not_optimize(*pi);
+    };
+  });
+
+  bench::add("util/permute32/10000", 10000, []() -> bench::body_fn {
+    auto r = make_shared<rng_t>(12);
+    auto pi = make_shared<vector<uint32_t>>();
+    return [r, pi](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        util::inplace_permute(*pi, 10000, *r);
+      bench::do_not_optimize(*pi);
+    };
+  });
+
+  bench::add("util/blocked_permute/10000", 10000, []() -> bench::body_fn {
+    auto r = make_shared<rng_t>(12);
+    auto pi = make_shared<vector<uint32_t>>();
+    auto blocks = make_shared<vector<uint32_t>>();
+    return [r, pi, blocks](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        util::inplace_blocked_permute(*pi, *blocks, 10000, 64, *r);
+      bench::do_not_optimize(*pi);
+    };
+  });
+
+  for (size_t k : {10, 100, 1000}) {
+    bench::add("util/sample_discrete_log/" + to_string(k), 1, [k]() -> bench::body_fn {
+      auto r = make_shared<rng_t>(12);
+      auto scores = make_shared<vector<float>>(k);
+      for (auto &s : *scores)
+        s = normal_distribution<float>(0., 3.)(*r);
+      auto scratch = make_shared<vector<float>>();
+      return [r, scores, scratch](size_t iters) {
+        size_t sum = 0;
+        for (size_t i = 0; i < iters; i++) {
+          *scratch = *scores;
+          sum += util::sample_discrete_log(*scratch, *r);
+        }
+        bench::do_not_optimize(sum);
+      };
+    });
+  }
+
+  bench::add("random/sample_dirichlet/100", 1, []() -> bench::body_fn {
+    auto r = make_shared<rng_t>(12);
+    auto alphas = make_shared<vector<float>>(100, 0.5);
+    auto out = make_shared<vector<float>>(100);
+    return [r, alphas, out](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        random::sample_dirichlet(alphas->data(), alphas->size(), out->data(), *r);
+      bench::do_not_optimize(*out);
+    };
+  });
+
+  bench::add("random/sample_multinomial/100", 1, []() -> bench::body_fn {
+    auto r = make_shared<rng_t>(12);
+    auto p = make_shared<vector<float>>(100, 0.01);
+    auto out = make_shared<vector<unsigned>>(100);
+    return [r, p, out](size_t iters) {
+      for (size_t i = 0; i < iters; i++)
+        random::sample_multinomial(1000, p->data(), p->size(), out->data(), *r);
+      bench::do_not_optimize(*out);
+    };
+  });
+}
+
+// the overhead of instrumentation
+static void
+add_timer_benchmarks()
+{
+  for (auto m : {timer::T_CLK_MONOTONIC, timer::T_CLK_TSC}) {
+    const string name = (m == timer::T_CLK_TSC) ? "tsc" : "monotonic";
+    bench::add("timer/cur_nsec/" + name, 1, [m]() -> bench::body_fn {
+      return [m](size_t iters) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < iters; i++)
+          sum += timer::cur_nsec(m);
+        bench::do_not_optimize(sum);
+      };
+    });
+  }
+
+  bench::add("profiler/region", 1, []() -> bench::body_fn {
+    return [](size_t iters) {
+      for (size_t i = 0; i < iters; i++) {
+        MICROSCOPES_PROFILE_REGION("bench");
+      }
+    };
+  });
+}
+
+int
+main(int argc, char **argv)
+{
+  add_all_model_benchmarks();
+  add_group_manager_benchmarks();
+  add_dataview_benchmarks();
+  add_relation_benchmarks();
+  add_zmatrix_benchmarks();
+  add_sampling_benchmarks();
+  add_timer_benchmarks();
+  return bench::main(argc, argv);
+}
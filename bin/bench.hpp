@@ -0,0 +1,276 @@
+#pragma once
+
+#include <microscopes/common/macros.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * A small benchmark harness, in the spirit of Google Benchmark.
+ *
+ * Benchmarks are registered with a setup function, which builds the fixture
+ * and returns the body; the body is called with an iteration count and must
+ * run that many iterations. Each benchmark is run once to warm up, then the
+ * iteration count is grown until a run takes at least min_time, and then
+ * that many iterations are timed repetitions times.
+ *
+ * Results go to stderr as a table and, with --out, to a JSON file:
+ *
+ *   {"context": {...},
+ *    "benchmarks": [{"name": ..., "iterations": ..., "repetitions": ...,
+ *                    "items_per_iteration": ...,
+ *                    "ns_per_iteration": {"mean": ..., "median": ...,
+ *                                         "stddev": ..., "min": ..., "max": ...},
+ *                    "items_per_second": ...}, ...]}
+ */
+namespace microscopes {
+namespace bench {
+
+typedef std::function<void(size_t)> body_fn;
+typedef std::function<body_fn()> setup_fn;
+
+struct benchmark {
+  std::string name_;
+  size_t items_per_iteration_;
+  setup_fn setup_;
+};
+
+struct result {
+  std::string name_;
+  size_t iterations_;
+  size_t items_per_iteration_;
+  std::vector<double> ns_per_iteration_; // one per repetition
+};
+
+struct options {
+  options()
+    : filter_(), out_(), repetitions_(5), min_time_(0.1), list_(false) {}
+
+  std::string filter_; // substring of the names to run
+  std::string out_; // JSON output file, if any
+  size_t repetitions_;
+  double min_time_; // seconds, per repetition
+  bool list_;
+};
+
+static inline std::vector<benchmark> &
+registry()
+{
+  static std::vector<benchmark> benchmarks;
+  return benchmarks;
+}
+
+// registers a benchmark whose iterations each process items_per_iteration
+// items (e.g. values scored)
+static inline void
+add(const std::string &name, size_t items_per_iteration, setup_fn setup)
+{
+  registry().push_back(benchmark{name, items_per_iteration, setup});
+}
+
+// keeps the compiler from optimizing away the computation of value
+template <typename T>
+static inline ALWAYS_INLINE void
+do_not_optimize(const T &value)
+{
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+static inline double
+time_body(const body_fn &body, size_t iterations)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  body(iterations);
+  const auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static inline result
+run(const benchmark &b, const options &opts)
+{
+  body_fn body = b.setup_();
+
+  // warm up, then find an iteration count which takes at least min_time
+  time_body(body, 1);
+  size_t iterations = 1;
+  for (;;) {
+    const double t = time_body(body, iterations);
+    if (t >= opts.min_time_ || iterations >= (size_t(1) << 30))
+      break;
+    const double scale = (t > 0.) ? 1.4 * opts.min_time_ / t : 10.;
+    iterations = std::max(iterations + 1,
+        size_t(iterations * std::min(10., scale)));
+  }
+
+  result r{b.name_, iterations, b.items_per_iteration_, {}};
+  for (size_t i = 0; i < opts.repetitions_; i++)
+    r.ns_per_iteration_.push_back(1e9 * time_body(body, iterations) / iterations);
+  return r;
+}
+
+struct stats {
+  explicit stats(std::vector<double> xs)
+  {
+    std::sort(xs.begin(), xs.end());
+    const size_t n = xs.size();
+    min_ = xs.front();
+    max_ = xs.back();
+    median_ = (n % 2) ? xs[n / 2] : 0.5 * (xs[n / 2 - 1] + xs[n / 2]);
+    mean_ = 0.;
+    for (auto x : xs)
+      mean_ += x / n;
+    double var = 0.;
+    for (auto x : xs)
+      var += (x - mean_) * (x - mean_);
+    stddev_ = (n > 1) ? std::sqrt(var / (n - 1)) : 0.;
+  }
+
+  double mean_, median_, stddev_, min_, max_;
+};
+
+static inline std::string
+json_escape(const std::string &s)
+{
+  std::string ret;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      ret += '\\';
+    ret += c;
+  }
+  return ret;
+}
+
+static inline void
+write_json(std::ostream &os, const std::vector<result> &results,
+           const options &opts)
+{
+  char host[256] = {};
+  gethostname(host, sizeof(host) - 1);
+  char date[64] = {};
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#ifdef NDEBUG
+  const bool debug = false;
+#else
+  const bool debug = true;
+#endif
+
+  os << std::setprecision(9);
+  os << "{\n"
+     << "  \"context\": {\n"
+     << "    \"date\": \"" << date << "\",\n"
+     << "    \"host_name\": \"" << json_escape(host) << "\",\n"
+     << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+     << "    \"debug_build\": " << (debug ? "true" : "false") << ",\n"
+     << "    \"repetitions\": " << opts.repetitions_ << ",\n"
+     << "    \"min_time\": " << opts.min_time_ << "\n"
+     << "  },\n"
+     << "  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const result &r = results[i];
+    const stats s(r.ns_per_iteration_);
+    os << (i ? ",\n" : "\n")
+       << "    {\"name\": \"" << json_escape(r.name_) << "\", "
+       << "\"iterations\": " << r.iterations_ << ", "
+       << "\"repetitions\": " << r.ns_per_iteration_.size() << ", "
+       << "\"items_per_iteration\": " << r.items_per_iteration_ << ", "
+       << "\"ns_per_iteration\": {"
+       << "\"mean\": " << s.mean_ << ", "
+       << "\"median\": " << s.median_ << ", "
+       << "\"stddev\": " << s.stddev_ << ", "
+       << "\"min\": " << s.min_ << ", "
+       << "\"max\": " << s.max_ << "}, "
+       << "\"items_per_second\": " << (1e9 * r.items_per_iteration_ / s.median_)
+       << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+static inline void
+usage(const char *prog)
+{
+  std::cerr
+    << "usage: " << prog << " [--filter=SUBSTR] [--repetitions=N]"
+    << " [--min_time=SECONDS] [--out=FILE.json] [--list]" << std::endl;
+}
+
+static inline bool
+parse_options(int argc, char **argv, options &opts)
+{
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+    if (key == "--filter")
+      opts.filter_ = value;
+    else if (key == "--out")
+      opts.out_ = value;
+    else if (key == "--repetitions")
+      opts.repetitions_ = std::max(1L, std::atol(value.c_str()));
+    else if (key == "--min_time")
+      opts.min_time_ = std::atof(value.c_str());
+    else if (key == "--list")
+      opts.list_ = true;
+    else
+      return false;
+  }
+  return true;
+}
+
+// runs the registered benchmarks as directed by the command line
+static inline int
+main(int argc, char **argv)
+{
+  options opts;
+  if (!parse_options(argc, argv, opts)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<result> results;
+  for (const auto &b : registry()) {
+    if (b.name_.find(opts.filter_) == std::string::npos)
+      continue;
+    if (opts.list_) {
+      std::cout << b.name_ << std::endl;
+      continue;
+    }
+    results.push_back(run(b, opts));
+    const stats s(results.back().ns_per_iteration_);
+    std::cerr << std::left << std::setw(40) << b.name_ << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(14) << s.median_ << " ns/iter"
+              << " +/- " << std::setprecision(1)
+              << (s.median_ > 0. ? 100. * s.stddev_ / s.median_ : 0.) << "%"
+              << std::setw(12) << results.back().iterations_ << " iters"
+              << std::endl;
+  }
+
+  if (!opts.out_.empty()) {
+    std::ofstream out(opts.out_);
+    if (!out) {
+      std::cerr << "could not open " << opts.out_ << std::endl;
+      return 1;
+    }
+    write_json(out, results, opts);
+  }
+  return 0;
+}
+
+} // namespace bench
+} // namespace microscopes
@@ -3,8 +3,10 @@
 #include <microscopes/common/typedefs.hpp>
 #include <microscopes/common/macros.hpp>
 #include <microscopes/common/assert.hpp>
+#include <microscopes/common/metrics.hpp>
 #include <microscopes/common/util.hpp>
 #include <microscopes/common/runtime_value.hpp>
+#include <microscopes/common/snapshot.hpp>
 #include <microscopes/io/schema.pb.h>
 #include <distributions/special.hpp>
 #include <distributions/io/protobuf.hpp>
@@ -57,7 +59,8 @@ public:
       gcount_(),
       gempty_(),
       assignments_(),
-      groups_()
+      groups_(),
+      generation_()
   {}
 
   group_manager(size_t n)
@@ -65,23 +68,25 @@ public:
       gcount_(),
       gempty_(),
       assignments_(n, -1),
-      groups_()
+      groups_(),
+      generation_()
   {}
 
   group_manager(
       const serialized_t &repr,
       std::function<T(const std::string &)> group_deserializer_fn)
-    : alpha_(), gcount_(), gempty_(), assignments_(), groups_()
+    : alpha_(), gcount_(), gempty_(), assignments_(), groups_(),
+      generation_()
   {
     io::GroupManager m;
     util::protobuf_from_string(m, repr);
-    MICROSCOPES_DCHECK(m.alpha() > 0., "alphas can only be positive");
-    MICROSCOPES_DCHECK(m.assignments_size() > 0, "no entities given");
+    MICROSCOPES_CHECK(m.alpha() > 0., "alphas can only be positive");
+    MICROSCOPES_CHECK(m.assignments_size() > 0, "no entities given");
 
     alpha_ = m.alpha();
     std::map<size_t, size_t> counts;
     for (size_t i = 0; i < (size_t)m.assignments_size(); i++) {
-      MICROSCOPES_DCHECK(
+      MICROSCOPES_CHECK(
           m.assignments(i) == -1 || m.assignments(i) >= 0,
           "invalid group id");
       assignments_.push_back(m.assignments(i));
@@ -104,10 +109,53 @@ public:
       gcount_ = groups_.crbegin()->first + 1;
   }
 
+  // restores a group manager written by dump()
+  group_manager(
+      snapshot_reader &r,
+      std::function<T(snapshot_reader &)> group_load_fn)
+    : alpha_(), gcount_(), gempty_(), assignments_(), groups_(),
+      generation_()
+  {
+    static_assert(sizeof(ssize_t) == sizeof(int64_t), "LP64 assumed");
+    // snapshots come from files, so validate them in release builds too
+    alpha_ = r.read<float>();
+    MICROSCOPES_CHECK(alpha_ > 0., "alphas can only be positive");
+    gcount_ = r.read<uint64_t>();
+    size_t n;
+    const int64_t *px = r.read_array<int64_t>(n);
+    assignments_.assign(px, px + n);
+    std::map<size_t, size_t> counts;
+    for (ssize_t gid : assignments_) {
+      MICROSCOPES_CHECK(
+          gid == -1 || (gid >= 0 && size_t(gid) < gcount_),
+          "invalid group id");
+      if (gid != -1)
+        counts[gid]++;
+    }
+    const size_t ngroups = r.read<uint64_t>();
+    for (size_t i = 0; i < ngroups; i++) {
+      const size_t gid = r.read<uint64_t>();
+      const size_t count = r.read<uint64_t>();
+      MICROSCOPES_CHECK(gid < gcount_, "invalid group id");
+      MICROSCOPES_CHECK(!groups_.count(gid), "duplicate group id");
+      const auto it = counts.find(gid);
+      MICROSCOPES_CHECK(
+          count == ((it == counts.end()) ? 0 : it->second),
+          "group count does not match assignments");
+      groups_[gid] = gd<T>(count, group_load_fn(r));
+      if (!count)
+        gempty_.insert(gid);
+    }
+    // every group assigned to was matched by a non-empty group above
+    MICROSCOPES_CHECK(
+        counts.size() == groups_.size() - gempty_.size(),
+        "entity assigned to missing group");
+  }
+
   inline hyperparam_bag_t
   get_hp() const
   {
-    message_type m;
+    message_type &m = util::scratch_message<message_type>();
     m.set_alpha(alpha_);
     return util::protobuf_to_string(m);
   }
@@ -115,7 +163,7 @@ public:
   inline void
   set_hp(const hyperparam_bag_t &hp)
   {
-    message_type m;
+    message_type &m = util::scratch_message<message_type>();
     util::protobuf_from_string(m, hp);
     MICROSCOPES_DCHECK(m.alpha() > 0.0, "alpha must be positive");
     alpha_ = m.alpha();
@@ -144,6 +192,10 @@ public:
   inline size_t nentities() const { return assignments_.size(); }
   inline size_t ngroups() const { return groups_.size(); }
 
+  // changes on every create_group(), delete_group(), add_value() and
+  // remove_value(), see models::mixture
+  inline const uint64_t & generation() const { return generation_; }
+
   inline bool
   isactivegroup(size_t gid) const
   {
@@ -197,22 +249,26 @@ public:
   inline std::pair<size_t, T&>
   create_group()
   {
+    MICROSCOPES_METRIC_INC(M_GROUP_MANAGER_CREATE_GROUP);
     const size_t gid = gcount_++;
     auto &g = groups_[gid]; // create the group
     MICROSCOPES_ASSERT(!gempty_.count(gid));
     gempty_.insert(gid);
+    generation_++;
     return std::pair<size_t, T&>(gid, g.data_);
   }
 
   inline void
   delete_group(size_t gid)
   {
+    MICROSCOPES_METRIC_INC(M_GROUP_MANAGER_DELETE_GROUP);
     auto it = groups_.find(gid);
     MICROSCOPES_DCHECK(it != groups_.end(), "invalid gid");
     MICROSCOPES_DCHECK(!it->second.count_, "group not empty");
     MICROSCOPES_ASSERT(gempty_.count(gid));
     groups_.erase(it);
     gempty_.erase(gid);
+    generation_++;
   }
 
   inline T &
@@ -229,6 +285,7 @@ public:
       MICROSCOPES_ASSERT(!gempty_.count(gid));
     }
     assignments_[eid] = gid;
+    generation_++;
     return it->second.data_;
   }
 
@@ -244,6 +301,7 @@ public:
     if (!--it->second.count_)
       gempty_.insert(gid);
     assignments_[eid] = -1;
+    generation_++;
     return std::pair<size_t, T&>(gid, it->second.data_);
   }
 
@@ -297,12 +355,36 @@ public:
     return util::protobuf_to_string(m);
   }
 
+  /**
+   * Writes this group manager in the flat snapshot format. Unlike
+   * serialize(), group counts are stored directly, and group data is
+   * written inline by group_dump_fn.
+   */
+  void
+  dump(snapshot_writer &w,
+       std::function<void(const T &, snapshot_writer &)> group_dump_fn) const
+  {
+    static_assert(sizeof(ssize_t) == sizeof(int64_t), "LP64 assumed");
+    w.write<float>(alpha_);
+    w.write<uint64_t>(gcount_);
+    w.write_array(
+        reinterpret_cast<const int64_t *>(assignments_.data()),
+        assignments_.size());
+    w.write<uint64_t>(groups_.size());
+    for (auto &p : groups_) {
+      w.write<uint64_t>(p.first);
+      w.write<uint64_t>(p.second.count_);
+      group_dump_fn(p.second.data_, w);
+    }
+  }
+
 protected:
   float alpha_;
   size_t gcount_;
   std::set<size_t> gempty_;
   std::vector<ssize_t> assignments_;
   std::map<size_t, gd<T>> groups_;
+  uint64_t generation_;
 };
 
 /**
@@ -339,6 +421,7 @@ public:
   inline std::pair<size_t, T&>
   create_group()
   {
+    MICROSCOPES_METRIC_INC(M_GROUP_MANAGER_CREATE_GROUP);
     const size_t gid = gcount_++;
     auto &g = groups_[gid];
     return std::pair<size_t, T&>(gid, g);
@@ -347,6 +430,7 @@ public:
   inline void
   delete_group(size_t gid)
   {
+    MICROSCOPES_METRIC_INC(M_GROUP_MANAGER_DELETE_GROUP);
     auto it = groups_.find(gid);
     MICROSCOPES_DCHECK(it != groups_.end(), "invalid gid");
     groups_.erase(it);
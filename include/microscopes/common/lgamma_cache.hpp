@@ -0,0 +1,173 @@
+#pragma once
+
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+#include <distributions/special.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace microscopes {
+namespace common {
+
+/**
+ * A table of lgamma(n + alphas[i]) and lgamma(n + sum_i alphas[i]), for
+ * integer n in [0, size()). Lookups past the end of the table fall back to
+ * computing the value directly.
+ *
+ * The row of each category (and of the sum) is only built once it has been
+ * looked up size() times, computing lookups directly until then. A row
+ * costs size() lgamma()s to build, so this is never more than twice the
+ * work of having built just the rows which pay off, and categories which are
+ * rarely (or never) touched, e.g. under alphas which only live for a single
+ * MH proposal, cost nothing.
+ *
+ * Each slot holds either a pointer to its row, or (with the low bit set) its
+ * # of lookups so far. Rows are published at most once, so lookups are safe
+ * to do concurrently.
+ */
+class lgamma_shifted_table {
+  friend class lgamma_cache;
+public:
+  ~lgamma_shifted_table();
+
+  inline float
+  lgamma(size_t i, unsigned n) const
+  {
+    MICROSCOPES_ASSERT(i < alphas_.size());
+    return lookup(i, alphas_[i], n);
+  }
+
+  inline float
+  lgamma_sum(unsigned n) const
+  {
+    return lookup(alphas_.size(), alpha_sum_, n);
+  }
+
+  inline const std::vector<float> & alphas() const { return alphas_; }
+  inline float alpha_sum() const { return alpha_sum_; }
+  inline unsigned size() const { return size_; }
+
+private:
+  lgamma_shifted_table(const float *alphas, size_t k, unsigned size);
+
+  lgamma_shifted_table(const lgamma_shifted_table &) = delete;
+  lgamma_shifted_table &operator=(const lgamma_shifted_table &) = delete;
+
+  inline bool
+  matches(const float *alphas, size_t k) const
+  {
+    return k == alphas_.size() && std::equal(alphas, alphas + k, alphas_.begin());
+  }
+
+  inline float
+  lookup(size_t slot, float alpha, unsigned n) const
+  {
+    if (likely(n < size_)) {
+      const uintptr_t v = slots_[slot].load(std::memory_order_acquire);
+      if (likely(!(v & 1)))
+        return reinterpret_cast<const float *>(v)[n];
+      return miss(slot, alpha, n);
+    }
+    return distributions::fast_lgamma(float(n) + alpha);
+  }
+
+  float miss(size_t slot, float alpha, unsigned n) const;
+
+  std::vector<float> alphas_;
+  float alpha_sum_;
+  unsigned size_;
+  // alphas_.size() + 1, the last one for the sum
+  std::unique_ptr<std::atomic<uintptr_t>[]> slots_;
+};
+
+/**
+ * Lazily built (and grown) lgamma_shifted_table for a hypers object whose
+ * parameters are a vector of alphas, e.g. dm_hypers.
+ *
+ * Tables are sized to the next power of two covering the requested n, and
+ * doubled as larger counts are seen, up to MaxSize values per category or
+ * MaxEntries values in total (so tables for very many categories stay
+ * small). Since rows are built lazily (see lgamma_shifted_table), creating
+ * a table is O(k), and only the categories in use take up memory.
+ *
+ * The owner must call invalidate() on every change to its alphas, from its
+ * non-const mutators (e.g. set_hp), which by contract do not run
+ * concurrently with scoring. The next get() then looks for a table built for
+ * the new alphas among the MaxTables most recently used ones (so that e.g. a
+ * rejected MH proposal which restores the previous alphas finds their table
+ * again), and only builds one if there is none.
+ *
+ * get() is safe to call concurrently: tables are never modified once
+ * published. Tables which are superseded or evicted (least recently used
+ * first) while readers may still hold them are freed on the next
+ * invalidate() or clear(). Copies start out empty.
+ */
+class lgamma_cache {
+public:
+  static const unsigned MaxSize = 1024;
+  static const size_t MaxTables = 8;
+  static const size_t MaxEntries = 1 << 20;
+
+  lgamma_cache() : current_(nullptr), mutex_(), tables_(), retired_() {}
+  lgamma_cache(const lgamma_cache &) : lgamma_cache() {}
+
+  lgamma_cache &
+  operator=(const lgamma_cache &)
+  {
+    clear();
+    return *this;
+  }
+
+  /**
+   * A table for alphas (which must be the owner's current alphas), covering
+   * [0, n) if possible; may return a table smaller than n if n > MaxSize.
+   */
+  inline const lgamma_shifted_table *
+  get(const float *alphas, size_t k, unsigned n) const
+  {
+    const lgamma_shifted_table *t = current_.load(std::memory_order_acquire);
+    if (likely(t && t->size_ >= std::min(n, max_size(k))))
+      return t;
+    return rebuild(alphas, k, n);
+  }
+
+  inline const lgamma_shifted_table *
+  get(const std::vector<float> &alphas, unsigned n) const
+  {
+    return get(alphas.data(), alphas.size(), n);
+  }
+
+  // the alphas changed: keeps the recently used tables for lookup
+  void invalidate();
+
+  // drops all tables
+  void clear();
+
+private:
+  static inline unsigned
+  max_size(size_t k)
+  {
+    const size_t rows = MaxEntries / std::max(k, size_t(1));
+    return std::max(size_t(1), std::min(size_t(MaxSize), rows));
+  }
+
+  const lgamma_shifted_table *
+  rebuild(const float *alphas, size_t k, unsigned n) const;
+
+  // retires tables_[i], which readers may still hold
+  void retire(size_t i) const;
+
+  mutable std::atomic<const lgamma_shifted_table *> current_;
+  mutable std::mutex mutex_;
+  // least recently used first
+  mutable std::vector<std::unique_ptr<lgamma_shifted_table>> tables_;
+  mutable std::vector<std::unique_ptr<lgamma_shifted_table>> retired_;
+};
+
+} // namespace common
+} // namespace microscopes
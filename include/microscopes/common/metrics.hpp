@@ -0,0 +1,146 @@
+#pragma once
+
+#include <microscopes/common/macros.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Hot path instrumentation: per-thread counters and log2 histograms.
+ *
+ * Instrumentation is compiled in only when MICROSCOPES_METRICS is defined
+ * (cmake -DMICROSCOPES_METRICS=ON); otherwise the MICROSCOPES_METRIC_*
+ * macros expand to nothing. When enabled, an update is a relaxed load and
+ * store to a thread local slot (no locked instructions, no sharing), so
+ * counting in add_value()/score_value() is cheap enough for production
+ * sweeps.
+ *
+ * Threads register their slots on first use; metrics::aggregate() sums
+ * over all live threads plus those which have exited.
+ *
+ * To add a metric, add it to the lists below.
+ */
+
+#define MICROSCOPES_METRICS_FOR_EACH_COUNTER(x) \
+  x(M_GROUP_ADD_VALUE, "group.add_value") \
+  x(M_GROUP_REMOVE_VALUE, "group.remove_value") \
+  x(M_GROUP_SCORE_VALUE, "group.score_value") \
+  x(M_GROUP_SCORE_DATA, "group.score_data") \
+  x(M_MIXTURE_SCORE_VALUE, "mixture.score_value_all_groups") \
+  x(M_GROUP_MANAGER_CREATE_GROUP, "group_manager.create_group") \
+  x(M_GROUP_MANAGER_DELETE_GROUP, "group_manager.delete_group") \
+  x(M_SLICE_ELEMENTS, "relation.slice_elements") \
+  x(M_PROTOBUF_BYTES_OUT, "protobuf.bytes_serialized") \
+  x(M_PROTOBUF_BYTES_IN, "protobuf.bytes_deserialized") \
+  x(M_SNAPSHOT_BYTES_OUT, "snapshot.bytes_written") \
+  x(M_SNAPSHOT_BYTES_IN, "snapshot.bytes_read")
+
+#define MICROSCOPES_METRICS_FOR_EACH_HISTOGRAM(x) \
+  x(H_PROTOBUF_MESSAGE_BYTES, "protobuf.message_bytes") \
+  x(H_MIXTURE_GROUPS, "mixture.groups_scored")
+
+#ifdef MICROSCOPES_METRICS
+  #define MICROSCOPES_METRIC_ADD(c, n) \
+    ::microscopes::common::metrics::detail::local().add( \
+        ::microscopes::common::metrics::c, (n))
+  #define MICROSCOPES_METRIC_OBSERVE(h, v) \
+    ::microscopes::common::metrics::detail::local().observe( \
+        ::microscopes::common::metrics::h, (v))
+#else
+  #define MICROSCOPES_METRIC_ADD(c, n) ((void)0)
+  #define MICROSCOPES_METRIC_OBSERVE(h, v) ((void)0)
+#endif
+
+#define MICROSCOPES_METRIC_INC(c) MICROSCOPES_METRIC_ADD(c, 1)
+
+namespace microscopes {
+namespace common {
+namespace metrics {
+
+enum counter_t {
+#define MICROSCOPES_METRICS_ENUM(e, name) e,
+  MICROSCOPES_METRICS_FOR_EACH_COUNTER(MICROSCOPES_METRICS_ENUM)
+#undef MICROSCOPES_METRICS_ENUM
+  NCOUNTERS
+};
+
+enum histogram_t {
+#define MICROSCOPES_METRICS_ENUM(e, name) e,
+  MICROSCOPES_METRICS_FOR_EACH_HISTOGRAM(MICROSCOPES_METRICS_ENUM)
+#undef MICROSCOPES_METRICS_ENUM
+  NHISTOGRAMS
+};
+
+// bucket 0 holds zeros, and bucket i > 0 holds values in [2^(i-1), 2^i)
+static const size_t NBuckets = 65;
+
+static inline size_t
+bucket(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+struct report {
+  std::map<std::string, uint64_t> counters_;
+  std::map<std::string, std::vector<uint64_t>> histograms_;
+};
+
+// true if the library was built with MICROSCOPES_METRICS
+bool enabled();
+
+// the totals across all threads
+report aggregate();
+
+// zeros all metrics; updates racing with reset() may survive it
+void reset();
+
+namespace detail {
+
+class thread_metrics {
+public:
+  thread_metrics();
+  ~thread_metrics();
+
+  thread_metrics(const thread_metrics &) = delete;
+  thread_metrics &operator=(const thread_metrics &) = delete;
+
+  // only the owning thread writes, so a load and a store suffice; the
+  // atomics make concurrent reads by aggregate() well defined
+  inline ALWAYS_INLINE void
+  add(counter_t c, uint64_t n)
+  {
+    bump(counters_[c], n);
+  }
+
+  inline ALWAYS_INLINE void
+  observe(histogram_t h, uint64_t v)
+  {
+    bump(histograms_[h][bucket(v)], 1);
+  }
+
+  std::atomic<uint64_t> counters_[NCOUNTERS];
+  std::atomic<uint64_t> histograms_[NHISTOGRAMS][NBuckets];
+
+private:
+  static inline ALWAYS_INLINE void
+  bump(std::atomic<uint64_t> &x, uint64_t n)
+  {
+    x.store(x.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+};
+
+static inline thread_metrics &
+local()
+{
+  static thread_local thread_metrics m;
+  return m;
+}
+
+} // namespace detail
+
+} // namespace metrics
+} // namespace common
+} // namespace microscopes
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Routines over assignment vectors (entity -> group id), all linear in the
+ * # of entities. Group ids are only compared for equality, so any labels
+ * work (a negative id, such as the -1 of an unassigned entity, is a group
+ * like any other).
+ *
+ * The canonical labeling of an assignment vector numbers its groups 0, 1,
+ * ... in order of their first entity; two vectors describe the same
+ * partition iff their canonical labelings are equal.
+ */
+
+namespace microscopes {
+namespace common {
+namespace partition {
+
+// writes the canonical labels of assignment into out, which must hold
+// assignment.size() entries, and returns the # of groups
+size_t relabel(const std::vector<ssize_t> &assignment, uint32_t *out);
+
+std::vector<ssize_t> canonical(const std::vector<ssize_t> &assignment);
+
+// group g (a canonical label) is members_[offsets_[g]:offsets_[g+1]], in
+// increasing order
+struct groups_t {
+  inline size_t ngroups() const { return offsets_.size() - 1; }
+  inline size_t groupsize(size_t g) const { return offsets_[g + 1] - offsets_[g]; }
+
+  std::vector<size_t> offsets_;
+  std::vector<size_t> members_;
+};
+
+groups_t groups(const std::vector<ssize_t> &assignment);
+
+// entry s is the # of groups with s entities, up to the largest group
+std::vector<size_t> size_histogram(const std::vector<ssize_t> &assignment);
+
+// the adjusted Rand index of Hubert and Arabie (1985): 1 for equal
+// partitions, 0 in expectation for independent ones
+double adjusted_rand_index(const std::vector<ssize_t> &a,
+                           const std::vector<ssize_t> &b);
+
+// the variation of information of Meila (2007), H(a|b) + H(b|a) in nats: 0
+// for equal partitions, at most log(n)
+double variation_of_information(const std::vector<ssize_t> &a,
+                                const std::vector<ssize_t> &b);
+
+} // namespace partition
+} // namespace common
+} // namespace microscopes
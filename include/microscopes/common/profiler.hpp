@@ -0,0 +1,152 @@
+#pragma once
+
+#include <microscopes/common/timer.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * A hierarchical region profiler: instead of printing each scope, like
+ * scoped_timer, regions accumulate their total time and # of entries into a
+ * per-thread tree (a region's node depends on the regions enclosing it), to
+ * be reported at the end of a run:
+ *
+ *   for (...) {
+ *     MICROSCOPES_PROFILE_REGION("sweep");
+ *     ...
+ *     {
+ *       MICROSCOPES_PROFILE_REGION("score");
+ *       ...
+ *     }
+ *   }
+ *   profiler::local().report(std::cerr);
+ *
+ * Entering and leaving a region reads the TSC twice and bumps a few
+ * counters of a (thread local) node, so regions can go inside sampler loops.
+ * Region names must be string literals, or otherwise outlive the profiler.
+ */
+
+namespace microscopes {
+namespace common {
+
+class profiler {
+public:
+  struct region {
+    region(const char *name, region *parent)
+      : name_(name), parent_(parent), ticks_(), count_(), children_() {}
+
+    region(const region &) = delete;
+    region &operator=(const region &) = delete;
+
+    // the child called name, which is created if need be
+    inline region *
+    child(const char *name)
+    {
+      // regions are named by literals, so pointer equality nearly always
+      // finds them
+      for (const auto &c : children_)
+        if (likely(c->name_ == name))
+          return c.get();
+      return find_or_create(name);
+    }
+
+    inline double nsec() const { return ticks_ * nsec_per_tick(); }
+
+    const char *name_;
+    region *parent_;
+    uint64_t ticks_;
+    uint64_t count_;
+    std::vector<std::unique_ptr<region>> children_;
+
+  private:
+    region *find_or_create(const char *name);
+  };
+
+  profiler() : root_("", nullptr), cur_(&root_) {}
+
+  profiler(const profiler &) = delete;
+  profiler &operator=(const profiler &) = delete;
+
+  // the calling thread's profiler
+  static profiler & local();
+
+  // the clock regions are timed with: the TSC where available, otherwise
+  // CLOCK_MONOTONIC
+  static inline ALWAYS_INLINE uint64_t
+  ticks()
+  {
+#ifdef MICROSCOPES_HAVE_TSC
+    return timer::rdtsc();
+#else
+    return timer::monotonic_nsec();
+#endif
+  }
+
+  static double nsec_per_tick();
+
+  inline void
+  enter(const char *name)
+  {
+    cur_ = cur_->child(name);
+  }
+
+  inline void
+  exit(uint64_t ticks)
+  {
+    MICROSCOPES_ASSERT(cur_ != &root_);
+    cur_->ticks_ += ticks;
+    cur_->count_++;
+    cur_ = cur_->parent_;
+  }
+
+  // the top level regions are the root's children
+  inline const region & root() const { return root_; }
+
+  // discards all regions; must not be called from within one
+  void reset();
+
+  // one line per region: total ms, # of entries, ns per entry, % of the
+  // enclosing region, and self ms (the time not spent in subregions)
+  void report(std::ostream &os) const;
+  std::string report() const;
+
+private:
+  region root_;
+  region *cur_;
+};
+
+class scoped_region {
+public:
+  explicit scoped_region(const char *name)
+    : p_(profiler::local())
+  {
+    p_.enter(name);
+    t0_ = profiler::ticks();
+  }
+
+  scoped_region(const scoped_region &) = delete;
+  scoped_region &operator=(const scoped_region &) = delete;
+
+  ~scoped_region()
+  {
+    p_.exit(profiler::ticks() - t0_);
+  }
+
+private:
+  profiler &p_;
+  uint64_t t0_;
+};
+
+#define MICROSCOPES_PROFILE_CONCAT_(a, b) a ## b
+#define MICROSCOPES_PROFILE_CONCAT(a, b) MICROSCOPES_PROFILE_CONCAT_(a, b)
+#define MICROSCOPES_PROFILE_REGION(name) \
+  ::microscopes::common::scoped_region \
+    MICROSCOPES_PROFILE_CONCAT(microscopes_profile_region_, __LINE__)(name)
+
+} // namespace common
+} // namespace microscopes
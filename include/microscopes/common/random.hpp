@@ -8,6 +8,7 @@
 #include <eigen3/Eigen/Cholesky>
 
 #include <cmath>
+#include <limits>
 #include <random>
 #include <utility>
 #include <iostream>
@@ -17,6 +18,66 @@ namespace common {
 
 struct random {
 
+  /**
+   * Writes a draw from Dirichlet(alphas[0], ..., alphas[k-1]) to out.
+   *
+   * Each component is drawn as a Gamma(alpha_i, 1) in log space (using
+   * Gamma(a) = Gamma(a+1) * U^(1/a) for a < 1), so that very small alphas
+   * do not underflow to an all zero draw.
+   */
+  template <typename T>
+  static inline void
+  sample_dirichlet(const T *alphas, size_t k, float *out, rng_t &rng)
+  {
+    MICROSCOPES_ASSERT(k > 0);
+    std::uniform_real_distribution<double> unif;
+    double log_max = -std::numeric_limits<double>::infinity();
+    // out holds log gamma draws until normalized below
+    for (size_t i = 0; i < k; i++) {
+      const double a = alphas[i];
+      MICROSCOPES_ASSERT(a > 0.);
+      double log_g;
+      if (a < 1.) {
+        const double g = std::gamma_distribution<double>(a + 1.)(rng);
+        log_g = std::log(g) + std::log(unif(rng)) / a;
+      } else {
+        log_g = std::log(std::gamma_distribution<double>(a)(rng));
+      }
+      out[i] = log_g;
+      log_max = std::max(log_max, log_g);
+    }
+    double sum = 0.;
+    for (size_t i = 0; i < k; i++) {
+      out[i] = std::exp(double(out[i]) - log_max);
+      sum += out[i];
+    }
+    for (size_t i = 0; i < k; i++)
+      out[i] /= sum;
+  }
+
+  /**
+   * Writes a draw from Multinomial(n, p[0], ..., p[k-1]) to out, as a chain
+   * of conditional binomials: O(k) binomial draws, independent of n, and
+   * stopping early once all n trials are placed.
+   */
+  static inline void
+  sample_multinomial(unsigned n, const float *p, size_t k, unsigned *out, rng_t &rng)
+  {
+    MICROSCOPES_ASSERT(k > 0);
+    double mass = 1.;
+    size_t i = 0;
+    for (; i + 1 < k && n; i++) {
+      const double pi = (mass > 0.) ? std::min(1., std::max(0., p[i] / mass)) : 1.;
+      const unsigned xi = std::binomial_distribution<unsigned>(n, pi)(rng);
+      out[i] = xi;
+      n -= xi;
+      mass -= p[i];
+    }
+    for (; i + 1 < k; i++)
+      out[i] = 0;
+    out[k - 1] = n;
+  }
+
   /**
    * Assumes sigma is positive definite
    */
@@ -70,15 +131,37 @@ struct random {
     return X * X.transpose();
   }
 
+  /**
+   * With psi = L L^T and the Bartlett factor A of a W(nu, I) draw, sigma^-1 =
+   * (L^-T A)(L^-T A)^T is a W(nu, psi^-1) draw, so
+   *
+   *   sigma = (L A^-T)(L A^-T)^T
+   *
+   * is an IW(nu, psi) draw. L A^-T is computed with a triangular solve, so no
+   * inverses are formed.
+   */
   static inline Eigen::MatrixXf
   sample_inverse_wishart(float nu, const Eigen::MatrixXf &psi, rng_t &rng)
   {
-    // XXX: horrible
-    Eigen::MatrixXf psi_inv = psi.inverse();
-    Eigen::MatrixXf sigma_inv = sample_wishart(nu, psi_inv, rng);
-    //std::cout << "psi_inv: " << psi_inv << std::endl;
-    //std::cout << "sigma_inv: " << sigma_inv << std::endl;
-    return sigma_inv.inverse();
+    MICROSCOPES_ASSERT(psi.rows() == psi.cols());
+    MICROSCOPES_ASSERT(util::is_symmetric_positive_definite(psi));
+
+    Eigen::LLT<Eigen::MatrixXf> llt(psi);
+    MICROSCOPES_ASSERT(llt.info() == Eigen::Success);
+
+    const unsigned d = psi.rows();
+    Eigen::MatrixXf A = Eigen::MatrixXf::Zero(d, d);
+    std::normal_distribution<float> norm;
+    for (unsigned i = 0; i < d; i++) {
+      A(i, i) = sqrt(std::chi_squared_distribution<float>(nu - float(i))(rng));
+      for (unsigned j = 0; j < i; j++)
+        A(i, j) = norm(rng);
+    }
+
+    // M A^T = L
+    Eigen::MatrixXf M = llt.matrixL();
+    A.transpose().triangularView<Eigen::Upper>().solveInPlace<Eigen::OnTheRight>(M);
+    return M * M.transpose();
   }
 
   static inline std::pair<Eigen::VectorXf, Eigen::MatrixXf>
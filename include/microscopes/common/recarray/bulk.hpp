@@ -0,0 +1,72 @@
+#pragma once
+
+#include <microscopes/common/recarray/dataview.hpp>
+#include <microscopes/common/group_manager.hpp>
+#include <microscopes/common/random_fwd.hpp>
+#include <microscopes/models/base.hpp>
+
+#include <vector>
+#include <memory>
+
+namespace microscopes {
+namespace common {
+namespace recarray {
+
+/**
+ * Bulk operations for states which keep one models::group per
+ * (group, feature) pair over a recarray dataview (e.g. mixture models).
+ *
+ * Work is sharded by rows across nthreads workers (0 means use the hardware
+ * concurrency). Each worker draws from its own rng, seeded from the rng
+ * passed in, so results are reproducible for a fixed (seed, nthreads).
+ */
+struct bulk {
+
+  typedef std::vector<std::shared_ptr<models::group>> feature_groups_t;
+  typedef group_manager<feature_groups_t> groups_t;
+
+  /**
+   * Equivalent to, for every row i of view (in its unpermuted order),
+   *
+   *   groups.add_value(assignments[i], i)
+   *
+   * followed by an add_value() on each unmasked feature's group. Every group
+   * named in assignments must already exist, and none of the entities may
+   * currently be assigned.
+   *
+   * Each worker accumulates its shard of rows into thread-local groups, which
+   * are then merge()-ed into the real groups. Suff stats which are sums of
+   * floats will differ from a serial load by rounding only.
+   */
+  static void
+  add_values(groups_t &groups,
+             const std::vector<std::shared_ptr<models::hypers>> &hypers,
+             const dataview &view,
+             const std::vector<size_t> &assignments,
+             rng_t &rng,
+             unsigned nthreads=0);
+
+  /**
+   * Fills out, a row major buffer of gids.size() rows laid out according to
+   * types (see runtime_type::GetOffsetsAndSize), with draws from the
+   * posterior predictive: feature f of row i is written by
+   *
+   *   groups.group(gids[i]).data_[f]->sample_value(*hypers[f], ...)
+   *
+   * The groups are not modified. Models which use the value already in the
+   * output as a template (e.g. the # of trials of a dm row) see whatever out
+   * held on entry.
+   */
+  static void
+  sample_values(const groups_t &groups,
+                const std::vector<std::shared_ptr<models::hypers>> &hypers,
+                const std::vector<runtime_type> &types,
+                const std::vector<size_t> &gids,
+                uint8_t *out,
+                rng_t &rng,
+                unsigned nthreads=0);
+};
+
+} // namespace recarray
+} // namespace common
+} // namespace microscopes
@@ -3,6 +3,7 @@
 #include <microscopes/common/runtime_type.hpp>
 #include <microscopes/common/runtime_value.hpp>
 #include <microscopes/common/macros.hpp>
+#include <microscopes/common/metrics.hpp>
 #include <microscopes/common/util.hpp>
 
 #include <algorithm>
@@ -326,6 +327,7 @@ public:
     void
     next() override
     {
+      MICROSCOPES_METRIC_INC(M_SLICE_ELEMENTS);
       for (;;) {
         iter_.next();
         if (iter_.end() || !px_->accessor(iter_.value()).anymasked())
@@ -482,6 +484,7 @@ public:
     void
     next() override
     {
+      MICROSCOPES_METRIC_INC(M_SLICE_ELEMENTS);
       indices_++;
       data_ += type_->size();
     }
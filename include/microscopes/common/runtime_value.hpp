@@ -63,15 +63,29 @@ private:
 
 class value_mutator {
 public:
-  value_mutator() : data_(), type_() {}
+  // called with the context given to notify() after every set()
+  typedef void (*notify_fn)(void *);
+
+  value_mutator() : data_(), type_(), notify_(), ctx_() {}
 
   template <typename T>
   value_mutator(T *data)
     : data_(reinterpret_cast<uint8_t *>(data)),
-      type_(runtime_type(static_type_to_primitive_type<T>::value)) {}
+      type_(runtime_type(static_type_to_primitive_type<T>::value)),
+      notify_(), ctx_() {}
 
   value_mutator(uint8_t *data, const runtime_type &type)
-    : data_(data), type_(type) {}
+    : data_(data), type_(type), notify_(), ctx_() {}
+
+  // makes every set() through this mutator (or a copy) call fn(ctx), e.g.
+  // so the owner of the value can invalidate whatever it derived from it
+  inline value_mutator &
+  notify(notify_fn fn, void *ctx)
+  {
+    notify_ = fn;
+    ctx_ = ctx;
+    return *this;
+  }
 
   inline const runtime_type & type() const { return type_; }
   inline unsigned shape() const { return type_.n(); }
@@ -84,6 +98,8 @@ public:
     MICROSCOPES_ASSERT(idx < shape());
     const size_t s = type_.psize();
     runtime_cast::uncast<T>(data_ + idx * s, type_.t(), t);
+    if (notify_)
+      notify_(ctx_);
   }
 
   inline value_accessor
@@ -92,9 +108,16 @@ public:
     return value_accessor(data_, nullptr, type_);
   }
 
+  // the underlying storage, for callers which resolve a mutator once and
+  // then access the field directly (see models::hp_handle). writes through
+  // it are not notified
+  inline uint8_t * data() const { return data_; }
+
 private:
   uint8_t *data_;
   runtime_type type_;
+  notify_fn notify_;
+  void *ctx_;
 };
 
 } // namespace common
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+#include <microscopes/common/metrics.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace microscopes {
+namespace common {
+
+/**
+ * A flat, versioned binary checkpoint format.
+ *
+ * A snapshot is a header (magic, format version) followed by whatever
+ * sequence of scalars and arrays the writer emitted; there is no schema, so
+ * readers must consume values in exactly the order they were written. Values
+ * are stored in host byte order. Arrays are length prefixed and padded to
+ * ArrayAlignment bytes (relative to the start of the snapshot), so that a
+ * reader over an mmap()-ed file can hand out pointers straight into the
+ * mapping.
+ */
+struct snapshot {
+  static const uint32_t Magic = 0x504e534d; // "MSNP"
+  // bumped whenever the layout of a model's dump_ss() changes. 2: sized
+  // DirichletDiscrete groups (see models::dd_model)
+  static const uint32_t Version = 2;
+  static const size_t ArrayAlignment = 8;
+};
+
+/**
+ * Streams a snapshot either to a file (through a fixed size buffer, with
+ * large arrays written straight through) or into memory.
+ */
+class snapshot_writer {
+public:
+  // in-memory snapshot, see buffer()
+  snapshot_writer();
+
+  // truncates path
+  snapshot_writer(const std::string &path, size_t bufsize=(1<<20));
+
+  snapshot_writer(const snapshot_writer &) = delete;
+  snapshot_writer &operator=(const snapshot_writer &) = delete;
+
+  // flushes and closes, swallowing any errors; call close() explicitly to
+  // have them reported
+  ~snapshot_writer();
+
+  template <typename T>
+  inline void
+  write(const T &value)
+  {
+    static_assert(std::is_pod<T>::value, "POD types only");
+    write_raw(&value, sizeof(T));
+  }
+
+  template <typename T>
+  inline void
+  write_array(const T *values, size_t n)
+  {
+    static_assert(std::is_pod<T>::value, "POD types only");
+    write<uint64_t>(n);
+    pad();
+    write_raw(values, n * sizeof(T));
+  }
+
+  template <typename T>
+  inline void
+  write_array(const std::vector<T> &values)
+  {
+    write_array(values.data(), values.size());
+  }
+
+  inline void
+  write_bytes(const std::string &s)
+  {
+    write_array(s.data(), s.size());
+  }
+
+  void write_raw(const void *p, size_t n);
+
+  void flush();
+  void close();
+
+  // discards the contents of an in-memory writer, so that it can be reused
+  void reset();
+
+  // total # of bytes written so far (including the header)
+  inline size_t tell() const { return offset_; }
+
+  // the snapshot so far, for in-memory writers
+  inline const std::string &
+  buffer() const
+  {
+    MICROSCOPES_DCHECK(fd_ == -1, "not an in-memory writer");
+    return buf_;
+  }
+
+private:
+  void pad();
+  void write_header();
+
+  int fd_;
+  size_t bufsize_;
+  std::string buf_;
+  size_t offset_;
+};
+
+/**
+ * Reads a snapshot either from a file, which is mmap()-ed read only, or from
+ * a caller owned buffer, which must outlive the reader.
+ */
+class snapshot_reader {
+public:
+  snapshot_reader(const uint8_t *data, size_t size);
+  explicit snapshot_reader(const std::string &path);
+
+  snapshot_reader(const snapshot_reader &) = delete;
+  snapshot_reader &operator=(const snapshot_reader &) = delete;
+
+  ~snapshot_reader();
+
+  template <typename T>
+  inline T
+  read()
+  {
+    static_assert(std::is_pod<T>::value, "POD types only");
+    T ret;
+    read_raw(&ret, sizeof(T));
+    return ret;
+  }
+
+  // zero-copy: the returned pointer (to n values) points into the snapshot
+  // and is valid for the lifetime of the reader
+  template <typename T>
+  inline const T *
+  read_array(size_t &n)
+  {
+    static_assert(std::is_pod<T>::value, "POD types only");
+    n = read<uint64_t>();
+    skip_pad();
+    // n comes from the file, so n * sizeof(T) could wrap around
+    MICROSCOPES_CHECK(n <= (size_ - pos_) / sizeof(T), "truncated snapshot");
+    return reinterpret_cast<const T *>(consume(n * sizeof(T)));
+  }
+
+  template <typename T>
+  inline void
+  read_array(std::vector<T> &values)
+  {
+    size_t n;
+    const T *px = read_array<T>(n);
+    values.assign(px, px + n);
+  }
+
+  inline std::string
+  read_bytes()
+  {
+    size_t n;
+    const char *px = read_array<char>(n);
+    return std::string(px, n);
+  }
+
+  inline void
+  read_raw(void *p, size_t n)
+  {
+    MICROSCOPES_MEMCPY(p, consume(n), n);
+  }
+
+  inline bool eof() const { return pos_ == size_; }
+
+private:
+  inline const uint8_t *
+  consume(size_t n)
+  {
+    MICROSCOPES_CHECK(n <= size_ - pos_, "truncated snapshot");
+    MICROSCOPES_METRIC_ADD(M_SNAPSHOT_BYTES_IN, n);
+    const uint8_t *px = data_ + pos_;
+    pos_ += n;
+    return px;
+  }
+
+  void skip_pad();
+  void read_header();
+
+  const uint8_t *data_;
+  size_t size_;
+  size_t pos_;
+  bool mapped_;
+};
+
+} // namespace common
+} // namespace microscopes
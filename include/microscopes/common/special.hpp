@@ -1,12 +1,47 @@
 #pragma once
 
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
 #include <distributions/special.hpp>
 
+#include <cmath>
+#include <limits>
+#include <vector>
+
 namespace microscopes {
 namespace common {
 
 struct special {
 
+  // size of the lgamma_int() lookup table
+  static const unsigned LgammaTableSize = 4096;
+
+  /**
+   * lgamma(n) for (small) integer n, as a table load. The table is built on
+   * first use and is read only afterwards, so it may be used concurrently.
+   */
+  static inline float
+  lgamma_int(unsigned n)
+  {
+    MICROSCOPES_ASSERT(n > 0);
+    if (likely(n < LgammaTableSize))
+      return lgamma_int_table()[n];
+    return distributions::fast_lgamma(float(n));
+  }
+
+  static inline const float *
+  lgamma_int_table()
+  {
+    static const std::vector<float> table = []() {
+      std::vector<float> ret(LgammaTableSize);
+      ret[0] = std::numeric_limits<float>::infinity();
+      for (unsigned n = 1; n < LgammaTableSize; n++)
+        ret[n] = std::lgamma(double(n));
+      return ret;
+    }();
+    return table.data();
+  }
+
   /**
    * http://en.wikipedia.org/wiki/Multivariate_gamma_function
    */
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <microscopes/common/profiler.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/**
+ * Phase tracing: nested spans recorded into per-thread ring buffers, for
+ * visualizing where the time of a run goes.
+ *
+ *   trace::start();
+ *   ... // code with MICROSCOPES_TRACE_SPAN("score") etc.
+ *   trace::stop();
+ *   trace::write_chrome_trace(out); // chrome://tracing, Perfetto
+ *   trace::write_folded(out);       // flamegraph.pl, speedscope
+ *
+ * Unlike the profiler, which sums over all entries of a region, a trace
+ * keeps each span (with an optional argument, such as an entity or group
+ * id), but only the most recent ones: each thread's buffer holds the last
+ * capacity begin/end events. Spans whose begin was overwritten are dropped
+ * on export.
+ *
+ * The thread which called start() gets a buffer of capacity events, and
+ * every other thread (e.g. the short lived workers of recarray::bulk) one of
+ * worker_capacity events. When a thread exits, the events of its completed
+ * spans are moved to a list of retained events (which keeps at most
+ * capacity events, dropping those of the earliest exited threads first) and
+ * its buffer is freed, so memory stays bounded however many threads come
+ * and go.
+ *
+ * When tracing is stopped, a span costs a relaxed load and a branch. Spans
+ * are timed with profiler::ticks(). Names must be string literals.
+ *
+ * start() and the writers must not run concurrently with traced code.
+ */
+
+namespace microscopes {
+namespace common {
+namespace trace {
+
+static const size_t DefaultCapacity = 1 << 20;
+static const size_t DefaultWorkerCapacity = 1 << 14;
+static const uint64_t NoArg = ~uint64_t(0);
+
+namespace detail {
+
+struct event {
+  uint64_t ticks_;
+  const char *name_;
+  uint64_t arg_;
+  bool begin_;
+};
+
+class buffer {
+public:
+  buffer(size_t capacity, unsigned tid, std::thread::id owner);
+
+  buffer(const buffer &) = delete;
+  buffer &operator=(const buffer &) = delete;
+
+  inline ALWAYS_INLINE void
+  push(const char *name, uint64_t arg, bool begin)
+  {
+    event &e = events_[head_++ & mask_];
+    e.ticks_ = profiler::ticks();
+    e.name_ = name;
+    e.arg_ = arg;
+    e.begin_ = begin;
+  }
+
+  // discards the events, rounding capacity up to a power of two (and only
+  // reallocating if that changes the size)
+  void reset(size_t capacity);
+
+  // the retained events, oldest first
+  std::vector<event> events() const;
+
+  inline unsigned tid() const { return tid_; }
+  inline std::thread::id owner() const { return owner_; }
+
+private:
+  std::vector<event> events_;
+  size_t mask_;
+  uint64_t head_;
+  unsigned tid_;
+  std::thread::id owner_;
+};
+
+extern std::atomic<bool> Enabled;
+
+// the calling thread's buffer, created on first use and retired (see above)
+// when the thread exits
+buffer & local();
+
+// # of buffers of threads which have not exited, for tests
+size_t live_buffers();
+
+} // namespace detail
+
+static inline ALWAYS_INLINE bool
+enabled()
+{
+  return detail::Enabled.load(std::memory_order_relaxed);
+}
+
+// clears all buffers (and the retained events), sizing the calling thread's
+// to capacity events and every other thread's to worker_capacity, and
+// starts tracing
+void start(size_t capacity = DefaultCapacity,
+           size_t worker_capacity = DefaultWorkerCapacity);
+
+void stop();
+
+// the Chrome trace event format: one complete ("X") event per span
+void write_chrome_trace(std::ostream &os);
+
+// one "outer;inner self_nsec" line per distinct stack, summed over threads
+void write_folded(std::ostream &os);
+
+class span {
+public:
+  explicit span(const char *name, uint64_t arg = NoArg)
+    : buf_(unlikely(enabled()) ? &detail::local() : nullptr), name_(name)
+  {
+    if (unlikely(buf_ != nullptr))
+      buf_->push(name, arg, true);
+  }
+
+  span(const span &) = delete;
+  span &operator=(const span &) = delete;
+
+  ~span()
+  {
+    if (unlikely(buf_ != nullptr))
+      buf_->push(name_, NoArg, false);
+  }
+
+private:
+  detail::buffer *buf_;
+  const char *name_;
+};
+
+#define MICROSCOPES_TRACE_SPAN(name) \
+  ::microscopes::common::trace::span \
+    MICROSCOPES_PROFILE_CONCAT(microscopes_trace_span_, __LINE__)(name)
+
+#define MICROSCOPES_TRACE_SPAN_ARG(name, arg) \
+  ::microscopes::common::trace::span \
+    MICROSCOPES_PROFILE_CONCAT(microscopes_trace_span_, __LINE__)(name, (arg))
+
+} // namespace trace
+} // namespace common
+} // namespace microscopes
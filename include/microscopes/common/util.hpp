@@ -2,6 +2,7 @@
 
 #include <microscopes/common/random_fwd.hpp>
 #include <microscopes/common/macros.hpp>
+#include <microscopes/common/metrics.hpp>
 #include <distributions/random.hpp>
 
 #include <google/protobuf/message.h>
@@ -16,6 +17,7 @@
 #include <utility>
 #include <random>
 #include <algorithm>
+#include <limits>
 
 // pretty printer for std::pair<A, B>
 template <typename A, typename B>
@@ -81,15 +83,87 @@ struct util {
     return ret;
   }
 
-  // generate a random permutation of the integers [0, ..., n-1]
+  /**
+   * A uniform draw from [0, range), range > 0, by Lemire's multiply-shift
+   * method ("Fast Random Integer Generation in an Interval", 2019): one
+   * 64-bit multiply, plus a division only in the rare case that the draw
+   * might be rejected. Unlike std::uniform_int_distribution, there is no
+   * distribution object to construct per draw.
+   */
+  static inline ALWAYS_INLINE uint32_t
+  bounded_rand(rng_t &rng, uint32_t range)
+  {
+    static_assert(rng_t::min() == 0 && rng_t::max() == 0xFFFFFFFFu,
+        "bounded_rand() needs uniform 32-bit words");
+    uint64_t m = uint64_t(uint32_t(rng())) * range;
+    uint32_t low = uint32_t(m);
+    if (unlikely(low < range)) {
+      const uint32_t threshold = uint32_t(-range) % range;
+      while (low < threshold) {
+        m = uint64_t(uint32_t(rng())) * range;
+        low = uint32_t(m);
+      }
+    }
+    return m >> 32;
+  }
+
+  // Fisher-Yates shuffle of [first, first + n)
+  template <typename T>
   static inline void
-  inplace_permute(std::vector<size_t> &pi, size_t n, rng_t &rng)
+  shuffle(T *first, size_t n, rng_t &rng)
   {
-    inplace_range(pi, n);
-    for (size_t i = pi.size() - 1; i >= 1; i--) {
-      std::uniform_int_distribution<size_t> dist(0, i);
-      const size_t j = dist(rng);
-      std::swap(pi[j], pi[i]);
+    for (size_t i = n; i > 1; i--) {
+      const size_t j = likely(i <= 0xFFFFFFFFu) ?
+        bounded_rand(rng, i) :
+        std::uniform_int_distribution<size_t>(0, i - 1)(rng);
+      std::swap(first[i - 1], first[j]);
+    }
+  }
+
+  // generate a random permutation of the integers [0, ..., n-1]; Index may
+  // be narrower than size_t (e.g. uint32_t, for n < 2^32) to halve the
+  // memory a sweep in permuted order reads
+  template <typename Index>
+  static inline void
+  inplace_permute(std::vector<Index> &pi, size_t n, rng_t &rng)
+  {
+    MICROSCOPES_DCHECK(!n || n - 1 <= size_t(std::numeric_limits<Index>::max()),
+        "index type too narrow");
+    pi.resize(n);
+    for (size_t i = 0; i < n; i++)
+      pi[i] = i;
+    shuffle(pi.data(), n, rng);
+  }
+
+  /**
+   * A random permutation of [0, ..., n-1] which visits the integers a block
+   * of blocksize consecutive ones at a time: the order of the blocks is
+   * shuffled, and so is the order within each block. Every integer still
+   * appears exactly once, so a sweep in this order is still a valid (random
+   * scan) Gibbs sweep, but one which touches row major data a contiguous
+   * block of rows at a time.
+   *
+   * blocks is scratch space, which (like pi) is only reallocated if it grows.
+   */
+  template <typename Index>
+  static inline void
+  inplace_blocked_permute(std::vector<Index> &pi,
+                          std::vector<Index> &blocks,
+                          size_t n,
+                          size_t blocksize,
+                          rng_t &rng)
+  {
+    MICROSCOPES_DCHECK(blocksize > 0, "empty blocks");
+    inplace_permute(blocks, (n + blocksize - 1) / blocksize, rng);
+    pi.resize(n);
+    size_t pos = 0;
+    for (auto b : blocks) {
+      const size_t begin = size_t(b) * blocksize;
+      const size_t end = std::min(n, begin + blocksize);
+      for (size_t i = begin; i < end; i++)
+        pi[pos + i - begin] = i;
+      shuffle(pi.data() + pos, end - begin, rng);
+      pos += end - begin;
     }
   }
 
@@ -234,19 +308,53 @@ struct util {
     return m(i, j);
   }
 
+  // protobuf messages are serialized straight to/from flat buffers, rather
+  // than through (locale-bearing, double buffered) string streams
+
+  static inline void
+  protobuf_to_string(const google::protobuf::Message &m, std::string &out)
+  {
+    // SerializeToString() clears out, keeping its capacity
+    m.SerializeToString(&out);
+    MICROSCOPES_METRIC_ADD(M_PROTOBUF_BYTES_OUT, out.size());
+    MICROSCOPES_METRIC_OBSERVE(H_PROTOBUF_MESSAGE_BYTES, out.size());
+  }
+
   static inline std::string
   protobuf_to_string(const google::protobuf::Message &m)
   {
-    std::ostringstream out;
-    m.SerializeToOstream(&out);
-    return out.str();
+    std::string out;
+    protobuf_to_string(m, out);
+    return out;
+  }
+
+  static inline void
+  protobuf_from_string(google::protobuf::Message &m, const void *data, size_t size)
+  {
+    MICROSCOPES_METRIC_ADD(M_PROTOBUF_BYTES_IN, size);
+    MICROSCOPES_METRIC_OBSERVE(H_PROTOBUF_MESSAGE_BYTES, size);
+    m.ParseFromArray(data, size);
   }
 
   static inline void
   protobuf_from_string(google::protobuf::Message &m, const std::string &s)
   {
-    std::istringstream inp(s);
-    m.ParseFromIstream(&inp);
+    protobuf_from_string(m, s.data(), s.size());
+  }
+
+  /**
+   * A cleared, per-thread instance of message type M, for (non-reentrant)
+   * hot paths such as get_hp()/set_hp() which would otherwise construct and
+   * destroy a message per call. Clear() keeps allocated repeated fields and
+   * strings around, so steady state round trips do not allocate.
+   */
+  template <typename M>
+  static inline M &
+  scratch_message()
+  {
+    static thread_local M m;
+    m.Clear();
+    return m;
   }
 
 };
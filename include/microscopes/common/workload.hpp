@@ -0,0 +1,191 @@
+#pragma once
+
+#include <microscopes/common/random_fwd.hpp>
+#include <microscopes/common/runtime_type.hpp>
+#include <microscopes/common/recarray/dataview.hpp>
+#include <microscopes/common/variadic/dataview.hpp>
+#include <microscopes/common/relation/dataview.hpp>
+#include <microscopes/common/assert.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Synthetic workloads, for benchmarking states and dataviews at scale.
+ *
+ * Each workload draws a latent clustering of its entities (with Zipf
+ * distributed cluster sizes, so a few clusters hold most of the data), draws
+ * per cluster parameters for each feature, and then fills in values from
+ * them. Generation is deterministic given the rng, so a workload can be
+ * reproduced from its config and seed alone.
+ *
+ * The data lives in a workload::storage, which is either anonymous memory or
+ * a file mapped into memory; the latter lets workloads larger than physical
+ * memory (10^8 cells and up) be generated and paged in by the kernel.
+ *
+ * A workload owns its data: dataviews returned by it must not outlive it.
+ */
+
+namespace microscopes {
+namespace common {
+namespace workload {
+
+class storage {
+public:
+  // anonymous memory if path is empty, otherwise path is created (or
+  // truncated) to nbytes and mapped shared
+  storage(size_t nbytes, const std::string &path);
+  ~storage();
+
+  storage(const storage &) = delete;
+  storage &operator=(const storage &) = delete;
+
+  inline uint8_t * data() const { return data_; }
+  inline size_t size() const { return size_; }
+  inline const std::string & path() const { return path_; }
+
+  // writes dirty pages back to the file (a no-op for anonymous memory)
+  void sync() const;
+
+private:
+  uint8_t *data_;
+  size_t size_;
+  std::string path_;
+};
+
+// the latent clustering of a workload's entities
+struct clustering {
+  clustering() : clusters_(1), zipf_s_(0.) {}
+  clustering(size_t clusters, float zipf_s)
+    : clusters_(clusters), zipf_s_(zipf_s) {}
+
+  size_t clusters_;
+
+  // cluster k has weight (k+1)^-s; 0 gives equal sized clusters
+  float zipf_s_;
+};
+
+// n assignments to c.clusters_ clusters
+std::vector<uint32_t>
+sample_assignments(size_t n, const clustering &c, rng_t &rng);
+
+// n feature types cycling through bool, int32, float, uint32 and float[3]
+std::vector<runtime_type> mixed_types(size_t n);
+
+struct recarray_config {
+  recarray_config()
+    : rows_(1000), types_(mixed_types(10)), mask_density_(0.),
+      clustering_(), path_() {}
+
+  size_t rows_;
+  std::vector<runtime_type> types_;
+  float mask_density_; // fraction of values masked; 0 allocates no mask
+  clustering clustering_;
+  std::string path_; // backing file, if any
+};
+
+class recarray_workload {
+public:
+  recarray_workload(const recarray_config &config, rng_t &rng);
+
+  std::shared_ptr<recarray::row_major_dataview> dataview() const;
+
+  inline const recarray_config & config() const { return config_; }
+  inline const std::vector<uint32_t> & assignments() const { return assignments_; }
+  inline const uint8_t * data() const { return data_; }
+  inline const bool * mask() const { return mask_; }
+  inline size_t nbytes() const { return storage_->size(); }
+
+private:
+  recarray_config config_;
+  std::vector<uint32_t> assignments_;
+  std::unique_ptr<storage> storage_;
+  uint8_t *data_;
+  bool *mask_;
+};
+
+struct variadic_config {
+  variadic_config()
+    : rows_(1000), type_(TYPE_F32), mean_rowsize_(10.),
+      clustering_(), path_() {}
+
+  size_t rows_;
+  runtime_type type_;
+  float mean_rowsize_; // row sizes are geometric with this mean
+  clustering clustering_;
+  std::string path_;
+};
+
+class variadic_workload {
+public:
+  variadic_workload(const variadic_config &config, rng_t &rng);
+
+  std::shared_ptr<variadic::row_major_dataview> dataview() const;
+
+  inline const variadic_config & config() const { return config_; }
+  inline const std::vector<uint32_t> & assignments() const { return assignments_; }
+  inline const std::vector<unsigned> & rowsizes() const { return ns_; }
+  inline size_t nbytes() const { return storage_->size(); }
+
+private:
+  variadic_config config_;
+  std::vector<uint32_t> assignments_;
+  std::vector<unsigned> ns_;
+  std::unique_ptr<storage> storage_;
+};
+
+/**
+ * A rows x cols relation. Each cell is observed with probability density_;
+ * the row and column entities are clustered independently, and a value's
+ * distribution depends on the (row, col) cluster pair.
+ */
+struct relation_config {
+  relation_config()
+    : rows_(100), cols_(100), type_(TYPE_B), density_(1.),
+      sparse_(false), row_clustering_(), col_clustering_(), path_() {}
+
+  size_t rows_;
+  size_t cols_;
+  runtime_type type_;
+  float density_;
+  // store as a compressed_2darray rather than a masked dense array
+  bool sparse_;
+  clustering row_clustering_;
+  clustering col_clustering_;
+  std::string path_;
+};
+
+class relation_workload {
+public:
+  relation_workload(const relation_config &config, rng_t &rng);
+
+  std::shared_ptr<relation::dataview> dataview() const;
+
+  inline const relation_config & config() const { return config_; }
+  inline const std::vector<uint32_t> & row_assignments() const { return row_assignments_; }
+  inline const std::vector<uint32_t> & col_assignments() const { return col_assignments_; }
+  inline size_t nnz() const { return nnz_; }
+  inline size_t nbytes() const { return storage_->size(); }
+
+private:
+  void generate_dense(rng_t &rng);
+  void generate_sparse(rng_t &rng);
+
+  relation_config config_;
+  std::vector<uint32_t> row_assignments_;
+  std::vector<uint32_t> col_assignments_;
+  std::vector<float> thetas_; // per (row cluster, col cluster)
+  size_t nnz_;
+  std::unique_ptr<storage> storage_;
+
+  // offsets into storage_ of the arrays; for dense relations only data and
+  // mask are used
+  size_t data_off_, mask_off_;
+  size_t csr_indices_off_, csr_indptr_off_;
+  size_t csc_data_off_, csc_indices_off_, csc_indptr_off_;
+};
+
+} // namespace workload
+} // namespace common
+} // namespace microscopes
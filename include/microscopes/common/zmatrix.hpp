@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+
+namespace microscopes {
+namespace common {
+
+/**
+ * Co-assignment ("z") matrices over n entities: z(i, j) is the fraction of
+ * the assignment vectors added (e.g. posterior samples) in which entities i
+ * and j are in the same group. Group ids are only compared for equality, so
+ * any labels (including negative ones) work.
+ *
+ * dense_zmatrix keeps all n^2 counts, and is the one to use when the whole
+ * matrix is wanted. sparse_zmatrix keeps the assignment vectors themselves
+ * (8 bytes per entity per vector) and computes rows on demand, materializing
+ * only the entries above a threshold, or the top k neighbors of each entity,
+ * so that it scales to n well past what fits in n^2 memory.
+ *
+ * Both use up to nthreads worker threads (0 means use the hardware
+ * concurrency) for the heavy lifting.
+ */
+
+class dense_zmatrix {
+public:
+  // counts are updated a TileSize x TileSize tile at a time, for a batch of
+  // up to BatchSize assignment vectors at once, so that each tile stays in
+  // cache across the batch
+  static const size_t TileSize = 128;
+  static const size_t BatchSize = 16;
+
+  explicit dense_zmatrix(size_t n, unsigned nthreads = 0);
+
+  inline size_t n() const { return n_; }
+  inline size_t nsamples() const { return nsamples_; }
+
+  // assignment must have n() entries; vectors are buffered, and folded into
+  // the counts a batch at a time
+  void add(const std::vector<ssize_t> &assignment);
+
+  // folds in any buffered vectors; the accessors below call this
+  void flush();
+
+  // the # of vectors in which i and j are in the same group
+  uint32_t count(size_t i, size_t j);
+
+  // writes the n() x n() matrix, row major, into out
+  void copy_to(float *out);
+
+  // see sparse_zmatrix::top_k()
+  void top_k(size_t k, ssize_t *neighbors, float *scores);
+
+private:
+  size_t n_;
+  unsigned nthreads_;
+  size_t nsamples_;
+
+  // row major n x n, of which only the upper triangle (j >= i) is kept
+  std::vector<uint32_t> counts_;
+
+  // npending_ buffered vectors, relabeled with dense group ids
+  std::vector<uint32_t> pending_;
+  size_t npending_;
+};
+
+class sparse_zmatrix {
+public:
+  explicit sparse_zmatrix(size_t n, unsigned nthreads = 0);
+
+  inline size_t n() const { return n_; }
+  inline size_t nsamples() const { return samples_.size(); }
+
+  // assignment must have n() entries
+  void add(const std::vector<ssize_t> &assignment);
+
+  // the # of vectors in which i and j are in the same group
+  uint32_t count(size_t i, size_t j) const;
+
+  /**
+   * The entries z(i, j) >= threshold, in CSR form: row i's columns are
+   * indices[indptr[i]:indptr[i+1]], in increasing order, with the values in
+   * data. Zero entries are never included, whatever the threshold.
+   */
+  void thresholded(float threshold,
+                   std::vector<size_t> &indptr,
+                   std::vector<uint32_t> &indices,
+                   std::vector<float> &data) const;
+
+  /**
+   * For each entity i, the (at most) k other entities j with the largest
+   * nonzero z(i, j), by decreasing z (ties broken by increasing j), into row
+   * i of the n() x k arrays neighbors and scores. Rows with fewer than k
+   * such entities are padded with -1 and 0.
+   */
+  void top_k(size_t k, ssize_t *neighbors, float *scores) const;
+
+private:
+  struct sample {
+    std::vector<uint32_t> labels_; // entity -> dense group id
+    std::vector<uint32_t> offsets_; // group -> range of members_
+    std::vector<uint32_t> members_; // entities, by group, in increasing order
+  };
+
+  // adds the counts of row i into acc, appending each column seen for the
+  // first time (acc[j] was 0) to touched
+  void accumulate_row(size_t i,
+                      uint32_t *acc,
+                      std::vector<uint32_t> &touched) const;
+
+  size_t n_;
+  unsigned nthreads_;
+  std::vector<sample> samples_;
+};
+
+} // namespace common
+} // namespace microscopes
@@ -4,6 +4,7 @@
 #include <microscopes/common/runtime_value.hpp>
 #include <microscopes/common/random_fwd.hpp>
 #include <microscopes/common/typedefs.hpp>
+#include <microscopes/common/snapshot.hpp>
 
 #include <memory>
 
@@ -16,6 +17,7 @@ namespace models {
 
 // forward decl
 class hypers;
+class mixture;
 
 // abstract suff stats
 class group {
@@ -28,11 +30,39 @@ public:
   virtual float score_data(const hypers &m, common::rng_t &rng) const = 0;
   virtual void sample_value(const hypers &m, common::value_mutator &value, common::rng_t &rng) const = 0;
 
+  // folds the suff stats of g (which must be a group of the same model, created
+  // from the same hypers) into this group
+  virtual void merge(const hypers &m, const group &g, common::rng_t &rng) = 0;
+
   virtual common::suffstats_bag_t get_ss() const = 0;
+
+  // get_ss() into a caller owned buffer, whose capacity is reused so that
+  // serializing many groups does not allocate. the default just calls get_ss()
+  virtual void
+  get_ss(common::suffstats_bag_t &out) const
+  {
+    out = get_ss();
+  }
+
   virtual void set_ss(const common::suffstats_bag_t &ss) = 0;
   virtual void set_ss(const group &g) = 0;
   virtual common::value_mutator get_ss_mutator(const std::string &key) = 0;
 
+  // the suff stats in the flat snapshot format (see common/snapshot.hpp).
+  // the default just embeds get_ss(); models with fixed layout suff stats
+  // should override these to skip the protobuf round trip
+  virtual void
+  dump_ss(common::snapshot_writer &w) const
+  {
+    w.write_bytes(get_ss());
+  }
+
+  virtual void
+  load_ss(common::snapshot_reader &r)
+  {
+    set_ss(r.read_bytes());
+  }
+
   virtual std::string debug_str() const = 0;
 };
 
@@ -42,13 +72,58 @@ public:
   virtual ~hypers() {}
 
   virtual common::hyperparam_bag_t get_hp() const = 0;
+
+  // get_hp() into a caller owned buffer, see group::get_ss(out)
+  virtual void
+  get_hp(common::hyperparam_bag_t &out) const
+  {
+    out = get_hp();
+  }
+
   virtual void set_hp(const common::hyperparam_bag_t &hp) = 0;
   virtual void set_hp(const hypers &s) = 0;
   virtual common::value_mutator get_hp_mutator(const std::string &key) = 0;
 
+  // invalidates anything cached against the old values of the hypers (e.g.
+  // by a mixture). set_hp() does this itself, and so does every set() on a
+  // mutator returned by get_hp_mutator() (see notifying()), since that is
+  // how kernels write hypers, e.g. through
+  // entity_state::get_component_hp_mutator(). only writes which bypass
+  // set(), such as through value_mutator::data(), must call it explicitly
+  virtual void hp_changed() {}
+
   virtual std::shared_ptr<group> create_group(common::rng_t &rng) const = 0;
 
+  // a group which only accumulates suff stats to be merge()-d into (or
+  // copied into) real groups, e.g. the thread-local groups of recarray::bulk.
+  // it is not a group of the model, so models which account for their groups
+  // should not count it
+  virtual std::shared_ptr<group>
+  create_scratch_group(common::rng_t &rng) const
+  {
+    return create_group(rng);
+  }
+
+  // an (empty) mixture for the groups of these hypers, see models/mixture.hpp
+  virtual std::shared_ptr<mixture> create_mixture() const;
+
   virtual std::string debug_str() const = 0;
+
+protected:
+  // m, with every set() through it followed by hp_changed(). models which
+  // override hp_changed() return their get_hp_mutator()s through this
+  inline common::value_mutator
+  notifying(common::value_mutator m)
+  {
+    return m.notify(&hypers::notify_hp_changed, this);
+  }
+
+private:
+  static void
+  notify_hp_changed(void *h)
+  {
+    static_cast<hypers *>(h)->hp_changed();
+  }
 };
 
 // abstract model
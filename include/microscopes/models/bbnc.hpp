@@ -4,6 +4,9 @@
 #include <microscopes/common/macros.hpp>
 #include <microscopes/models/base.hpp>
 
+#include <atomic>
+#include <cstdint>
+
 namespace microscopes {
 namespace models {
 
@@ -21,34 +24,56 @@ public:
   float score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override;
   float score_data(const hypers &m, common::rng_t &rng) const override;
   void sample_value(const hypers &m, common::value_mutator &value, common::rng_t &rng) const override;
+  void merge(const hypers &m, const group &g, common::rng_t &rng) override;
 
   common::suffstats_bag_t get_ss() const override;
   void set_ss(const common::suffstats_bag_t &ss) override;
   void set_ss(const group &g) override;
+  void dump_ss(common::snapshot_writer &w) const override;
+  void load_ss(common::snapshot_reader &r) override;
 
   common::value_mutator get_ss_mutator(const std::string &key) override;
   std::string debug_str() const override;
 
 protected:
-  size_t heads_;
-  size_t tails_;
+  // 32-bit, as for the distributions models, so a group is 24 bytes
+  uint32_t heads_;
+  uint32_t tails_;
   float p_;
 };
 
 class bbnc_hypers : public hypers {
   friend class bbnc_group;
 public:
-  bbnc_hypers() : alpha_(), beta_() {}
+  bbnc_hypers()
+    : alpha_(), beta_(), lbeta_(), lbeta_alpha_(), lbeta_beta_()
+  {
+    changed();
+  }
 
   std::shared_ptr<group> create_group(common::rng_t &rng) const override;
+  std::shared_ptr<group> create_scratch_group(common::rng_t &rng) const override;
 
   common::hyperparam_bag_t get_hp() const override;
   void set_hp(const common::hyperparam_bag_t &hp) override;
   void set_hp(const hypers &m) override;
   common::value_mutator get_hp_mutator(const std::string &key) override;
+  void hp_changed() override { changed(); }
 
   std::string debug_str() const override;
 
+  // log B(alpha, beta), for the current hypers. the cached value is checked
+  // against alpha/beta, since they may have been written without a
+  // hp_changed() (e.g. through value_mutator::data()); until the next
+  // changed() such writes are recomputed here
+  inline float
+  lbeta() const
+  {
+    if (likely(alpha_ == lbeta_alpha_ && beta_ == lbeta_beta_))
+      return lbeta_;
+    return compute_lbeta();
+  }
+
   static inline size_t
   CreateFeatureGroupInvocations()
   {
@@ -56,10 +81,18 @@ public:
   }
 
 protected:
+  void changed();
+  float compute_lbeta() const;
+
   float alpha_;
   float beta_;
+  float lbeta_;
+  float lbeta_alpha_; // the alpha_ and beta_ lbeta_ was computed for
+  float lbeta_beta_;
 
-  static size_t CreateFeatureGroupInvocations_;
+  // counts create_group() only, not create_scratch_group(). atomic since
+  // groups may be created concurrently
+  static std::atomic<size_t> CreateFeatureGroupInvocations_;
 };
 
 class bbnc_model : public model {
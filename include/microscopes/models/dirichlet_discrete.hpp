@@ -0,0 +1,187 @@
+#pragma once
+
+#include <microscopes/common/assert.hpp>
+
+#include <distributions/random.hpp>
+#include <distributions/special.hpp>
+#include <distributions/models/dd.hpp>
+
+#include <vector>
+
+namespace microscopes {
+namespace models {
+
+/**
+ * A DirichletDiscrete whose # of categories is only known at runtime, for
+ * features with more categories than the largest compile time
+ * distributions::DirichletDiscrete<N> we instantiate.
+ *
+ * Follows the model interface of distributions (Shared/Group/Scorer, with
+ * the DirichletDiscrete protobuf messages), so it plugs into
+ * distributions_group<T> like the models distributions ships.
+ */
+struct DirichletDiscreteV {
+  typedef distributions::DirichletDiscrete<2>::Value Value;
+
+  struct Shared {
+    int dim;
+    std::vector<float> alphas;
+    // sum of alphas, so scoring a value stays O(1). Whoever writes alphas
+    // directly (rather than through protobuf_load()) calls
+    // update_alpha_sum() after
+    float alphas_sum;
+
+    template <class Message>
+    void
+    protobuf_load(const Message &message)
+    {
+      dim = message.alphas_size();
+      alphas.resize(dim);
+      for (int i = 0; i < dim; i++)
+        alphas[i] = message.alphas(i);
+      update_alpha_sum();
+    }
+
+    template <class Message>
+    void
+    protobuf_dump(Message &message) const
+    {
+      message.Clear();
+      for (int i = 0; i < dim; i++)
+        message.add_alphas(alphas[i]);
+    }
+
+    inline void
+    update_alpha_sum()
+    {
+      alphas_sum = 0.;
+      for (int i = 0; i < dim; i++)
+        alphas_sum += alphas[i];
+    }
+
+    inline float alpha_sum() const { return alphas_sum; }
+  };
+
+  struct Group {
+    int dim;
+    uint32_t count_sum;
+    std::vector<uint32_t> counts;
+
+    template <class Message>
+    void
+    protobuf_load(const Message &message)
+    {
+      dim = message.counts_size();
+      counts.resize(dim);
+      count_sum = 0;
+      for (int i = 0; i < dim; i++)
+        count_sum += (counts[i] = message.counts(i));
+    }
+
+    template <class Message>
+    void
+    protobuf_dump(Message &message) const
+    {
+      message.Clear();
+      for (int i = 0; i < dim; i++)
+        message.add_counts(counts[i]);
+    }
+
+    void
+    init(const Shared &shared, distributions::rng_t &)
+    {
+      dim = shared.dim;
+      count_sum = 0;
+      counts.assign(dim, 0);
+    }
+
+    void
+    add_value(const Shared &, const Value &value, distributions::rng_t &)
+    {
+      MICROSCOPES_ASSERT(value < Value(dim));
+      count_sum++;
+      counts[value]++;
+    }
+
+    void
+    remove_value(const Shared &, const Value &value, distributions::rng_t &)
+    {
+      MICROSCOPES_ASSERT(value < Value(dim));
+      MICROSCOPES_ASSERT(counts[value]);
+      count_sum--;
+      counts[value]--;
+    }
+
+    void
+    merge(const Shared &, const Group &source, distributions::rng_t &)
+    {
+      MICROSCOPES_ASSERT(dim == source.dim);
+      count_sum += source.count_sum;
+      for (int i = 0; i < dim; i++)
+        counts[i] += source.counts[i];
+    }
+
+    float
+    score_value(const Shared &shared, const Value &value,
+                distributions::rng_t &) const
+    {
+      MICROSCOPES_ASSERT(value < Value(dim));
+      return distributions::fast_log(
+          (shared.alphas[value] + counts[value]) /
+          (shared.alpha_sum() + count_sum));
+    }
+
+    float
+    score_data(const Shared &shared, distributions::rng_t &) const
+    {
+      using distributions::fast_lgamma;
+      float score = 0.;
+      for (int i = 0; i < dim; i++)
+        if (counts[i])
+          score += fast_lgamma(shared.alphas[i] + counts[i])
+                 - fast_lgamma(shared.alphas[i]);
+      return score + fast_lgamma(shared.alpha_sum())
+                   - fast_lgamma(shared.alpha_sum() + count_sum);
+    }
+
+    Value
+    sample_value(const Shared &shared, distributions::rng_t &rng) const
+    {
+      // the posterior predictive picks i w.p. ~ alphas[i] + counts[i]
+      float u = distributions::sample_unif01(rng) *
+        (shared.alpha_sum() + count_sum);
+      for (int i = 0; i < dim - 1; i++) {
+        u -= shared.alphas[i] + counts[i];
+        if (u < 0.)
+          return i;
+      }
+      return dim - 1;
+    }
+  };
+
+  struct Scorer {
+    float alpha_sum;
+    std::vector<float> alphas;
+
+    void
+    init(const Shared &shared, const Group &group, distributions::rng_t &)
+    {
+      alpha_sum = 0.;
+      alphas.resize(shared.dim);
+      for (int i = 0; i < shared.dim; i++) {
+        alphas[i] = shared.alphas[i] + group.counts[i];
+        alpha_sum += alphas[i];
+      }
+    }
+
+    float
+    eval(const Shared &, const Value &value, distributions::rng_t &) const
+    {
+      MICROSCOPES_ASSERT(value < Value(alphas.size()));
+      return distributions::fast_log(alphas[value] / alpha_sum);
+    }
+  };
+};
+
+} // namespace models
+} // namespace microscopes
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <stdexcept>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
 
 #include <microscopes/models/base.hpp>
+#include <microscopes/models/mixture.hpp>
+#include <microscopes/models/dirichlet_discrete.hpp>
 #include <microscopes/common/runtime_value.hpp>
 #include <microscopes/common/macros.hpp>
+#include <microscopes/common/metrics.hpp>
+#include <microscopes/common/trace.hpp>
 #include <microscopes/common/util.hpp>
 
 #include <distributions/io/protobuf.hpp>
@@ -60,9 +66,24 @@
   x(BetaNegativeBinomial) \
   x(GammaPoisson) \
   x(NormalInverseChiSq) \
+  x(DirichletDiscrete2) \
+  x(DirichletDiscrete4) \
+  x(DirichletDiscrete8) \
+  x(DirichletDiscrete16) \
+  x(DirichletDiscrete32) \
   x(DirichletDiscrete128) \
+  x(DirichletDiscreteV) \
   x(NormalInverseWishartV)
 
+// the compile time sizes of DirichletDiscrete, see dd_model
+#define DISTRIB_FOR_EACH_DD_SIZE(x) \
+  x(2) \
+  x(4) \
+  x(8) \
+  x(16) \
+  x(32) \
+  x(128)
+
 #define DISTRIB_FOR_EACH_DISTRIBUTION_WITH_SCALAR_SHARED_FIELDS(x) \
   x(BetaBernoulli, DISTRIB_BB_SHARED_FIELDS) \
   x(BetaNegativeBinomial, DISTRIB_BNB_SHARED_FIELDS) \
@@ -77,11 +98,20 @@
 
 // somewhat of a hack
 namespace distributions {
-  extern template struct DirichletDiscrete<128>;
-  typedef DirichletDiscrete<128> DirichletDiscrete128;
+#define DISTRIB_DECLARE_DD(n) \
+  extern template struct DirichletDiscrete<n>; \
+  typedef DirichletDiscrete<n> DirichletDiscrete ## n; \
+  namespace protobuf { \
+    typedef DirichletDiscrete_Shared DirichletDiscrete ## n ## _Shared; \
+    typedef DirichletDiscrete_Group DirichletDiscrete ## n ## _Group; \
+  }
+  DISTRIB_FOR_EACH_DD_SIZE(DISTRIB_DECLARE_DD)
+#undef DISTRIB_DECLARE_DD
+
+  typedef microscopes::models::DirichletDiscreteV DirichletDiscreteV;
   namespace protobuf {
-    typedef DirichletDiscrete_Shared DirichletDiscrete128_Shared;
-    typedef DirichletDiscrete_Group DirichletDiscrete128_Group;
+    typedef DirichletDiscrete_Shared DirichletDiscreteV_Shared;
+    typedef DirichletDiscrete_Group DirichletDiscreteV_Group;
   } // namespace protobuf
 
   typedef NormalInverseWishart<-1> NormalInverseWishartV;
@@ -160,30 +190,30 @@ DISTRIB_FOR_EACH_DISTRIBUTION_WITH_SCALAR_GROUP_FIELDS(DISTRIB_SPECIALIZE_GROUP_
 #undef DISTRIB_SPECIALIZE_SHARED_HP
 #undef DISTRIB_SPECIALIZE_GROUP_SS
 
-// NOTE: DirichletDiscrete128 is special
-template <>
-struct distributions_shared_hp< distributions::DirichletDiscrete128 >
+// NOTE: the DirichletDiscretes are special
+template <typename T>
+struct dd_shared_hp
 {
   static inline common::value_mutator
-  get(distributions::DirichletDiscrete128::Shared &s, const std::string &key)
+  get(typename T::Shared &s, const std::string &key)
   {
     if (key == "alphas")
       return common::value_mutator(
           reinterpret_cast<uint8_t *>(&s.alphas[0]),
           common::runtime_type(
             common::static_type_to_primitive_type<
-              std::remove_reference<decltype(s.alphas[0])>::type
+              typename std::remove_reference<decltype(s.alphas[0])>::type
             >::value,
             s.dim));
     throw std::runtime_error("Unknown shared HP param key: " + key);
   }
 };
 
-template <>
-struct distributions_group_ss< distributions::DirichletDiscrete128 >
+template <typename T>
+struct dd_group_ss
 {
   static inline common::value_mutator
-  get(distributions::DirichletDiscrete128::Group &s, const std::string &key)
+  get(typename T::Group &s, const std::string &key)
   {
     if (key == "count_sum")
       return common::value_mutator(&s.count_sum);
@@ -192,13 +222,29 @@ struct distributions_group_ss< distributions::DirichletDiscrete128 >
           reinterpret_cast<uint8_t *>(&s.counts[0]),
           common::runtime_type(
             common::static_type_to_primitive_type<
-              std::remove_reference<decltype(s.counts[0])>::type
+              typename std::remove_reference<decltype(s.counts[0])>::type
             >::value,
             s.dim));
     throw std::runtime_error("Unknown group SS param key: " + key);
   }
 };
 
+template <int N>
+struct distributions_shared_hp< distributions::DirichletDiscrete<N> >
+  : public dd_shared_hp< distributions::DirichletDiscrete<N> > {};
+
+template <int N>
+struct distributions_group_ss< distributions::DirichletDiscrete<N> >
+  : public dd_group_ss< distributions::DirichletDiscrete<N> > {};
+
+template <>
+struct distributions_shared_hp< distributions::DirichletDiscreteV >
+  : public dd_shared_hp< distributions::DirichletDiscreteV > {};
+
+template <>
+struct distributions_group_ss< distributions::DirichletDiscreteV >
+  : public dd_group_ss< distributions::DirichletDiscreteV > {};
+
 namespace detail {
 
 template <typename T>
@@ -251,6 +297,58 @@ struct value_setter<Eigen::Matrix<T, Rows, 1>> {
   }
 };
 
+// fixed layout suff stats are snapshotted as raw bytes; everything else
+// (e.g. the Eigen backed NIW stats) goes through protobuf
+template <typename T, typename Message,
+          bool Raw = std::is_trivially_copyable<typename T::Group>::value>
+struct group_snapshot {
+  static inline void
+  dump(const typename T::Group &repr, common::snapshot_writer &w)
+  {
+    w.write_raw(&repr, sizeof(repr));
+  }
+
+  static inline void
+  load(typename T::Group &repr, common::snapshot_reader &r)
+  {
+    r.read_raw(&repr, sizeof(repr));
+  }
+};
+
+template <typename T, typename Message>
+struct group_snapshot<T, Message, false> {
+  static inline void
+  dump(const typename T::Group &repr, common::snapshot_writer &w)
+  {
+    Message m;
+    repr.protobuf_dump(m);
+    w.write_bytes(common::util::protobuf_to_string(m));
+  }
+
+  static inline void
+  load(typename T::Group &repr, common::snapshot_reader &r)
+  {
+    Message m;
+    common::util::protobuf_from_string(m, r.read_bytes());
+    repr.protobuf_load(m);
+  }
+};
+
+template <typename T>
+struct void_type { typedef void type; };
+
+template <typename T, typename Enable = void>
+struct has_scorer : std::false_type {};
+
+template <typename T>
+struct has_scorer<T, typename void_type<typename T::Scorer>::type>
+  : std::true_type {};
+
+// a fresh (nonzero) hypers stamp
+uint64_t next_hypers_stamp();
+
+template <typename T> class distributions_hypers;
+
 } // namespace detail
 
 template <typename T>
@@ -267,6 +365,7 @@ public:
   add_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override
   {
     MICROSCOPES_ASSERT(!value.anymasked());
+    MICROSCOPES_METRIC_INC(M_GROUP_ADD_VALUE);
     repr_.add_value(shared_repr(m), detail::value_getter<typename T::Value>::get(value), rng);
   }
 
@@ -274,6 +373,7 @@ public:
   remove_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override
   {
     MICROSCOPES_ASSERT(!value.anymasked());
+    MICROSCOPES_METRIC_INC(M_GROUP_REMOVE_VALUE);
     repr_.remove_value(shared_repr(m), detail::value_getter<typename T::Value>::get(value), rng);
   }
 
@@ -281,12 +381,14 @@ public:
   score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override
   {
     MICROSCOPES_ASSERT(!value.anymasked());
+    MICROSCOPES_METRIC_INC(M_GROUP_SCORE_VALUE);
     return repr_.score_value(shared_repr(m), detail::value_getter<typename T::Value>::get(value), rng);
   }
 
   float
   score_data(const hypers &m, common::rng_t &rng) const override
   {
+    MICROSCOPES_METRIC_INC(M_GROUP_SCORE_DATA);
     return repr_.score_data(shared_repr(m), rng);
   }
 
@@ -297,18 +399,32 @@ public:
     detail::value_setter<typename T::Value>::set(value, sampled);
   }
 
+  void
+  merge(const hypers &m, const group &g, common::rng_t &rng) override
+  {
+    repr_.merge(shared_repr(m), static_cast<const distributions_group<T> &>(g).repr_, rng);
+  }
+
   common::suffstats_bag_t
   get_ss() const override
   {
-    message_type m;
+    common::suffstats_bag_t out;
+    get_ss(out);
+    return out;
+  }
+
+  void
+  get_ss(common::suffstats_bag_t &out) const override
+  {
+    message_type &m = common::util::scratch_message<message_type>();
     repr_.protobuf_dump(m);
-    return common::util::protobuf_to_string(m);
+    common::util::protobuf_to_string(m, out);
   }
 
   void
   set_ss(const common::suffstats_bag_t &ss) override
   {
-    message_type m;
+    message_type &m = common::util::scratch_message<message_type>();
     common::util::protobuf_from_string(m, ss);
     repr_.protobuf_load(m);
   }
@@ -325,6 +441,18 @@ public:
     return distributions_group_ss<T>::get(repr_, name);
   }
 
+  void
+  dump_ss(common::snapshot_writer &w) const override
+  {
+    detail::group_snapshot<T, message_type>::dump(repr_, w);
+  }
+
+  void
+  load_ss(common::snapshot_reader &r) override
+  {
+    detail::group_snapshot<T, message_type>::load(repr_, r);
+  }
+
   std::string
   debug_str() const override
   {
@@ -337,6 +465,241 @@ public:
   typename T::Group repr_;
 };
 
+/**
+ * A distributions_group which also keeps a T::Scorer (distributions'
+ * precomputed posterior predictive constants), rebuilt whenever the suff
+ * stats change through add_value/remove_value/merge, so score_value()
+ * against an unchanged group is a few FLOPs. Created instead of a plain
+ * group by hypers which opted in, see distributions_hypers::set_scorer_cache().
+ *
+ * The scorer is only used while the stamp of the hypers it was built against
+ * is current; otherwise (and after set_ss()/load_ss(), or writes through
+ * get_ss_mutator()) scoring falls back to the suff stats until the next
+ * change. It is never rebuilt from const paths, so concurrent scoring stays
+ * read-only.
+ */
+template <typename T>
+class cached_distributions_group : public distributions_group<T> {
+public:
+  cached_distributions_group() : scorer_(), stamp_() {}
+
+  void
+  add_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override
+  {
+    distributions_group<T>::add_value(m, value, rng);
+    refresh(m, rng);
+  }
+
+  void
+  remove_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override
+  {
+    distributions_group<T>::remove_value(m, value, rng);
+    refresh(m, rng);
+  }
+
+  float
+  score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override;
+
+  void
+  merge(const hypers &m, const group &g, common::rng_t &rng) override
+  {
+    distributions_group<T>::merge(m, g, rng);
+    refresh(m, rng);
+  }
+
+  void
+  set_ss(const common::suffstats_bag_t &ss) override
+  {
+    distributions_group<T>::set_ss(ss);
+    stamp_ = 0;
+  }
+
+  void
+  set_ss(const group &g) override
+  {
+    distributions_group<T>::set_ss(g);
+    stamp_ = 0;
+  }
+
+  common::value_mutator
+  get_ss_mutator(const std::string &name) override
+  {
+    return distributions_group<T>::get_ss_mutator(name).notify(
+        &cached_distributions_group<T>::invalidate, this);
+  }
+
+  void
+  load_ss(common::snapshot_reader &r) override
+  {
+    distributions_group<T>::load_ss(r);
+    stamp_ = 0;
+  }
+
+  // rebuilds the scorer from the suff stats, against m
+  void refresh(const hypers &m, common::rng_t &rng);
+
+  // whether score_value() against m uses the scorer
+  bool cached(const hypers &m) const;
+
+private:
+  static void
+  invalidate(void *g)
+  {
+    static_cast<cached_distributions_group<T> *>(g)->stamp_ = 0;
+  }
+
+  typename T::Scorer scorer_;
+  uint64_t stamp_; // of the hypers scorer_ was built against, 0 if stale
+};
+
+/**
+ * A mixture keeping a T::Scorer for every group, contiguously, so scoring a
+ * value against all groups reads the value once and evaluates each scorer.
+ * Scorers built against other hypers than the ones given, or against values
+ * since changed by set_hp()/hp_changed(), are skipped in favor of the
+ * group's own score_value() until refresh().
+ *
+ * Unlike cached_distributions_group, the groups themselves need not carry
+ * a Scorer, so plain groups (no larger than their T::Group) suffice.
+ */
+template <typename T>
+class distributions_mixture : public mixture {
+public:
+  float
+  score_value(size_t gid, const hypers &m, const common::value_accessor &value,
+              common::rng_t &rng) const override
+  {
+    MICROSCOPES_ASSERT(!value.anymasked());
+    check_synced();
+    const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+    const size_t i = index(gid);
+    if (likely(stamps_[i] == h.stamp()))
+      return scorers_[i].eval(
+          h.repr_, detail::value_getter<typename T::Value>::get(value), rng);
+    return groups_[i]->score_value(m, value, rng);
+  }
+
+  bool
+  cached(size_t gid, const hypers &m) const override
+  {
+    const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+    return stamps_[index(gid)] == h.stamp();
+  }
+
+  void
+  score_value_all_groups(const hypers &m, const common::value_accessor &value,
+                         float *out, common::rng_t &rng) const override
+  {
+    MICROSCOPES_ASSERT(!value.anymasked());
+    MICROSCOPES_METRIC_INC(M_MIXTURE_SCORE_VALUE);
+    MICROSCOPES_TRACE_SPAN("mixture::score_value_all_groups");
+    MICROSCOPES_METRIC_OBSERVE(H_MIXTURE_GROUPS, scorers_.size());
+    check_synced();
+    const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+    const uint64_t stamp = h.stamp();
+    const typename T::Value v = detail::value_getter<typename T::Value>::get(value);
+    for (size_t i = 0; i < scorers_.size(); i++) {
+      if (likely(stamps_[i] == stamp))
+        out[i] = scorers_[i].eval(h.repr_, v, rng);
+      else
+        out[i] = groups_[i]->score_value(m, value, rng);
+    }
+  }
+
+  void
+  refresh(const hypers &m, common::rng_t &rng) override
+  {
+    for (size_t i = 0; i < scorers_.size(); i++)
+      group_changed(i, m, rng);
+  }
+
+protected:
+  void
+  group_created(size_t i, const hypers &m, common::rng_t &rng) override
+  {
+    scorers_.insert(scorers_.begin() + i, typename T::Scorer());
+    stamps_.insert(stamps_.begin() + i, 0);
+    group_changed(i, m, rng);
+  }
+
+  void
+  group_deleted(size_t i) override
+  {
+    scorers_.erase(scorers_.begin() + i);
+    stamps_.erase(stamps_.begin() + i);
+  }
+
+  void
+  group_changed(size_t i, const hypers &m, common::rng_t &rng) override
+  {
+    const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+    const auto &g = static_cast<const distributions_group<T> &>(*groups_[i]);
+    scorers_[i].init(h.repr_, g.repr_, rng);
+    stamps_[i] = h.stamp();
+  }
+
+private:
+  std::vector<typename T::Scorer> scorers_;
+  std::vector<uint64_t> stamps_;
+};
+
+namespace detail {
+
+template <typename T, bool = has_scorer<T>::value>
+struct group_factory {
+  static inline std::shared_ptr<group>
+  create(const distributions_hypers<T> &h, bool cached, common::rng_t &rng)
+  {
+    auto p = std::make_shared<distributions_group<T>>();
+    p->repr_.init(h.repr_, rng);
+    return p;
+  }
+};
+
+template <typename T>
+struct group_factory<T, true> {
+  static inline std::shared_ptr<group>
+  create(const distributions_hypers<T> &h, bool cached, common::rng_t &rng)
+  {
+    if (!cached)
+      return group_factory<T, false>::create(h, false, rng);
+    auto p = std::make_shared<cached_distributions_group<T>>();
+    p->repr_.init(h.repr_, rng);
+    p->refresh(h, rng);
+    return p;
+  }
+};
+
+template <typename T, bool = has_scorer<T>::value>
+struct mixture_factory {
+  static inline std::shared_ptr<mixture>
+  create()
+  {
+    return std::make_shared<mixture>();
+  }
+};
+
+template <typename T>
+struct mixture_factory<T, true> {
+  static inline std::shared_ptr<mixture>
+  create()
+  {
+    return std::make_shared<distributions_mixture<T>>();
+  }
+};
+
+// recomputes whatever T::Shared derives from its hypers, after they change
+template <typename Shared>
+inline void shared_changed(Shared &) {}
+
+inline void
+shared_changed(DirichletDiscreteV::Shared &s)
+{
+  s.update_alpha_sum();
+}
+
+} // namespace detail
+
 namespace detail {
 
 template <typename T>
@@ -344,42 +707,79 @@ class distributions_hypers : public hypers {
 public:
   typedef typename distribution_types<T>::shared_message_type message_type;
 
+  distributions_hypers()
+    : repr_(), stamp_(next_hypers_stamp()), scorer_cache_(false) {}
+
   std::shared_ptr<group>
   create_group(common::rng_t &rng) const override
   {
-    auto p = std::make_shared<distributions_group<T>>();
-    p->repr_.init(repr_, rng);
-    return p;
+    return group_factory<T>::create(*this, scorer_cache_, rng);
+  }
+
+  // always plain groups, since they only accumulate suff stats
+  std::shared_ptr<group>
+  create_scratch_group(common::rng_t &rng) const override
+  {
+    return group_factory<T, false>::create(*this, false, rng);
+  }
+
+  /**
+   * Opts the groups created from now on into caching a T::Scorer, see
+   * cached_distributions_group. Worthwhile when many values are scored per
+   * add/remove_value() of a group. No-op for models without a Scorer
+   */
+  inline void set_scorer_cache(bool enabled) { scorer_cache_ = enabled; }
+  inline bool scorer_cache() const { return scorer_cache_; }
+
+  std::shared_ptr<mixture>
+  create_mixture() const override
+  {
+    return mixture_factory<T>::create();
   }
 
+  // identifies the current values of the hypers (never 0), see hp_changed()
+  inline uint64_t stamp() const { return stamp_; }
+
   common::hyperparam_bag_t
   get_hp() const override
   {
-    message_type m;
+    common::hyperparam_bag_t out;
+    get_hp(out);
+    return out;
+  }
+
+  void
+  get_hp(common::hyperparam_bag_t &out) const override
+  {
+    message_type &m = common::util::scratch_message<message_type>();
     repr_.protobuf_dump(m);
-    return common::util::protobuf_to_string(m);
+    common::util::protobuf_to_string(m, out);
   }
 
   void
   set_hp(const common::hyperparam_bag_t &hp) override
   {
-    message_type m;
+    message_type &m = common::util::scratch_message<message_type>();
     common::util::protobuf_from_string(m, hp);
     repr_.protobuf_load(m);
+    changed();
   }
 
   void
   set_hp(const hypers &m) override
   {
     repr_ = static_cast<const distributions_hypers<T> &>(m).repr_;
+    changed();
   }
 
   common::value_mutator
   get_hp_mutator(const std::string &name) override
   {
-    return distributions_shared_hp<T>::get(repr_, name);
+    return this->notifying(distributions_shared_hp<T>::get(repr_, name));
   }
 
+  void hp_changed() override { changed(); }
+
   std::string
   debug_str() const override
   {
@@ -390,6 +790,18 @@ public:
   }
 
   typename T::Shared repr_;
+
+protected:
+  inline void
+  changed()
+  {
+    shared_changed(repr_);
+    stamp_ = next_hypers_stamp();
+  }
+
+private:
+  uint64_t stamp_;
+  bool scorer_cache_;
 };
 
 template <typename T>
@@ -406,25 +818,15 @@ public:
 // shorten name
 typedef distributions::DirichletDiscrete128 DD128;
 
-} // namespace detail
-
+/**
+ * The DirichletDiscrete hypers, over the first dim categories of T
+ */
 template <typename T>
-class distributions_hypers : public detail::distributions_hypers<T> {
+class dd_hypers : public distributions_hypers<T> {
 public:
-  typedef
-    typename detail::distributions_hypers<T>::message_type
-    message_type;
-};
+  typedef typename distributions_hypers<T>::message_type message_type;
 
-template <>
-class distributions_hypers<detail::DD128>
-  : public detail::distributions_hypers<detail::DD128> {
-public:
-  typedef
-    typename detail::distributions_hypers<detail::DD128>::message_type
-    message_type;
-
-  distributions_hypers(unsigned size)
+  dd_hypers(unsigned size)
   {
     MICROSCOPES_DCHECK(size > 0, "no elements");
     this->repr_.dim = size;
@@ -433,18 +835,58 @@ public:
   void
   set_hp(const common::hyperparam_bag_t &hp) override
   {
-    message_type m;
+    message_type &m = common::util::scratch_message<message_type>();
     common::util::protobuf_from_string(m, hp);
     MICROSCOPES_DCHECK(this->repr_.dim == m.alphas_size(), "wrong dimension");
     this->repr_.protobuf_load(m);
+    this->changed();
   }
 
   void
   set_hp(const hypers &m) override
   {
-    const auto &that = static_cast<const distributions_hypers<detail::DD128> &>(m);
+    const auto &that = static_cast<const dd_hypers<T> &>(m);
     MICROSCOPES_DCHECK(this->repr_.dim == that.repr_.dim, "wrong dimension");
     this->repr_ = that.repr_;
+    this->changed();
+  }
+};
+
+/**
+ * Hypers for a DirichletDiscrete over dim categories, using the smallest
+ * DirichletDiscrete<N> which fits (or DirichletDiscreteV beyond 128)
+ */
+std::shared_ptr<hypers> create_dd_hypers(unsigned dim);
+
+} // namespace detail
+
+template <typename T>
+class distributions_hypers : public detail::distributions_hypers<T> {
+public:
+  typedef
+    typename detail::distributions_hypers<T>::message_type
+    message_type;
+};
+
+template <int N>
+class distributions_hypers<distributions::DirichletDiscrete<N>>
+  : public detail::dd_hypers<distributions::DirichletDiscrete<N>> {
+public:
+  distributions_hypers(unsigned size)
+    : detail::dd_hypers<distributions::DirichletDiscrete<N>>(size)
+  {
+    MICROSCOPES_DCHECK(size <= N, "too many categories");
+  }
+};
+
+template <>
+class distributions_hypers<distributions::DirichletDiscreteV>
+  : public detail::dd_hypers<distributions::DirichletDiscreteV> {
+public:
+  distributions_hypers(unsigned size)
+    : detail::dd_hypers<distributions::DirichletDiscreteV>(size)
+  {
+    this->repr_.alphas.resize(size);
   }
 };
 
@@ -458,9 +900,30 @@ public:
   }
 };
 
+template <int N>
+class distributions_model<distributions::DirichletDiscrete<N>>
+  : public detail::distributions_model<distributions::DirichletDiscrete<N>> {
+public:
+  distributions_model(unsigned dim)
+    : dim_(dim)
+  {
+    MICROSCOPES_DCHECK(dim > 0, "no elements");
+  }
+
+  std::shared_ptr<hypers>
+  create_hypers() const override
+  {
+    return std::make_shared<
+      distributions_hypers<distributions::DirichletDiscrete<N>>>(dim_);
+  }
+
+private:
+  unsigned dim_;
+};
+
 template <>
-class distributions_model<detail::DD128>
-  : public detail::distributions_model<detail::DD128> {
+class distributions_model<distributions::DirichletDiscreteV>
+  : public detail::distributions_model<distributions::DirichletDiscreteV> {
 public:
   distributions_model(unsigned dim)
     : dim_(dim)
@@ -471,13 +934,50 @@ public:
   std::shared_ptr<hypers>
   create_hypers() const override
   {
-    return std::make_shared<distributions_hypers<detail::DD128>>(dim_);
+    return std::make_shared<
+      distributions_hypers<distributions::DirichletDiscreteV>>(dim_);
   }
 
 private:
   unsigned dim_;
 };
 
+/**
+ * A DirichletDiscrete over dim categories, whose hypers (and hence groups)
+ * are of the smallest DirichletDiscrete type which fits, see
+ * detail::create_dd_hypers(). Unlike distributions_model<DirichletDiscrete<N>>,
+ * the concrete hypers type is only known at runtime, so callers must not
+ * static_cast the hypers to any one distributions_hypers<T>.
+ */
+class dd_model : public model {
+public:
+  dd_model(unsigned dim)
+    : dim_(dim)
+  {
+    MICROSCOPES_DCHECK(dim > 0, "no elements");
+  }
+
+  std::shared_ptr<hypers>
+  create_hypers() const override
+  {
+    return detail::create_dd_hypers(dim_);
+  }
+
+  common::runtime_type
+  get_runtime_type() const override
+  {
+    return common::runtime_type(
+        common::static_type_to_primitive_type<
+          detail::DD128::Value
+        >::value);
+  }
+
+  inline unsigned dim() const { return dim_; }
+
+private:
+  unsigned dim_;
+};
+
 template <>
 class distributions_model<distributions::NormalInverseWishartV> : public model {
 public:
@@ -527,5 +1027,36 @@ distributions_group<T>::shared_repr(const hypers &h)
   return static_cast<const distributions_hypers<T> &>(h).repr_;
 }
 
+template <typename T>
+inline float
+cached_distributions_group<T>::score_value(
+    const hypers &m, const common::value_accessor &value, common::rng_t &rng) const
+{
+  if (!cached(m))
+    return distributions_group<T>::score_value(m, value, rng);
+  MICROSCOPES_ASSERT(!value.anymasked());
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_VALUE);
+  const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+  return scorer_.eval(
+      h.repr_, detail::value_getter<typename T::Value>::get(value), rng);
+}
+
+template <typename T>
+inline void
+cached_distributions_group<T>::refresh(const hypers &m, common::rng_t &rng)
+{
+  const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+  scorer_.init(h.repr_, this->repr_, rng);
+  stamp_ = h.stamp();
+}
+
+template <typename T>
+inline bool
+cached_distributions_group<T>::cached(const hypers &m) const
+{
+  const auto &h = static_cast<const detail::distributions_hypers<T> &>(m);
+  return likely(stamp_ == h.stamp());
+}
+
 } // namespace models
 } // namespace microscopes
@@ -3,6 +3,7 @@
 #include <microscopes/common/assert.hpp>
 #include <microscopes/common/macros.hpp>
 #include <microscopes/common/util.hpp>
+#include <microscopes/common/lgamma_cache.hpp>
 #include <microscopes/models/base.hpp>
 #include <microscopes/io/schema.pb.h>
 
@@ -19,39 +20,40 @@ class dm_group : public group {
 public:
   typedef microscopes::io::DirichletMultinomial_Group message_type;
 
+  // (category, count) pairs, sorted by category, counts nonzero
+  typedef std::vector<std::pair<unsigned, unsigned>> sparse_counts_t;
+
+  // groups over at least this many categories store only their nonzero
+  // counts, so that memory and scoring time scale with the # of nonzeros
+  static const unsigned SparseThreshold = 1024;
+
   dm_group(unsigned categories)
-    : counts_(categories), ratio_() {}
+    : categories_(categories),
+      sparse_(categories >= SparseThreshold),
+      counts_(sparse_ ? 0 : categories),
+      nonzeros_(),
+      count_sum_(),
+      ratio_() {}
 
   void add_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override;
   void remove_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override;
   float score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override;
   float score_data(const hypers &m, common::rng_t &rng) const override;
+
+  /**
+   * Draws from the posterior predictive. Since a row's # of trials is not
+   * part of the model, the row already in value is used as a template: the
+   * draw has the same row sum.
+   */
   void sample_value(const hypers &m, common::value_mutator &value, common::rng_t &rng) const override;
 
-  common::suffstats_bag_t
-  get_ss() const override
-  {
-    message_type m;
-    for (auto c : counts_)
-      m.add_counts(c);
-    m.set_ratio(ratio_);
-    return common::util::protobuf_to_string(m);
-  }
+  // as above, with n trials
+  void sample_value(const hypers &m, unsigned n, common::value_mutator &value, common::rng_t &rng) const;
 
-  void
-  set_ss(const common::suffstats_bag_t &ss) override
-  {
-    message_type m;
-    common::util::protobuf_from_string(m, ss);
-    MICROSCOPES_DCHECK(
-        (size_t)m.counts_size() == categories(),
-        "# categories mismatch");
-    MICROSCOPES_DCHECK(m.ratio() >= 0., "negative partition");
-    for (size_t i = 0; i < categories(); i++) {
-      counts_[i] = m.counts(i);
-    }
-    ratio_ = m.ratio();
-  }
+  void merge(const hypers &m, const group &g, common::rng_t &rng) override;
+
+  common::suffstats_bag_t get_ss() const override;
+  void set_ss(const common::suffstats_bag_t &ss) override;
 
   void
   set_ss(const group &g) override
@@ -68,22 +70,39 @@ public:
     throw std::runtime_error("no mutation allowed");
   }
 
+  void dump_ss(common::snapshot_writer &w) const override;
+  void load_ss(common::snapshot_reader &r) override;
+
   std::string
   debug_str() const override
   {
     std::ostringstream oss;
-    oss << "{counts:" << counts_ << ", ratio:" << ratio_ << "}";
+    if (sparse_)
+      oss << "{nonzeros:" << nonzeros_ << ", ratio:" << ratio_ << "}";
+    else
+      oss << "{counts:" << counts_ << ", ratio:" << ratio_ << "}";
     return oss.str();
   }
 
   inline size_t
   categories() const
   {
-    return counts_.size();
+    return categories_;
   }
 
+  inline bool sparse() const { return sparse_; }
+
+  // the count of category i
+  unsigned count(size_t i) const;
+
 private:
-  std::vector<unsigned> counts_;
+  void set_counts(const std::vector<unsigned> &counts);
+
+  unsigned categories_;
+  bool sparse_;
+  std::vector<unsigned> counts_; // dense
+  sparse_counts_t nonzeros_; // sparse
+  unsigned count_sum_;
   float ratio_;
 };
 
@@ -92,7 +111,7 @@ public:
   typedef microscopes::io::DirichletMultinomial_Shared message_type;
 
   dm_hypers(unsigned categories)
-    : alphas_(categories) {}
+    : alphas_(categories), alpha_sum_() {}
 
   std::shared_ptr<group>
   create_group(common::rng_t &rng) const override
@@ -103,7 +122,7 @@ public:
   common::hyperparam_bag_t
   get_hp() const override
   {
-    message_type m;
+    message_type &m = common::util::scratch_message<message_type>();
     for (auto a : alphas_)
       m.add_alphas(a);
     return common::util::protobuf_to_string(m);
@@ -112,7 +131,7 @@ public:
   void
   set_hp(const common::hyperparam_bag_t &hp) override
   {
-    message_type m;
+    message_type &m = common::util::scratch_message<message_type>();
     common::util::protobuf_from_string(m, hp);
     MICROSCOPES_DCHECK(
         (size_t)m.alphas_size() == categories(),
@@ -122,6 +141,7 @@ public:
           "alphas need to be positive reals");
       alphas_[i] = m.alphas(i);
     }
+    alphas_changed();
   }
 
   void
@@ -130,6 +150,7 @@ public:
     const auto &h = static_cast<const dm_hypers &>(m);
     MICROSCOPES_DCHECK(categories() == h.categories(),
         "# categories mismatch");
+    // copies the alphas and their sum, and clears the lgamma cache
     *this = h;
   }
 
@@ -137,14 +158,16 @@ public:
   get_hp_mutator(const std::string &key) override
   {
     if (key == "alphas")
-      return common::value_mutator(
+      return notifying(common::value_mutator(
           reinterpret_cast<uint8_t *>(&alphas_[0]),
           common::runtime_type(
             common::static_type_to_primitive_type<float>::value,
-            categories()));
+            categories())));
     throw std::runtime_error("unknown key: " + key);
   }
 
+  void hp_changed() override { alphas_changed(); }
+
   inline size_t
   categories() const
   {
@@ -157,6 +180,22 @@ public:
     return alphas_;
   }
 
+  /**
+   * lgamma(n + alphas()[i]) lookups for n in [0, max_n], built for the
+   * current alphas, see common::lgamma_cache.
+   *
+   * every change to the alphas goes through alphas_changed() (writes
+   * through get_hp_mutator()'s mutators by way of hp_changed()), which
+   * invalidates the cache
+   */
+  inline const common::lgamma_shifted_table *
+  lgamma_table(unsigned max_n) const
+  {
+    return lgamma_cache_.get(alphas_, max_n + 1);
+  }
+
+  inline float alpha_sum() const { return alpha_sum_; }
+
   std::string
   debug_str() const override
   {
@@ -166,7 +205,18 @@ public:
   }
 
 private:
+  inline void
+  alphas_changed()
+  {
+    alpha_sum_ = 0.;
+    for (auto a : alphas_)
+      alpha_sum_ += a;
+    lgamma_cache_.invalidate();
+  }
+
   std::vector<float> alphas_;
+  float alpha_sum_;
+  common::lgamma_cache lgamma_cache_;
 };
 
 class dm_model : public model {
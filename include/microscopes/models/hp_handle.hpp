@@ -0,0 +1,163 @@
+#pragma once
+
+#include <microscopes/models/base.hpp>
+#include <microscopes/models/ss_histogram.hpp>
+#include <microscopes/common/runtime_type.hpp>
+#include <microscopes/common/runtime_value.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstring>
+
+namespace microscopes {
+namespace models {
+
+/**
+ * A typed reference to one hyperparameter of a hypers object. The key is
+ * resolved (via get_hp_mutator(), which has no side effects) and type
+ * checked once, at construction; get() afterwards is a plain load from the
+ * model's representation, and set() a store followed by hp_changed(), so
+ * anything cached against the old value is invalidated.
+ *
+ * A handle is valid for as long as the hypers object it was resolved
+ * against. T must match the field's storage type exactly (no runtime
+ * casting is done).
+ */
+template <typename T>
+class hp_handle {
+public:
+  hp_handle() : h_(), px_() {}
+
+  hp_handle(hypers &h, const std::string &key, size_t idx=0)
+    : h_(&h), px_()
+  {
+    const common::value_mutator mut = h.get_hp_mutator(key);
+    MICROSCOPES_CHECK(
+        mut.type().t() == common::static_type_to_primitive_type<T>::value,
+        "hyperparameter type mismatch: " + key);
+    MICROSCOPES_CHECK(idx < mut.shape(), "index out of range: " + key);
+    px_ = reinterpret_cast<T *>(mut.data()) + idx;
+  }
+
+  inline T
+  get() const
+  {
+    MICROSCOPES_ASSERT(px_);
+    return *px_;
+  }
+
+  inline void
+  set(T value)
+  {
+    MICROSCOPES_ASSERT(px_);
+    *px_ = value;
+    h_->hp_changed();
+  }
+
+  inline bool valid() const { return px_ != nullptr; }
+
+private:
+  hypers *h_;
+  T *px_;
+};
+
+/**
+ * Computes the sum of score_data() over the groups of a single feature, as a
+ * function of a fixed set of that feature's hyperparameters.
+ *
+ * Scores are memoized on the current raw values of the tracked fields, so a
+ * sampler which proposes a value, rescores and then reverts (e.g. a rejected
+ * MH step, or a slice sampler shrinking back towards its start) gets the
+ * score of the reverted value for free. The cache knows nothing about the
+ * groups themselves; callers must invalidate() it whenever any group's suff
+ * stats change.
+ */
+class feature_rescorer {
+public:
+  feature_rescorer(hypers &h,
+                   const std::vector<std::string> &keys,
+                   size_t cache_size=4)
+    : h_(&h), fields_(), cache_(), cache_size_(cache_size), next_(),
+      key_()
+  {
+    MICROSCOPES_DCHECK(cache_size > 0, "need a non-empty cache");
+    // only ever read through, so the fields are resolved without a
+    // hp_changed()
+    for (const auto &k : keys) {
+      const common::value_mutator mut = h.get_hp_mutator(k);
+      fields_.emplace_back(mut.data(), mut.type().size());
+    }
+    cache_.reserve(cache_size);
+  }
+
+  /**
+   * groups is any range of (smart) pointers to this feature's groups, e.g.
+   * the std::vector<std::shared_ptr<group>> of one feature.
+   */
+  template <typename Range>
+  float
+  score_data(const Range &groups, common::rng_t &rng)
+  {
+    return cached([&]() {
+      float sum = 0.;
+      for (const auto &g : groups)
+        sum += g->score_data(*h_, rng);
+      return sum;
+    });
+  }
+
+  // the feature's groups, collapsed by distinct suff stats
+  float
+  score_data(const ss_histogram &hist, common::rng_t &rng)
+  {
+    return cached([&]() { return hist.score_data(*h_, rng); });
+  }
+
+  inline void
+  invalidate()
+  {
+    cache_.clear();
+    next_ = 0;
+  }
+
+private:
+  template <typename Fn>
+  float
+  cached(Fn score_fn)
+  {
+    current_key(key_);
+    for (const auto &e : cache_)
+      if (e.first == key_)
+        return e.second;
+    const float sum = score_fn();
+    if (cache_.size() < cache_size_) {
+      cache_.emplace_back(key_, sum);
+    } else {
+      cache_[next_].first = key_;
+      cache_[next_].second = sum;
+      next_ = (next_ + 1) % cache_size_;
+    }
+    return sum;
+  }
+
+  inline void
+  current_key(std::string &key) const
+  {
+    key.clear();
+    for (const auto &f : fields_)
+      key.append(reinterpret_cast<const char *>(f.first), f.second);
+  }
+
+  hypers *h_;
+  std::vector<std::pair<const uint8_t *, size_t>> fields_;
+  std::vector<std::pair<std::string, float>> cache_;
+  size_t cache_size_;
+  size_t next_;
+  std::string key_; // scratch
+};
+
+} // namespace models
+} // namespace microscopes
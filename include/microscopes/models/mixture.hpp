@@ -0,0 +1,151 @@
+#pragma once
+
+#include <microscopes/common/assert.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/group_manager.hpp>
+#include <microscopes/models/base.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace microscopes {
+namespace models {
+
+/**
+ * All the groups of one feature, for scoring a value against every group at
+ * once (cf. the Mixture types of distributions).
+ *
+ * A mixture either creates its own groups, or (after reset()) shares the
+ * groups of a state's group_manager, so the suff stats exist only once.
+ * Either way every change to a group must go through the mixture, so its
+ * per group constants cannot go stale: create_group()/delete_group() as the
+ * gids of the group_manager come and go, add_value()/remove_value() (which
+ * update the group itself, so callers must not also do so), and update()
+ * for anything else (e.g. merge() or set_ss()). Groups are kept in
+ * increasing gid order, which is the iteration order of group_manager.
+ *
+ * A mixture reset() from a group_manager checks this: the group_manager's
+ * generation() changes on every create/delete_group() and
+ * add/remove_value(), and scoring throws unless the mixture has made a
+ * change of its own since (e.g. after a state's add_value() which skipped
+ * the mixture). The group_manager must outlive the mixture, and not move.
+ *
+ * The base class just loops over the groups. Models which can precompute
+ * per group constants (see distributions_mixture) override the protected
+ * hooks below, score_value() and score_value_all_groups().
+ */
+class mixture {
+public:
+  mixture() : gm_generation_(), generation_() {}
+  virtual ~mixture() {}
+
+  // creates group gid (which must not exist) from h
+  const group & create_group(size_t gid, const hypers &h, common::rng_t &rng);
+
+  // adds group gid (which must not exist) as g, e.g. the group just created
+  // in the group_manager this mixture was reset() from
+  void create_group(size_t gid, const std::shared_ptr<group> &g,
+                    const hypers &h, common::rng_t &rng);
+
+  void delete_group(size_t gid);
+
+  void add_value(size_t gid, const hypers &h,
+                 const common::value_accessor &value, common::rng_t &rng);
+  void remove_value(size_t gid, const hypers &h,
+                    const common::value_accessor &value, common::rng_t &rng);
+
+  /**
+   * Applies fn to group gid (as a group &), then updates its per group
+   * constants. For changes other than add/remove_value(), e.g. merge()
+   */
+  template <typename Fn>
+  void
+  update(size_t gid, const hypers &h, common::rng_t &rng, Fn fn)
+  {
+    const size_t i = index(gid);
+    fn(*groups_[i]);
+    group_changed(i, h, rng);
+  }
+
+  inline const group &
+  get_group(size_t gid) const
+  {
+    return *groups_[index(gid)];
+  }
+
+  // score_value() of group gid, through the per group constants if current
+  virtual float score_value(size_t gid, const hypers &h,
+                            const common::value_accessor &value,
+                            common::rng_t &rng) const;
+
+  /**
+   * Writes score_value() of every group, in gid order, to out (which must
+   * hold ngroups() floats)
+   */
+  virtual void score_value_all_groups(
+      const hypers &h, const common::value_accessor &value,
+      float *out, common::rng_t &rng) const;
+
+  // whether group gid is scored through per group constants built against h
+  virtual bool cached(size_t gid, const hypers &h) const { return false; }
+
+  /**
+   * Recomputes any per group constants, which is needed after the hypers
+   * change (until then, scoring falls back to the groups themselves)
+   */
+  virtual void refresh(const hypers &h, common::rng_t &rng) {}
+
+  /**
+   * Rebuilds the mixture over the groups of gm (e.g. of a state which was
+   * just deserialized), sharing rather than copying them, and checks that
+   * it stays in sync with gm from then on (see above). group_of maps the T
+   * of gm to the std::shared_ptr<group> of this feature.
+   */
+  template <typename T, typename Fn>
+  void
+  reset(const common::group_manager<T> &gm, Fn group_of,
+        const hypers &h, common::rng_t &rng)
+  {
+    while (!gids_.empty())
+      delete_group(gids_.back());
+    gm_generation_ = &gm.generation();
+    for (const auto &p : gm)
+      create_group(p.first, group_of(p.second.data_), h, rng);
+  }
+
+  inline size_t ngroups() const { return gids_.size(); }
+  inline const std::vector<size_t> & gids() const { return gids_; }
+
+  // the position of gid in gids()
+  size_t index(size_t gid) const;
+
+protected:
+  virtual void group_created(size_t i, const hypers &h, common::rng_t &rng) {}
+  virtual void group_deleted(size_t i) {}
+  virtual void group_changed(size_t i, const hypers &h, common::rng_t &rng) {}
+
+  // throws if the group_manager changed behind our back
+  inline void
+  check_synced() const
+  {
+    MICROSCOPES_CHECK(!gm_generation_ || generation_ == *gm_generation_,
+        "mixture is out of sync with its group_manager");
+  }
+
+  // records a change to the groups, matching the group_manager's
+  inline void
+  synced()
+  {
+    if (gm_generation_)
+      generation_ = *gm_generation_;
+  }
+
+  std::vector<size_t> gids_;
+  std::vector<std::shared_ptr<group>> groups_;
+
+  const uint64_t *gm_generation_; // of the group_manager we were reset() from
+  uint64_t generation_; // of the group_manager, as of our last change
+};
+
+} // namespace models
+} // namespace microscopes
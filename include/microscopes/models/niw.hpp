@@ -0,0 +1,224 @@
+#pragma once
+
+#include <microscopes/common/assert.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/util.hpp>
+#include <microscopes/models/base.hpp>
+
+#include <distributions/io/protobuf.hpp>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Cholesky>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/**
+ * The Normal-Inverse-Wishart model.
+ *
+ * Unlike distributions_group<NormalInverseWishartV>, which rebuilds (and
+ * decomposes) the posterior scatter matrix on every call, a niw_group keeps
+ * the Cholesky factor of the posterior scatter matrix Psi_n, updating it by
+ * a rank one (up|down)date in add_value()/remove_value(). This makes
+ * add/remove/score_value O(d^2). The cached posterior is tagged with the
+ * stamp() of the hypers it was computed against; set_hp() only bumps the
+ * stamp, and each group refreshes (in O(d^3)) the next time it is used, so
+ * hypers proposals which are rejected before any group is scored cost
+ * nothing per group.
+ *
+ * The suff stats (and their protobuf messages) are those of the
+ * distributions NIW model, so the two are interchangeable.
+ *
+ * The classes are templated on the dimension D: niw_model picks a fixed
+ * size instantiation for 2 <= dim <= 8 (see MICROSCOPES_NIW_FOR_EACH_DIM),
+ * so small features use fixed size Eigen types which live inline (no heap
+ * allocations) and whose loops the compiler can unroll, and falls back to
+ * D = Eigen::Dynamic otherwise.
+ */
+
+#define MICROSCOPES_NIW_FOR_EACH_DIM(x) \
+  x(2) \
+  x(3) \
+  x(4) \
+  x(5) \
+  x(6) \
+  x(7) \
+  x(8) \
+  x(Eigen::Dynamic)
+
+namespace microscopes {
+namespace models {
+
+template <int D> class niw_hypers;
+
+template <int D>
+class niw_group : public group {
+public:
+  typedef distributions::protobuf::NormalInverseWishart_Group message_type;
+
+  // unaligned, so that groups can be allocated with std::make_shared()
+  typedef Eigen::Matrix<double, D, 1, Eigen::ColMajor | Eigen::DontAlign> vector_type;
+  typedef Eigen::Matrix<double, D, D, Eigen::ColMajor | Eigen::DontAlign> matrix_type;
+
+  explicit niw_group(const niw_hypers<D> &h);
+
+  niw_group(const niw_group &) = delete;
+
+  // copies the suff stats and posterior
+  niw_group &operator=(const niw_group &that);
+
+  void add_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override;
+  void remove_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) override;
+  float score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override;
+  float score_data(const hypers &m, common::rng_t &rng) const override;
+  void sample_value(const hypers &m, common::value_mutator &value, common::rng_t &rng) const override;
+  void merge(const hypers &m, const group &g, common::rng_t &rng) override;
+
+  common::suffstats_bag_t get_ss() const override;
+  void set_ss(const common::suffstats_bag_t &ss) override;
+
+  void
+  set_ss(const group &g) override
+  {
+    const auto &that = static_cast<const niw_group<D> &>(g);
+    MICROSCOPES_DCHECK(dim() == that.dim(), "dimension mismatch");
+    *this = that;
+  }
+
+  common::value_mutator
+  get_ss_mutator(const std::string &key) override
+  {
+    throw std::runtime_error("not supported");
+  }
+
+  void dump_ss(common::snapshot_writer &w) const override;
+  void load_ss(common::snapshot_reader &r) override;
+
+  std::string debug_str() const override;
+
+  inline unsigned dim() const { return sum_x_.size(); }
+  inline unsigned count() const { return count_; }
+
+  // whether the cached posterior is current under h
+  inline bool
+  cached(const niw_hypers<D> &h) const
+  {
+    return stamp_.load(std::memory_order_acquire) == h.stamp();
+  }
+
+  // the posterior parameters, with Psi_n kept in factored form
+  struct posterior {
+    double kappa_;
+    double nu_;
+    vector_type mu_;
+    Eigen::LLT<matrix_type> llt_;
+    double logdet_; // log |Psi_n|
+  };
+
+private:
+  // the posterior under h, refreshing our cache first if it is stale
+  const posterior &current(const niw_hypers<D> &h) const;
+
+  // recomputes the cached posterior from the suff stats, O(d^3)
+  void refresh(const niw_hypers<D> &h);
+
+  void compute_posterior(const niw_hypers<D> &h, posterior &p) const;
+
+  unsigned count_;
+  vector_type sum_x_;
+  matrix_type sum_xxT_;
+
+  // stamp of the niw_hypers post_ was computed against (0 if stale). const
+  // callers may score a group concurrently, so they refresh the cache under
+  // refresh_mutex_ and publish it through stamp_
+  mutable std::atomic<uint64_t> stamp_;
+  mutable posterior post_;
+  mutable std::mutex refresh_mutex_;
+};
+
+template <int D>
+class niw_hypers : public hypers {
+public:
+  typedef distributions::protobuf::NormalInverseWishart_Shared message_type;
+  typedef typename niw_group<D>::vector_type vector_type;
+  typedef typename niw_group<D>::matrix_type matrix_type;
+
+  // mu=0, kappa=1, psi=I, nu=dim
+  explicit niw_hypers(unsigned dim);
+
+  std::shared_ptr<group>
+  create_group(common::rng_t &rng) const override
+  {
+    return std::make_shared<niw_group<D>>(*this);
+  }
+
+  common::hyperparam_bag_t get_hp() const override;
+  void set_hp(const common::hyperparam_bag_t &hp) override;
+
+  void set_hp(const hypers &m) override;
+
+  common::value_mutator
+  get_hp_mutator(const std::string &key) override
+  {
+    // groups cache values derived from the hypers, so all changes must go
+    // through set_hp()
+    throw std::runtime_error("not supported");
+  }
+
+  std::string debug_str() const override;
+
+  inline unsigned dim() const { return mu0_.size(); }
+  inline const vector_type & mu0() const { return mu0_; }
+  inline double kappa0() const { return kappa0_; }
+  inline const matrix_type & psi0() const { return psi0_; }
+  inline double nu0() const { return nu0_; }
+  inline double logdet_psi0() const { return logdet_psi0_; }
+
+  // identifies the current values of the hypers; changes on every set_hp()
+  inline uint64_t stamp() const { return stamp_; }
+
+private:
+  // recomputes the derived values and bumps the stamp, which makes groups
+  // refresh their posterior when next used. O(d^3)
+  void changed();
+
+  vector_type mu0_;
+  double kappa0_;
+  matrix_type psi0_;
+  double nu0_;
+
+  double logdet_psi0_;
+  uint64_t stamp_;
+};
+
+class niw_model : public model {
+public:
+  niw_model(unsigned dim)
+    : dim_(dim)
+  {
+    MICROSCOPES_DCHECK(dim > 0, "no elements");
+  }
+
+  std::shared_ptr<hypers> create_hypers() const override;
+
+  common::runtime_type
+  get_runtime_type() const override
+  {
+    return common::runtime_type(TYPE_F32, dim_);
+  }
+
+  inline unsigned dim() const { return dim_; }
+
+private:
+  unsigned dim_;
+};
+
+#define MICROSCOPES_NIW_EXPLICIT_INSTANTIATE(d) \
+  extern template class niw_group<d>; \
+  extern template class niw_hypers<d>;
+MICROSCOPES_NIW_FOR_EACH_DIM(MICROSCOPES_NIW_EXPLICIT_INSTANTIATE)
+#undef MICROSCOPES_NIW_EXPLICIT_INSTANTIATE
+
+} // namespace models
+} // namespace microscopes
@@ -17,6 +17,7 @@ public:
   float score_value(const hypers &m, const common::value_accessor &value, common::rng_t &rng) const override { return 0.0; }
   float score_data(const hypers &m, common::rng_t &rng) const override { return 0.0; }
   void sample_value(const hypers &m, common::value_mutator &value, common::rng_t &rng) const override {}
+  void merge(const hypers &m, const group &g, common::rng_t &rng) override {}
   common::suffstats_bag_t get_ss() const override { return ""; }
   void set_ss(const common::suffstats_bag_t &ss) override {}
   void set_ss(const group &g) override {}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <microscopes/models/base.hpp>
+#include <microscopes/common/snapshot.hpp>
+#include <microscopes/common/random_fwd.hpp>
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace microscopes {
+namespace models {
+
+/**
+ * A multiset of the suff stats of one feature's groups.
+ *
+ * Groups with identical suff stats (e.g. the same (heads, tails) pair for a
+ * BetaBernoulli feature) are collapsed into a single private representative
+ * with a multiplicity, so that
+ *
+ *   score_data(h) == sum_{g in groups} g.score_data(h)
+ *
+ * costs one score_data() call per distinct suff stat rather than per group.
+ * This is what makes it cheap to evaluate many hyperparameter proposals
+ * against a fixed clustering.
+ *
+ * The histogram is a snapshot, built on demand (e.g. once per round of
+ * hyperparameter inference) from the groups as they stand; nothing is
+ * maintained as groups change, so the hot add/remove_value() paths pay
+ * nothing for it. Suff stats are compared by their dump_ss() bytes.
+ */
+class ss_histogram {
+public:
+  explicit ss_histogram(const hypers &h)
+    : h_(&h), entries_(), spare_(), key_(), w_() {}
+
+  ss_histogram(const ss_histogram &) = delete;
+  ss_histogram &operator=(const ss_histogram &) = delete;
+
+  /**
+   * Rebuilds the histogram from groups, any range of (smart) pointers to
+   * this feature's groups
+   */
+  template <typename Range>
+  void
+  build(const Range &groups, common::rng_t &rng)
+  {
+    clear();
+    for (const auto &g : groups)
+      add(*g, rng);
+  }
+
+  void add(const group &g, common::rng_t &rng);
+
+  // representatives are kept for reuse by the next build()
+  void clear();
+
+  float score_data(const hypers &h, common::rng_t &rng) const;
+
+  // # of distinct suff stats
+  inline size_t size() const { return entries_.size(); }
+
+  // # of groups
+  size_t count() const;
+
+private:
+  struct entry {
+    entry() : repr_(), count_() {}
+    std::shared_ptr<group> repr_;
+    size_t count_;
+  };
+
+  const std::string &key(const group &g);
+
+  // only used to create representatives
+  const hypers *h_;
+  std::unordered_map<std::string, entry> entries_;
+  std::vector<std::shared_ptr<group>> spare_;
+  std::string key_; // scratch
+  common::snapshot_writer w_;
+};
+
+} // namespace models
+} // namespace microscopes
@@ -7,9 +7,9 @@ from microscopes._models_h cimport (
     GammaPoisson as c_gp,
     NormalInverseChiSq as c_nich,
     distributions_model as c_distributions_model,
-    distributions_model_dd128 as c_distributions_model_dd128,
-    distributions_model_niwv as c_distributions_model_niwv,
+    dd_model as c_dd,
     bbnc_model as c_bbnc,
+    niw_model as c_niw,
     dm_model as c_dm,
 )
 
@@ -37,11 +37,11 @@ cdef class _nich(_base):
 
 cdef class _dd(_base):
     def __cinit__(self, int size):
-        self._thisptr.reset(new c_distributions_model_dd128(size))
+        self._thisptr.reset(new c_dd(size))
 
 cdef class _niw(_base):
     def __cinit__(self, int dim):
-        self._thisptr.reset(new c_distributions_model_niwv(dim))
+        self._thisptr.reset(new c_niw(dim))
 
 cdef class _bbnc(_base):
     def __cinit__(self):
@@ -5,7 +5,7 @@ from microscopes.common._runtime_type_h cimport runtime_type
 from microscopes.common._typedefs_h cimport hyperparam_bag_t, suffstats_bag_t
 from microscopes._shared_ptr_h cimport shared_ptr
 
-cdef extern from "microscopes/models/base.hpp" namespace "microscopes::models":
+cdef extern from "microscopes/models/base.hpp" namespace "microscopes::models" nogil:
     cdef cppclass group:
         suffstats_bag_t get_ss() except +
         void set_ss(const suffstats_bag_t &) except +
@@ -31,8 +31,8 @@ cdef extern from "microscopes/models/distributions.hpp" namespace "microscopes::
     cdef cppclass distributions_model[T]:
         distributions_model()
 
-    cdef cppclass distributions_model_dd128:
-        distributions_model_dd128(unsigned) except +
+    cdef cppclass dd_model:
+        dd_model(unsigned) except +
 
     cdef cppclass distributions_model_niwv:
         distributions_model_niwv(unsigned) except +
@@ -65,6 +65,10 @@ cdef extern from "microscopes/models/bbnc.hpp" namespace "microscopes::models":
     cdef cppclass bbnc_model:
         pass
 
+cdef extern from "microscopes/models/niw.hpp" namespace "microscopes::models":
+    cdef cppclass niw_model:
+        niw_model(unsigned) except +
+
 cdef extern from "microscopes/models/dm.hpp" namespace "microscopes::models":
     cdef cppclass dm_model:
         dm_model(unsigned) except +
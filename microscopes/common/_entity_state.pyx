@@ -1,6 +1,7 @@
 # cython: embedsignature=True
 
 
+from microscopes.common._random_fwd_h cimport rng_t
 from microscopes.models import model_descriptor
 import numpy as np
 
@@ -13,26 +14,78 @@ cdef class entity_based_state_object:
         self._models = list(models)
 
     # expose enough of the API here
+    #
+    # the calls into C++ which do work proportional to the data (scoring,
+    # adding and removing values, copying assignments) release the GIL, so
+    # independent states can be driven from several python threads. a state
+    # (and the rng passed to it) must still only be used by one thread at a
+    # time
 
     def assignments(self):
-        return list(self._thisptr.get().assignments())
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef vector[ssize_t] ret
+        with nogil:
+            ret = px.assignments()
+        return list(ret)
 
     def nentities(self):
-        return self._thisptr.get().nentities()
+        return self.raw_px().nentities()
 
     def ngroups(self):
-        return self._thisptr.get().ngroups()
+        return self.raw_px().ngroups()
 
     def add_value(self, int gid, int eid, rng r):
-        self._thisptr.get().add_value(gid, eid, r._thisptr[0])
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        with nogil:
+            px.add_value(gid, eid, prng[0])
 
     def remove_value(self, int eid, rng r):
-        return self._thisptr.get().remove_value(eid, r._thisptr[0])
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        cdef size_t gid
+        with nogil:
+            gid = px.remove_value(eid, prng[0])
+        return gid
+
+    def add_values(self, gids, eids, rng r):
+        """Adds each eids[i] to group gids[i], in order, without going
+        back to python in between
+
+        """
+        if len(gids) != len(eids):
+            raise ValueError("gids and eids differ in length")
+        cdef vector[size_t] cgids = gids
+        cdef vector[size_t] ceids = eids
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        cdef size_t i
+        with nogil:
+            for i in range(ceids.size()):
+                px.add_value(cgids[i], ceids[i], prng[0])
+
+    def remove_values(self, eids, rng r):
+        """Removes each of eids, in order, returning the groups they were
+        removed from
+
+        """
+        cdef vector[size_t] ceids = eids
+        cdef vector[size_t] gids
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        cdef size_t i
+        with nogil:
+            gids.reserve(ceids.size())
+            for i in range(ceids.size()):
+                gids.push_back(px.remove_value(ceids[i], prng[0]))
+        return list(gids)
 
     def score_value(self, int eid, rng r):
-        cdef pair[vector[size_t], vector[float]] ret = (
-            self._thisptr.get().score_value(eid, r._thisptr[0])
-        )
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        cdef pair[vector[size_t], vector[float]] ret
+        with nogil:
+            ret = px.score_value(eid, prng[0])
         return (
             [int(x) for x in ret.first],
             np.array([x for x in ret.second], dtype=np.float)
@@ -45,7 +98,12 @@ cdef class entity_based_state_object:
         return list(self.raw_px().empty_groups())
 
     def create_group(self, rng r):
-        return self.raw_px().create_group(r._thisptr[0])
+        cdef c_entity_based_state_object *px = self.raw_px()
+        cdef rng_t *prng = r._thisptr
+        cdef size_t gid
+        with nogil:
+            gid = px.create_group(prng[0])
+        return gid
 
     def delete_group(self, int gid):
         self.raw_px().delete_group(gid)
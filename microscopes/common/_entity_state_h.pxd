@@ -4,7 +4,7 @@ from libc.stddef cimport size_t
 
 from microscopes.common._random_fwd_h cimport rng_t
 
-cdef extern from "microscopes/common/entity_state.hpp" namespace "microscopes::common":
+cdef extern from "microscopes/common/entity_state.hpp" namespace "microscopes::common" nogil:
     # expose enough of the API here
     cdef cppclass entity_based_state_object:
         vector[ssize_t] assignments() except +
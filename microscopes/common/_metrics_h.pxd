@@ -0,0 +1,13 @@
+from libcpp.map cimport map
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+from libc.stdint cimport uint64_t
+
+cdef extern from "microscopes/common/metrics.hpp" namespace "microscopes::common::metrics":
+    cdef cppclass report:
+        map[string, uint64_t] counters_
+        map[string, vector[uint64_t]] histograms_
+
+    bint enabled()
+    report aggregate() except +
+    void reset() except +
@@ -0,0 +1,15 @@
+from libcpp.vector cimport vector
+from libc.stddef cimport size_t
+
+cdef extern from "microscopes/common/partition.hpp" namespace "microscopes::common::partition" nogil:
+    cdef cppclass groups_t:
+        vector[size_t] offsets_
+        vector[size_t] members_
+
+    vector[ssize_t] canonical(const vector[ssize_t] &) except +
+    groups_t groups(const vector[ssize_t] &) except +
+    vector[size_t] size_histogram(const vector[ssize_t] &) except +
+    double adjusted_rand_index(const vector[ssize_t] &,
+                               const vector[ssize_t] &) except +
+    double variation_of_information(const vector[ssize_t] &,
+                                    const vector[ssize_t] &) except +
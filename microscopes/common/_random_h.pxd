@@ -2,7 +2,7 @@ from libcpp.utility cimport pair
 from microscopes._eigen_h cimport VectorXf, MatrixXf
 from microscopes.common._random_fwd_h cimport rng_t
 
-cdef extern from "microscopes/common/random.hpp" namespace "microscopes::common::random":
+cdef extern from "microscopes/common/random.hpp" namespace "microscopes::common::random" nogil:
     VectorXf sample_multivariate_normal(const VectorXf &, const MatrixXf &, rng_t &) except +
     MatrixXf sample_wishart(float, const MatrixXf &, rng_t &) except +
     MatrixXf sample_inverse_wishart(float, const MatrixXf &, rng_t &) except +
@@ -0,0 +1,25 @@
+from libcpp.vector cimport vector
+from libc.stdint cimport uint32_t
+from libc.stddef cimport size_t
+
+cdef extern from "microscopes/common/zmatrix.hpp" namespace "microscopes::common" nogil:
+    cdef cppclass dense_zmatrix:
+        dense_zmatrix(size_t, unsigned) except +
+        size_t n()
+        size_t nsamples()
+        void add(const vector[ssize_t] &) except +
+        uint32_t count(size_t, size_t) except +
+        void copy_to(float *) except +
+        void top_k(size_t, ssize_t *, float *) except +
+
+    cdef cppclass sparse_zmatrix:
+        sparse_zmatrix(size_t, unsigned) except +
+        size_t n()
+        size_t nsamples()
+        void add(const vector[ssize_t] &) except +
+        uint32_t count(size_t, size_t) except +
+        void thresholded(float,
+                         vector[size_t] &,
+                         vector[uint32_t] &,
+                         vector[float] &) except +
+        void top_k(size_t, ssize_t *, float *) except +
@@ -0,0 +1,39 @@
+# cython: embedsignature=True
+
+
+from microscopes.common._metrics_h cimport (
+    report,
+    enabled as c_enabled,
+    aggregate as c_aggregate,
+    reset as c_reset,
+)
+
+
+def enabled():
+    """Returns True if the library was built with MICROSCOPES_METRICS;
+    otherwise the metrics are always zero.
+
+    """
+    return c_enabled()
+
+
+def aggregate():
+    """Returns the metrics summed over all threads, as a dict with keys
+
+      counters: {name: count}
+      histograms: {name: [count] * 65}
+
+    Histogram bucket 0 counts zeros, and bucket i > 0 counts values in
+    [2^(i-1), 2^i).
+
+    """
+    cdef report r = c_aggregate()
+    return {
+        'counters': dict(r.counters_),
+        'histograms': {k: list(v) for k, v in dict(r.histograms_).items()},
+    }
+
+
+def reset():
+    """Zeros all metrics"""
+    c_reset()
@@ -0,0 +1,4 @@
+from libcpp.vector cimport vector
+
+# converts avec, any 1-d sequence of ints, into out
+cdef void to_assignment(avec, vector[ssize_t] &out) except *
@@ -0,0 +1,115 @@
+# cython: embedsignature=True
+
+
+from libc.stdint cimport int64_t
+from libc.stddef cimport size_t
+from microscopes.common._partition_h cimport (
+    groups_t,
+    canonical as c_canonical,
+    groups as c_groups,
+    size_histogram as c_size_histogram,
+    adjusted_rand_index as c_adjusted_rand_index,
+    variation_of_information as c_variation_of_information,
+)
+
+cimport numpy as np
+
+import numpy as np
+
+
+cdef void to_assignment(avec, vector[ssize_t] &out) except *:
+    cdef np.ndarray a = np.ascontiguousarray(avec, dtype=np.int64)
+    if a.ndim != 1:
+        raise ValueError("expected a 1-d assignment vector")
+    cdef const int64_t *px = <const int64_t *> a.data
+    cdef size_t i, n = a.shape[0]
+    out.resize(n)
+    for i in xrange(n):
+        out[i] = px[i]
+
+
+cdef np.ndarray _to_ndarray(const vector[size_t] &v):
+    cdef np.ndarray ret = np.empty(v.size(), dtype=np.intp)
+    cdef ssize_t *px = <ssize_t *> ret.data
+    cdef size_t i
+    for i in xrange(v.size()):
+        px[i] = v[i]
+    return ret
+
+
+def canonical(avec):
+    """Relabels the groups of avec 0, 1, ... in order of their first entity
+
+    Two assignment vectors describe the same clustering iff their canonical
+    labelings are equal.
+
+    """
+    cdef vector[ssize_t] a, labels
+    to_assignment(avec, a)
+    with nogil:
+        labels = c_canonical(a)
+    cdef np.ndarray ret = np.empty(labels.size(), dtype=np.intp)
+    cdef ssize_t *px = <ssize_t *> ret.data
+    cdef size_t i
+    for i in xrange(labels.size()):
+        px[i] = labels[i]
+    return ret
+
+
+def groups(avec):
+    """Returns the groups of avec as (offsets, members): the entities of
+    group g, a canonical label, are ``members[offsets[g]:offsets[g+1]]``, in
+    increasing order
+
+    """
+    cdef vector[ssize_t] a
+    to_assignment(avec, a)
+    cdef groups_t g
+    with nogil:
+        g = c_groups(a)
+    return _to_ndarray(g.offsets_), _to_ndarray(g.members_)
+
+
+def size_histogram(avec):
+    """Returns h, where h[s] is the # of groups of avec with s entities, up
+    to the largest group
+
+    """
+    cdef vector[ssize_t] a
+    to_assignment(avec, a)
+    cdef vector[size_t] hist
+    with nogil:
+        hist = c_size_histogram(a)
+    return _to_ndarray(hist)
+
+
+def adjusted_rand_index(avec1, avec2):
+    """The adjusted Rand index between two clusterings of the same entities:
+    1 if they are equal, 0 in expectation if they are independent
+
+    """
+    cdef vector[ssize_t] a, b
+    to_assignment(avec1, a)
+    to_assignment(avec2, b)
+    if a.size() != b.size():
+        raise ValueError("assignment vectors should all be same size")
+    cdef double ret
+    with nogil:
+        ret = c_adjusted_rand_index(a, b)
+    return ret
+
+
+def variation_of_information(avec1, avec2):
+    """The variation of information (in nats) between two clusterings of the
+    same entities: 0 if they are equal, at most log(N)
+
+    """
+    cdef vector[ssize_t] a, b
+    to_assignment(avec1, a)
+    to_assignment(avec2, b)
+    if a.size() != b.size():
+        raise ValueError("assignment vectors should all be same size")
+    cdef double ret
+    with nogil:
+        ret = c_variation_of_information(a, b)
+    return ret
@@ -6,7 +6,9 @@ Note you should generally be calling the model-specific query interfaces.
 
 import scipy.cluster
 import numpy as np
-import itertools as it
+
+from microscopes.common import partition
+from microscopes.common.zmatrix import dense_zmatrix, sparse_zmatrix
 
 # Terminology used in this module:
 # avec: a single assignment vector
@@ -26,37 +28,85 @@ def groups(avec, sort=False):
     Returns
     -------
     clustering : a list of lists
-        Note that ``len(clustering) == len(np.unique(avec))``
+        Note that ``len(clustering) == len(np.unique(avec))``. Unless sorted,
+        the clusters are in order of their first entity.
 
     """
-    cluster_map = {}
-    for idx, gid in enumerate(avec):
-        lst = cluster_map.get(gid, [])
-        lst.append(idx)
-        cluster_map[gid] = lst
+    offsets, members = partition.groups(avec)
+    clustering = [members[offsets[g]:offsets[g + 1]].tolist()
+                  for g in xrange(len(offsets) - 1)]
     if sort:
-        return list(sorted(cluster_map.values(), key=len, reverse=True))
+        return list(sorted(clustering, key=len, reverse=True))
     else:
-        return list(cluster_map.values())
+        return clustering
 
 
-def zmatrix(assignments):
+def _validate_assignments(assignments):
     if not len(assignments):
         raise ValueError("empty assignments list")
     if len(set(map(len, assignments))) != 1:
         raise ValueError("assignment vectors should all be same size")
 
-    # XXX(stephentu): should support sparse z-matrices for large n
 
-    n = len(assignments[0])
-    zmat = np.zeros((n, n), dtype=np.float32)
+def zmatrix(assignments, nthreads=0):
+    """Compute the z-matrix (co-assignment matrix) of a list of assignment
+    vectors
+
+    Parameters
+    ----------
+    assignments : list of avecs, all over the same N entities
+    nthreads : int, default 0
+        The # of threads to use; 0 means use the # of cores
+
+    Returns
+    -------
+    zmat : (N, N) float32 ndarray
+        ``zmat[i, j]`` is the fraction of the assignment vectors in which
+        entities `i` and `j` are in the same group
+
+    """
+    _validate_assignments(assignments)
+    z = dense_zmatrix(len(assignments[0]), nthreads)
     for avec in assignments:
-        clusters = groups(avec)
-        for cluster in clusters:
-            for i, j in it.product(cluster, repeat=2):
-                zmat[i, j] += 1
-    zmat /= float(len(assignments))
-    return zmat
+        z.add(avec)
+    return z.todense()
+
+
+def zmatrix_sparse(assignments, threshold=0., nthreads=0):
+    """Compute the entries of the z-matrix which are at least `threshold`,
+    without materializing the rest of it (its memory use is linear in N, for
+    a given # of assignment vectors, plus the # of entries kept)
+
+    Returns
+    -------
+    zmat : (N, N) float32 scipy.sparse.csr_matrix
+
+    """
+    _validate_assignments(assignments)
+    z = sparse_zmatrix(len(assignments[0]), nthreads)
+    for avec in assignments:
+        z.add(avec)
+    return z.thresholded(threshold)
+
+
+def zmatrix_top_k(assignments, k, nthreads=0):
+    """Find each entity's `k` nearest neighbors by z-matrix entry, without
+    materializing the z-matrix
+
+    Returns
+    -------
+    neighbors : (N, k) ndarray
+        Row `i` holds the (at most) `k` other entities with the largest
+        nonzero ``zmat[i, j]``, in decreasing order, padded with -1
+    scores : (N, k) float32 ndarray
+        The corresponding z-matrix entries (0 for padding)
+
+    """
+    _validate_assignments(assignments)
+    z = sparse_zmatrix(len(assignments[0]), nthreads)
+    for avec in assignments:
+        z.add(avec)
+    return z.top_k(k)
 
 
 def _is_square_ndarray(n):
@@ -8,6 +8,7 @@ from microscopes.common._random_h cimport \
     sample_inverse_wishart as c_sample_inverse_wishart, \
     sample_normal_inverse_wishart as c_sample_normal_inverse_wishart
 from microscopes.common._rng cimport rng
+from microscopes.common._random_fwd_h cimport rng_t
 from microscopes.common._util_h cimport \
     set as c_eigen_matf_set, \
     get as c_eigen_matf_get
@@ -52,35 +53,39 @@ cdef np.ndarray to_np_2darray(const MatrixXf &x):
 
 
 def sample_multivariate_normal(np.ndarray mu, np.ndarray cov, rng r):
-    cdef VectorXf sample = c_sample_multivariate_normal(
-        to_eigen_vecf(mu),
-        to_eigen_matf(cov),
-        r._thisptr[0])
+    cdef VectorXf cmu = to_eigen_vecf(mu)
+    cdef MatrixXf ccov = to_eigen_matf(cov)
+    cdef rng_t *prng = r._thisptr
+    cdef VectorXf sample
+    with nogil:
+        sample = c_sample_multivariate_normal(cmu, ccov, prng[0])
     return to_np_1darray(sample)
 
 
 def sample_wishart(float nu, np.ndarray scale, rng r):
-    cdef MatrixXf sample = c_sample_wishart(
-        nu,
-        to_eigen_matf(scale),
-        r._thisptr[0])
+    cdef MatrixXf cscale = to_eigen_matf(scale)
+    cdef rng_t *prng = r._thisptr
+    cdef MatrixXf sample
+    with nogil:
+        sample = c_sample_wishart(nu, cscale, prng[0])
     return to_np_2darray(sample)
 
 
 def sample_inverse_wishart(float nu, np.ndarray scale, rng r):
-    cdef MatrixXf sample = c_sample_inverse_wishart(
-        nu,
-        to_eigen_matf(scale),
-        r._thisptr[0])
+    cdef MatrixXf cscale = to_eigen_matf(scale)
+    cdef rng_t *prng = r._thisptr
+    cdef MatrixXf sample
+    with nogil:
+        sample = c_sample_inverse_wishart(nu, cscale, prng[0])
     return to_np_2darray(sample)
 
 
 def sample_normal_inverse_wishart(
         np.ndarray mu0, float lam, np.ndarray psi, float nu, rng r):
-    cdef pair[VectorXf, MatrixXf] sample = c_sample_normal_inverse_wishart(
-        to_eigen_vecf(mu0),
-        lam,
-        to_eigen_matf(psi),
-        nu,
-        r._thisptr[0])
+    cdef VectorXf cmu0 = to_eigen_vecf(mu0)
+    cdef MatrixXf cpsi = to_eigen_matf(psi)
+    cdef rng_t *prng = r._thisptr
+    cdef pair[VectorXf, MatrixXf] sample
+    with nogil:
+        sample = c_sample_normal_inverse_wishart(cmu0, lam, cpsi, nu, prng[0])
     return to_np_1darray(sample.first), to_np_2darray(sample.second)
@@ -11,6 +11,7 @@ from microscopes.common.recarray._dataview_h cimport (
     row_mutator,
 )
 from microscopes.common._rng cimport rng
+from microscopes.common._random_fwd_h cimport rng_t
 cimport microscopes.common._type_info_h as ti
 from microscopes.common._runtime_type_h cimport runtime_type
 
@@ -77,23 +77,78 @@ cdef class numpy_dataview(abstract_dataview):
             self._mask = None
 
         cdef vector[runtime_type] ctypes = get_c_types(dtype)
-
-        if self._mask is not None:
-            self._thisptr.reset(new row_major_dataview(
-                <uint8_t *> self._data.data,
-                <cbool *> self._mask.data,
-                self._n,
-                ctypes))
-        else:
-            self._thisptr.reset(new row_major_dataview(
-                <uint8_t *> self._data.data,
-                NULL,
-                self._n,
-                ctypes))
+        cdef uint8_t *data = <uint8_t *> self._data.data
+        cdef cbool *mask = \
+            <cbool *> self._mask.data if self._mask is not None else NULL
+        cdef size_t n = self._n
+        cdef row_major_dataview *px
+        with nogil:
+            px = new row_major_dataview(data, mask, n, ctypes)
+        self._thisptr.reset(px)
 
     def size(self):
         return self._n
 
+    def permute(self, rng r):
+        """Iterate (and export rows) in a random order from now on"""
+        validator.validate_not_none(r, "r")
+        cdef row_major_dataview *px = \
+            <row_major_dataview *> self._thisptr.get()
+        cdef rng_t *prng = r._thisptr
+        with nogil:
+            px.permute(prng[0])
+
+    def permute_blocked(self, rng r, size_t block_rows=0):
+        """Like permute(), but visiting the rows a block of block_rows
+        consecutive rows at a time (blocks and the rows within each block in a
+        random order), which is much more cache friendly on large views.
+        block_rows=0 picks blocks of about 64KB of row data.
+
+        """
+        validator.validate_not_none(r, "r")
+        cdef row_major_dataview *px = \
+            <row_major_dataview *> self._thisptr.get()
+        cdef rng_t *prng = r._thisptr
+        with nogil:
+            px.permute_blocked(prng[0], block_rows)
+
+    def reset_permutation(self):
+        (<row_major_dataview *> self._thisptr.get()).reset_permutation()
+
+    def rows(self, begin=0, end=None, copy=True):
+        """Rows [begin, end) of the iteration order, as one structured
+        (masked, if the dataview is) array, in a single call rather than one
+        per row.
+
+        If the view is not permuted and copy is False, the result is a view
+        of the underlying array, rather than a copy.
+
+        """
+        if end is None:
+            end = self._n
+        if not (0 <= begin <= end <= self._n):
+            raise ValueError("invalid range [{}, {})".format(begin, end))
+        cdef row_major_dataview *px = \
+            <row_major_dataview *> self._thisptr.get()
+
+        if not copy and not px.permuted():
+            if self._mask is None:
+                return self._data[begin:end]
+            return ma.array(self._data[begin:end], mask=self._mask[begin:end])
+
+        cdef np.ndarray data = np.empty(end - begin, dtype=self._data.dtype)
+        cdef np.ndarray mask = None
+        if self._mask is not None:
+            mask = np.empty(end - begin, dtype=self._mask.dtype)
+        cdef size_t cbegin = begin, cend = end
+        cdef uint8_t *pdata = <uint8_t *> data.data
+        cdef cbool *pmask = <cbool *> mask.data if mask is not None else NULL
+        with nogil:
+            px.copy_rows(cbegin, cend, pdata, pmask)
+        if mask is None:
+            return data
+        return ma.array(data, mask=mask)
+
     def __len__(self):
         return self.size()
 
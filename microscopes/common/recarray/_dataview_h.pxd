@@ -4,8 +4,9 @@ from libc.stdint cimport uint8_t
 from libc.stddef cimport size_t
 
 from microscopes.common._runtime_type_h cimport runtime_type
+from microscopes.common._random_fwd_h cimport rng_t
 
-cdef extern from "microscopes/common/recarray/dataview.hpp" namespace "microscopes::common::recarray":
+cdef extern from "microscopes/common/recarray/dataview.hpp" namespace "microscopes::common::recarray" nogil:
     cdef cppclass row_accessor:
         row_accessor()
         row_accessor(uint8_t *, cbool *, vector[runtime_type] *)
@@ -29,3 +30,8 @@ cdef extern from "microscopes/common/recarray/dataview.hpp" namespace "microscop
 
     cdef cppclass row_major_dataview(dataview):
         row_major_dataview(uint8_t *, cbool *, size_t, vector[runtime_type] &) except +
+        void reset_permutation()
+        void permute(rng_t &) except +
+        void permute_blocked(rng_t &, size_t) except +
+        cbool permuted()
+        void copy_rows(size_t, size_t, uint8_t *, cbool *) except +
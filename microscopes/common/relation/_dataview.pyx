@@ -44,11 +44,13 @@ cdef class numpy_dataview(abstract_dataview):
         else:
             self._data = np.ascontiguousarray(npd)
             self._mask = None
-        self._thisptr.reset(new row_major_dense_dataview(
-            <uint8_t *> self._data.data,
-            <cbool *> self._mask.data if self._mask is not None else NULL,
-            cshape,
-            ctype))
+        cdef uint8_t *data = <uint8_t *> self._data.data
+        cdef cbool *mask = \
+            <cbool *> self._mask.data if self._mask is not None else NULL
+        cdef row_major_dense_dataview *px
+        with nogil:
+            px = new row_major_dense_dataview(data, mask, cshape, ctype)
+        self._thisptr.reset(px)
 
     def shape(self):
         return self._shape
@@ -108,17 +110,24 @@ cdef class sparse_2d_dataview(abstract_dataview):
             csc_rep.data, csc_rep.indices, csc_rep.indptr
         )
 
-        self._thisptr.reset(
-            new compressed_2darray(
-                <const uint8_t *> self._csr_data.data,
-                <const uint32_t *> self._csr_indices.data,
-                <const uint32_t *> self._csr_indptr.data,
-                <const uint8_t *> self._csc_data.data,
-                <const uint32_t *> self._csc_indices.data,
-                <const uint32_t *> self._csc_indptr.data,
-                self._rows,
-                self._cols,
-                ctype))
+        cdef const uint8_t *csr_data = <const uint8_t *> self._csr_data.data
+        cdef const uint32_t *csr_indices = \
+            <const uint32_t *> self._csr_indices.data
+        cdef const uint32_t *csr_indptr = \
+            <const uint32_t *> self._csr_indptr.data
+        cdef const uint8_t *csc_data = <const uint8_t *> self._csc_data.data
+        cdef const uint32_t *csc_indices = \
+            <const uint32_t *> self._csc_indices.data
+        cdef const uint32_t *csc_indptr = \
+            <const uint32_t *> self._csc_indptr.data
+        cdef size_t rows = self._rows, cols = self._cols
+        cdef compressed_2darray *px
+        with nogil:
+            px = new compressed_2darray(
+                csr_data, csr_indices, csr_indptr,
+                csc_data, csc_indices, csc_indptr,
+                rows, cols, ctype)
+        self._thisptr.reset(px)
 
     def shape(self):
         return (self._rows, self._cols)
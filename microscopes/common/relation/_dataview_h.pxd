@@ -5,7 +5,7 @@ from libc.stddef cimport size_t
 
 from microscopes.common._runtime_type_h cimport runtime_type
 
-cdef extern from "microscopes/common/relation/dataview.hpp" namespace "microscopes::common::relation":
+cdef extern from "microscopes/common/relation/dataview.hpp" namespace "microscopes::common::relation" nogil:
     cdef cppclass dataview:
         pass
 
@@ -41,7 +41,10 @@ cdef class numpy_dataview(abstract_dataview):
 
         cdef runtime_type ctype = get_c_type(dtype)
 
-        self._thisptr.reset(new row_major_dataview(pxs, ns, ctype))
+        cdef row_major_dataview *px
+        with nogil:
+            px = new row_major_dataview(pxs, ns, ctype)
+        self._thisptr.reset(px)
 
     def size(self):
         return len(self._data)
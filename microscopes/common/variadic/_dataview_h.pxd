@@ -5,7 +5,7 @@ from libc.stddef cimport size_t
 from microscopes.common._runtime_type_h cimport runtime_type
 
 
-cdef extern from "microscopes/common/variadic/dataview.hpp" namespace "microscopes::common::variadic":
+cdef extern from "microscopes/common/variadic/dataview.hpp" namespace "microscopes::common::variadic" nogil:
 
     cdef cppclass row_accessor:
         pass
@@ -0,0 +1,155 @@
+# cython: embedsignature=True
+
+
+from libcpp.vector cimport vector
+from libc.stdint cimport int64_t, uint32_t
+from libc.stddef cimport size_t
+from microscopes.common.partition cimport to_assignment
+from microscopes.common._zmatrix_h cimport (
+    dense_zmatrix as c_dense_zmatrix,
+    sparse_zmatrix as c_sparse_zmatrix,
+)
+
+cimport numpy as np
+
+import numpy as np
+from scipy.sparse import csr_matrix
+
+
+cdef void _to_assignment(avec, size_t n, vector[ssize_t] &out) except *:
+    to_assignment(avec, out)
+    if out.size() != n:
+        raise ValueError(
+            "expected an assignment vector of length {}".format(n))
+
+
+cdef class dense_zmatrix:
+    """Accumulates the co-assignment counts of assignment vectors over n
+    entities into a dense n x n matrix.
+
+    """
+
+    cdef c_dense_zmatrix *_thisptr
+
+    def __cinit__(self, size_t n, unsigned nthreads=0):
+        self._thisptr = new c_dense_zmatrix(n, nthreads)
+
+    def __dealloc__(self):
+        del self._thisptr
+
+    def n(self):
+        return self._thisptr.n()
+
+    def nsamples(self):
+        return self._thisptr.nsamples()
+
+    def add(self, avec):
+        cdef vector[ssize_t] a
+        _to_assignment(avec, self._thisptr.n(), a)
+        cdef c_dense_zmatrix *px = self._thisptr
+        with nogil:
+            px.add(a)
+
+    def count(self, size_t i, size_t j):
+        if i >= self._thisptr.n() or j >= self._thisptr.n():
+            raise IndexError("invalid entity")
+        return self._thisptr.count(i, j)
+
+    def todense(self):
+        """Returns the (n, n) float32 z-matrix"""
+        if not self._thisptr.nsamples():
+            raise ValueError("no assignment vectors added")
+        cdef size_t n = self._thisptr.n()
+        cdef np.ndarray z = np.empty((n, n), dtype=np.float32)
+        cdef float *out = <float *> z.data
+        cdef c_dense_zmatrix *px = self._thisptr
+        with nogil:
+            px.copy_to(out)
+        return z
+
+    def top_k(self, size_t k):
+        """See sparse_zmatrix.top_k()"""
+        cdef size_t n = self._thisptr.n()
+        cdef np.ndarray neighbors = np.empty((n, k), dtype=np.intp)
+        cdef np.ndarray scores = np.empty((n, k), dtype=np.float32)
+        cdef ssize_t *pn = <ssize_t *> neighbors.data
+        cdef float *ps = <float *> scores.data
+        cdef c_dense_zmatrix *px = self._thisptr
+        with nogil:
+            px.top_k(k, pn, ps)
+        return neighbors, scores
+
+
+cdef class sparse_zmatrix:
+    """Keeps assignment vectors over n entities, computing z-matrix entries
+    on demand, in memory linear in n.
+
+    """
+
+    cdef c_sparse_zmatrix *_thisptr
+
+    def __cinit__(self, size_t n, unsigned nthreads=0):
+        self._thisptr = new c_sparse_zmatrix(n, nthreads)
+
+    def __dealloc__(self):
+        del self._thisptr
+
+    def n(self):
+        return self._thisptr.n()
+
+    def nsamples(self):
+        return self._thisptr.nsamples()
+
+    def add(self, avec):
+        cdef vector[ssize_t] a
+        _to_assignment(avec, self._thisptr.n(), a)
+        cdef c_sparse_zmatrix *px = self._thisptr
+        with nogil:
+            px.add(a)
+
+    def count(self, size_t i, size_t j):
+        if i >= self._thisptr.n() or j >= self._thisptr.n():
+            raise IndexError("invalid entity")
+        return self._thisptr.count(i, j)
+
+    def thresholded(self, float threshold=0.):
+        """Returns the entries of the z-matrix which are >= threshold (and
+        nonzero), as an (n, n) float32 scipy.sparse.csr_matrix
+
+        """
+        cdef vector[size_t] indptr
+        cdef vector[uint32_t] indices
+        cdef vector[float] data
+        cdef c_sparse_zmatrix *px = self._thisptr
+        with nogil:
+            px.thresholded(threshold, indptr, indices, data)
+
+        cdef size_t n = px.n(), nnz = indices.size(), i
+        cdef np.ndarray np_indptr = np.empty(n + 1, dtype=np.int64)
+        cdef np.ndarray np_indices = np.empty(nnz, dtype=np.int64)
+        cdef np.ndarray np_data = np.empty(nnz, dtype=np.float32)
+        cdef int64_t *pindptr = <int64_t *> np_indptr.data
+        cdef int64_t *pindices = <int64_t *> np_indices.data
+        cdef float *pdata = <float *> np_data.data
+        for i in xrange(n + 1):
+            pindptr[i] = indptr[i]
+        for i in xrange(nnz):
+            pindices[i] = indices[i]
+            pdata[i] = data[i]
+        return csr_matrix((np_data, np_indices, np_indptr), shape=(n, n))
+
+    def top_k(self, size_t k):
+        """Returns (neighbors, scores), both (n, k): row i holds the (at most)
+        k other entities j with the largest nonzero z[i, j], by decreasing z,
+        padded with -1 (and a score of 0)
+
+        """
+        cdef size_t n = self._thisptr.n()
+        cdef np.ndarray neighbors = np.empty((n, k), dtype=np.intp)
+        cdef np.ndarray scores = np.empty((n, k), dtype=np.float32)
+        cdef ssize_t *pn = <ssize_t *> neighbors.data
+        cdef float *ps = <float *> scores.data
+        cdef c_sparse_zmatrix *px = self._thisptr
+        with nogil:
+            px.top_k(k, pn, ps)
+        return neighbors, scores
@@ -23,6 +23,8 @@ CYTHON_MODULES = ['microscopes.models',
                   'microscopes._models',
                   'microscopes.common._dataview',
                   'microscopes.common._entity_state',
+                  'microscopes.common.metrics',
+                  'microscopes.common.partition',
                   'microscopes.common.recarray.dataview',
                   'microscopes.common.recarray._dataview',
                   'microscopes.common.relation.dataview',
@@ -34,6 +36,7 @@ CYTHON_MODULES = ['microscopes.models',
                   'microscopes.common._scalar_functions',
                   'microscopes.common.variadic.dataview',
                   'microscopes.common.variadic._dataview',
+                  'microscopes.common.zmatrix',
                   ]
 
 LIBRARY_DEPENDENCIES = ["microscopes_common", "protobuf",
@@ -116,6 +119,10 @@ def is_debug_build():
     return 'DEBUG' in os.environ
 
 
+def is_metrics_build():
+    return 'MICROSCOPES_METRICS' in os.environ
+
+
 def is_clang():
     return sys.platform.lower().startswith('darwin')
 
@@ -208,6 +215,8 @@ def build_extra_compile_args():
         ])
     if is_debug_build():
         extra_compile_args.append('-DDEBUG_MODE')
+    if is_metrics_build():
+        extra_compile_args.append('-DMICROSCOPES_METRICS')
 
     return extra_compile_args
 
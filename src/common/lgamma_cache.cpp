@@ -0,0 +1,125 @@
+#include <microscopes/common/lgamma_cache.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace microscopes::common;
+
+const unsigned lgamma_cache::MaxSize;
+const size_t lgamma_cache::MaxTables;
+const size_t lgamma_cache::MaxEntries;
+
+lgamma_shifted_table::lgamma_shifted_table(
+    const float *alphas, size_t k, unsigned size)
+  : alphas_(alphas, alphas + k), alpha_sum_(), size_(size),
+    slots_(new atomic<uintptr_t>[k + 1])
+{
+  double alpha_sum = 0.;
+  for (auto a : alphas_)
+    alpha_sum += a;
+  alpha_sum_ = alpha_sum;
+  for (size_t i = 0; i <= k; i++)
+    slots_[i].store(1, memory_order_relaxed);
+}
+
+lgamma_shifted_table::~lgamma_shifted_table()
+{
+  for (size_t i = 0; i <= alphas_.size(); i++) {
+    const uintptr_t v = slots_[i].load(memory_order_relaxed);
+    if (!(v & 1))
+      delete [] reinterpret_cast<float *>(v);
+  }
+}
+
+float
+lgamma_shifted_table::miss(size_t slot, float alpha, unsigned n) const
+{
+  auto &s = slots_[slot];
+  uintptr_t v = s.load(memory_order_relaxed);
+  while (v & 1) {
+    const uintptr_t lookups = (v >> 1) + 1;
+    if (lookups > size_)
+      // someone else is building the row
+      break;
+    if (!s.compare_exchange_weak(v, v + 2, memory_order_relaxed))
+      continue;
+    if (lookups < size_)
+      break;
+    // we took the last lookup before the row pays off, so build it; nobody
+    // else touches the slot from now on
+    float *row = new float[size_];
+    for (unsigned m = 0; m < size_; m++)
+      row[m] = distributions::fast_lgamma(float(m) + alpha);
+    s.store(reinterpret_cast<uintptr_t>(row), memory_order_release);
+    return row[n];
+  }
+  if (!(v & 1))
+    return reinterpret_cast<const float *>(v)[n];
+  return distributions::fast_lgamma(float(n) + alpha);
+}
+
+void
+lgamma_cache::invalidate()
+{
+  lock_guard<mutex> lock(mutex_);
+  current_.store(nullptr, memory_order_release);
+  retired_.clear();
+}
+
+void
+lgamma_cache::clear()
+{
+  lock_guard<mutex> lock(mutex_);
+  current_.store(nullptr, memory_order_release);
+  tables_.clear();
+  retired_.clear();
+}
+
+void
+lgamma_cache::retire(size_t i) const
+{
+  retired_.emplace_back(move(tables_[i]));
+  tables_.erase(tables_.begin() + i);
+}
+
+const lgamma_shifted_table *
+lgamma_cache::rebuild(const float *alphas, size_t k, unsigned n) const
+{
+  lock_guard<mutex> lock(mutex_);
+
+  // someone else may have beaten us to it
+  const unsigned limit = max_size(k);
+  const unsigned wanted = min(n, limit);
+  const lgamma_shifted_table *t = current_.load(memory_order_relaxed);
+  if (t && t->size_ >= wanted)
+    return t;
+
+  // a table for these alphas, which becomes the most recently used
+  size_t i = 0;
+  while (i < tables_.size() && !tables_[i]->matches(alphas, k))
+    i++;
+  unsigned size = 1;
+  if (i < tables_.size()) {
+    if (tables_[i]->size_ >= wanted) {
+      rotate(tables_.begin() + i, tables_.begin() + i + 1, tables_.end());
+      t = tables_.back().get();
+      current_.store(t, memory_order_release);
+      return t;
+    }
+    // superseded by a larger one
+    size = 2 * tables_[i]->size_;
+    retire(i);
+  }
+
+  while (size < n && size < limit)
+    size *= 2;
+  size = min(size, limit);
+
+  if (tables_.size() >= MaxTables)
+    retire(0);
+  tables_.emplace_back(new lgamma_shifted_table(alphas, k, size));
+  t = tables_.back().get();
+  current_.store(t, memory_order_release);
+  return t;
+}
@@ -0,0 +1,116 @@
+#include <microscopes/common/metrics.hpp>
+
+#include <mutex>
+#include <set>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::common::metrics;
+
+namespace {
+
+const char *CounterNames[] = {
+#define MICROSCOPES_METRICS_NAME(e, name) name,
+  MICROSCOPES_METRICS_FOR_EACH_COUNTER(MICROSCOPES_METRICS_NAME)
+#undef MICROSCOPES_METRICS_NAME
+};
+
+const char *HistogramNames[] = {
+#define MICROSCOPES_METRICS_NAME(e, name) name,
+  MICROSCOPES_METRICS_FOR_EACH_HISTOGRAM(MICROSCOPES_METRICS_NAME)
+#undef MICROSCOPES_METRICS_NAME
+};
+
+// the live threads' metrics, and the totals of threads which have exited
+struct registry {
+  mutex mutex_;
+  set<detail::thread_metrics *> live_;
+  uint64_t retired_counters_[NCOUNTERS];
+  uint64_t retired_histograms_[NHISTOGRAMS][NBuckets];
+};
+
+// never destroyed, since threads may exit after static destructors run
+registry &
+global()
+{
+  static registry *r = new registry();
+  return *r;
+}
+
+} // namespace
+
+detail::thread_metrics::thread_metrics()
+{
+  for (auto &c : counters_)
+    c.store(0, memory_order_relaxed);
+  for (auto &h : histograms_)
+    for (auto &b : h)
+      b.store(0, memory_order_relaxed);
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  r.live_.insert(this);
+}
+
+detail::thread_metrics::~thread_metrics()
+{
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  for (size_t i = 0; i < NCOUNTERS; i++)
+    r.retired_counters_[i] += counters_[i].load(memory_order_relaxed);
+  for (size_t i = 0; i < NHISTOGRAMS; i++)
+    for (size_t j = 0; j < NBuckets; j++)
+      r.retired_histograms_[i][j] += histograms_[i][j].load(memory_order_relaxed);
+  r.live_.erase(this);
+}
+
+bool
+microscopes::common::metrics::enabled()
+{
+#ifdef MICROSCOPES_METRICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+report
+microscopes::common::metrics::aggregate()
+{
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  report ret;
+  for (size_t i = 0; i < NCOUNTERS; i++) {
+    uint64_t sum = r.retired_counters_[i];
+    for (auto m : r.live_)
+      sum += m->counters_[i].load(memory_order_relaxed);
+    ret.counters_[CounterNames[i]] = sum;
+  }
+  for (size_t i = 0; i < NHISTOGRAMS; i++) {
+    vector<uint64_t> buckets(
+        r.retired_histograms_[i], r.retired_histograms_[i] + NBuckets);
+    for (auto m : r.live_)
+      for (size_t j = 0; j < NBuckets; j++)
+        buckets[j] += m->histograms_[i][j].load(memory_order_relaxed);
+    ret.histograms_[HistogramNames[i]] = buckets;
+  }
+  return ret;
+}
+
+void
+microscopes::common::metrics::reset()
+{
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  for (auto &c : r.retired_counters_)
+    c = 0;
+  for (auto &h : r.retired_histograms_)
+    for (auto &b : h)
+      b = 0;
+  for (auto m : r.live_) {
+    for (auto &c : m->counters_)
+      c.store(0, memory_order_relaxed);
+    for (auto &h : m->histograms_)
+      for (auto &b : h)
+        b.store(0, memory_order_relaxed);
+  }
+}
@@ -0,0 +1,181 @@
+#include <microscopes/common/partition.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+using namespace std;
+using namespace microscopes::common;
+
+template <typename T>
+static size_t
+relabel_into(const vector<ssize_t> &assignment, T *out)
+{
+  const size_t n = assignment.size();
+  MICROSCOPES_CHECK(n <= numeric_limits<uint32_t>::max(), "too many entities");
+  uint32_t ngroups = 0;
+
+  // the common case: group ids which are already in [0, n)
+  const bool small = all_of(assignment.begin(), assignment.end(),
+      [n](ssize_t g) { return g >= 0 && size_t(g) < n; });
+  if (small) {
+    vector<uint32_t> ids(n, numeric_limits<uint32_t>::max());
+    for (size_t i = 0; i < n; i++) {
+      uint32_t &id = ids[assignment[i]];
+      if (id == numeric_limits<uint32_t>::max())
+        id = ngroups++;
+      out[i] = id;
+    }
+    return ngroups;
+  }
+
+  unordered_map<ssize_t, uint32_t> ids;
+  for (size_t i = 0; i < n; i++) {
+    const auto p = ids.emplace(assignment[i], ngroups);
+    if (p.second)
+      ngroups++;
+    out[i] = p.first->second;
+  }
+  return ngroups;
+}
+
+size_t
+partition::relabel(const vector<ssize_t> &assignment, uint32_t *out)
+{
+  return relabel_into(assignment, out);
+}
+
+vector<ssize_t>
+partition::canonical(const vector<ssize_t> &assignment)
+{
+  vector<ssize_t> ret(assignment.size());
+  relabel_into(assignment, ret.data());
+  return ret;
+}
+
+partition::groups_t
+partition::groups(const vector<ssize_t> &assignment)
+{
+  const size_t n = assignment.size();
+  vector<uint32_t> labels(n);
+  const size_t ngroups = relabel(assignment, labels.data());
+
+  // counting sort of the entities by group
+  groups_t ret;
+  ret.offsets_.assign(ngroups + 1, 0);
+  for (auto g : labels)
+    ret.offsets_[g + 1]++;
+  for (size_t g = 0; g < ngroups; g++)
+    ret.offsets_[g + 1] += ret.offsets_[g];
+  vector<size_t> pos(ret.offsets_.begin(), ret.offsets_.end() - 1);
+  ret.members_.resize(n);
+  for (size_t i = 0; i < n; i++)
+    ret.members_[pos[labels[i]]++] = i;
+  return ret;
+}
+
+vector<size_t>
+partition::size_histogram(const vector<ssize_t> &assignment)
+{
+  const size_t n = assignment.size();
+  vector<uint32_t> labels(n);
+  vector<size_t> sizes(relabel(assignment, labels.data()));
+  for (auto g : labels)
+    sizes[g]++;
+  vector<size_t> hist(sizes.empty() ? 1 : *max_element(sizes.begin(), sizes.end()) + 1);
+  for (auto s : sizes)
+    hist[s]++;
+  return hist;
+}
+
+namespace {
+
+struct cell {
+  uint32_t a_, b_;
+  size_t count_;
+};
+
+// the nonzero cells of the contingency table of a and b, and its margins
+struct contingency {
+  contingency(const vector<ssize_t> &a, const vector<ssize_t> &b)
+    : n_(a.size())
+  {
+    MICROSCOPES_CHECK(a.size() == b.size(),
+        "assignment vectors differ in length");
+    vector<uint32_t> la(n_), lb(n_);
+    amargin_.resize(partition::relabel(a, la.data()));
+    bmargin_.resize(partition::relabel(b, lb.data()));
+    for (size_t i = 0; i < n_; i++) {
+      amargin_[la[i]]++;
+      bmargin_[lb[i]]++;
+    }
+
+    // a dense table, unless it would be much larger than the vectors
+    const size_t ka = amargin_.size(), kb = bmargin_.size();
+    if (ka * kb <= 4 * n_) {
+      vector<size_t> table(ka * kb);
+      for (size_t i = 0; i < n_; i++)
+        table[la[i] * kb + lb[i]]++;
+      for (size_t x = 0; x < table.size(); x++)
+        if (table[x])
+          cells_.push_back(cell{uint32_t(x / kb), uint32_t(x % kb), table[x]});
+    } else {
+      unordered_map<uint64_t, size_t> table;
+      for (size_t i = 0; i < n_; i++)
+        table[uint64_t(la[i]) * kb + lb[i]]++;
+      for (const auto &p : table)
+        cells_.push_back(
+            cell{uint32_t(p.first / kb), uint32_t(p.first % kb), p.second});
+    }
+  }
+
+  size_t n_;
+  vector<size_t> amargin_, bmargin_;
+  vector<cell> cells_;
+};
+
+inline double
+choose2(double x)
+{
+  return x * (x - 1.) / 2.;
+}
+
+} // namespace
+
+double
+partition::adjusted_rand_index(const vector<ssize_t> &a,
+                               const vector<ssize_t> &b)
+{
+  const contingency c(a, b);
+  double index = 0., asum = 0., bsum = 0.;
+  for (const auto &x : c.cells_)
+    index += choose2(x.count_);
+  for (auto m : c.amargin_)
+    asum += choose2(m);
+  for (auto m : c.bmargin_)
+    bsum += choose2(m);
+  const double pairs = choose2(c.n_);
+  const double expected = pairs ? asum * bsum / pairs : 0.;
+  const double maximum = (asum + bsum) / 2.;
+  // only when both are one group, or both all singletons
+  if (maximum == expected)
+    return 1.;
+  return (index - expected) / (maximum - expected);
+}
+
+double
+partition::variation_of_information(const vector<ssize_t> &a,
+                                    const vector<ssize_t> &b)
+{
+  const contingency c(a, b);
+  if (!c.n_)
+    return 0.;
+  double vi = 0.;
+  for (const auto &x : c.cells_) {
+    const double nij = x.count_;
+    vi -= nij * (log(nij / c.amargin_[x.a_]) + log(nij / c.bmargin_[x.b_]));
+  }
+  return vi / c.n_;
+}
@@ -0,0 +1,92 @@
+#include <microscopes/common/profiler.hpp>
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+using namespace microscopes::common;
+
+profiler::region *
+profiler::region::find_or_create(const char *name)
+{
+  for (const auto &c : children_)
+    if (!strcmp(c->name_, name))
+      return c.get();
+  children_.emplace_back(new region(name, this));
+  return children_.back().get();
+}
+
+profiler &
+profiler::local()
+{
+  static thread_local profiler p;
+  return p;
+}
+
+double
+profiler::nsec_per_tick()
+{
+#ifdef MICROSCOPES_HAVE_TSC
+  return timer::calibration().nsec_per_tick_;
+#else
+  return 1.;
+#endif
+}
+
+void
+profiler::reset()
+{
+  MICROSCOPES_DCHECK(cur_ == &root_, "reset() within a region");
+  root_.children_.clear();
+}
+
+static void
+report_region(ostream &os, const profiler::region &r, size_t depth)
+{
+  uint64_t child_ticks = 0;
+  for (const auto &c : r.children_)
+    child_ticks += c->ticks_;
+  const double nsec = r.nsec();
+  const double parent_nsec = r.parent_->parent_ ? r.parent_->nsec() : 0.;
+  const double self_nsec = (r.ticks_ > child_ticks) ?
+    (r.ticks_ - child_ticks) * profiler::nsec_per_tick() : 0.;
+  os << left << setw(40) << (string(2 * depth, ' ') + r.name_) << right
+     << fixed << setprecision(3)
+     << setw(14) << nsec / 1e6
+     << setw(12) << r.count_
+     << setprecision(1)
+     << setw(14) << nsec / max(r.count_, uint64_t(1))
+     << setw(9) << (parent_nsec > 0. ? 100. * nsec / parent_nsec : 100.)
+     << setprecision(3)
+     << setw(14) << self_nsec / 1e6
+     << endl;
+  for (const auto &c : r.children_)
+    report_region(os, *c, depth + 1);
+}
+
+void
+profiler::report(ostream &os) const
+{
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << left << setw(40) << "region" << right
+     << setw(14) << "total ms"
+     << setw(12) << "count"
+     << setw(14) << "ns/entry"
+     << setw(9) << "%parent"
+     << setw(14) << "self ms"
+     << endl;
+  for (const auto &c : root_.children_)
+    report_region(os, *c, 0);
+  os.flags(flags);
+  os.precision(precision);
+}
+
+string
+profiler::report() const
+{
+  ostringstream oss;
+  report(oss);
+  return oss.str();
+}
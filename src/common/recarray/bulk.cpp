@@ -0,0 +1,171 @@
+#include <microscopes/common/recarray/bulk.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+#include <microscopes/common/trace.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <thread>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::common::recarray;
+
+static unsigned
+effective_nthreads(unsigned nthreads, size_t n)
+{
+  if (!nthreads)
+    nthreads = max(1U, thread::hardware_concurrency());
+  return max(size_t(1), min(size_t(nthreads), n));
+}
+
+// invokes fn(t, begin, end) for each of the nthreads contiguous shards of
+// [0, n), rethrowing the first exception (if any) raised by a worker
+static void
+run_sharded(size_t n,
+            unsigned nthreads,
+            const function<void(unsigned, size_t, size_t)> &fn)
+{
+  vector<exception_ptr> errors(nthreads);
+  vector<thread> workers;
+  workers.reserve(nthreads);
+  for (unsigned t = 0; t < nthreads; t++) {
+    const size_t begin = (n * t) / nthreads;
+    const size_t end = (n * (t + 1)) / nthreads;
+    workers.emplace_back([&fn, &errors, t, begin, end]() {
+      try {
+        fn(t, begin, end);
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+  }
+  for (auto &w : workers)
+    w.join();
+  for (auto &e : errors)
+    if (e)
+      rethrow_exception(e);
+}
+
+// the position of gid in gids, which is sorted (group_manager iterates in gid
+// order)
+static inline size_t
+gid_index(const vector<size_t> &gids, size_t gid)
+{
+  const auto it = lower_bound(gids.begin(), gids.end(), gid);
+  MICROSCOPES_DCHECK(it != gids.end() && *it == gid, "invalid gid");
+  return it - gids.begin();
+}
+
+void
+bulk::add_values(groups_t &groups,
+                 const vector<shared_ptr<models::hypers>> &hypers,
+                 const dataview &view,
+                 const vector<size_t> &assignments,
+                 rng_t &rng,
+                 unsigned nthreads)
+{
+  MICROSCOPES_TRACE_SPAN("bulk::add_values");
+  const size_t n = view.size();
+  const size_t nfeatures = view.types().size();
+  MICROSCOPES_DCHECK(assignments.size() == n, "assignments/view size mismatch");
+  MICROSCOPES_DCHECK(hypers.size() == nfeatures, "# of features mismatch");
+  MICROSCOPES_DCHECK(groups.nentities() == n, "# of entities mismatch");
+
+  // thread-local groups are indexed densely by position in gids
+  const vector<size_t> gids = groups.groups();
+
+  nthreads = effective_nthreads(nthreads, n);
+  vector<rng_t> rngs;
+  rngs.reserve(nthreads);
+  for (unsigned t = 0; t < nthreads; t++)
+    rngs.emplace_back(rng());
+
+  vector<vector<feature_groups_t>> locals(nthreads);
+  run_sharded(n, nthreads, [&](unsigned t, size_t begin, size_t end) {
+    MICROSCOPES_TRACE_SPAN("shard");
+    auto &local = locals[t];
+    auto &r = rngs[t];
+    local.resize(gids.size());
+    for (size_t i = begin; i < end; i++) {
+      MICROSCOPES_TRACE_SPAN_ARG("entity", i);
+      auto &fgroups = local[gid_index(gids, assignments[i])];
+      if (fgroups.empty()) {
+        fgroups.reserve(nfeatures);
+        for (const auto &h : hypers)
+          fgroups.emplace_back(h->create_scratch_group(r));
+      }
+      row_accessor acc = view.get(i);
+      for (size_t f = 0; f < nfeatures; f++, acc.bump()) {
+        if (acc.anymasked())
+          continue;
+        MICROSCOPES_TRACE_SPAN_ARG("add_value", f);
+        fgroups[f]->add_value(*hypers[f], acc.get(), r);
+      }
+    }
+  });
+
+  // reduce, then do the (cheap) entity bookkeeping
+  MICROSCOPES_TRACE_SPAN("reduce");
+  for (auto &local : locals) {
+    for (size_t g = 0; g < local.size(); g++) {
+      if (local[g].empty())
+        continue;
+      auto &target = groups.group(gids[g]).data_;
+      MICROSCOPES_ASSERT(target.size() == nfeatures);
+      for (size_t f = 0; f < nfeatures; f++)
+        target[f]->merge(*hypers[f], *local[g][f], rng);
+    }
+  }
+  for (size_t i = 0; i < n; i++)
+    groups.add_value(assignments[i], i);
+}
+
+void
+bulk::sample_values(const groups_t &groups,
+                    const vector<shared_ptr<models::hypers>> &hypers,
+                    const vector<runtime_type> &types,
+                    const vector<size_t> &gids,
+                    uint8_t *out,
+                    rng_t &rng,
+                    unsigned nthreads)
+{
+  MICROSCOPES_TRACE_SPAN("bulk::sample_values");
+  const size_t n = gids.size();
+  const size_t nfeatures = types.size();
+  MICROSCOPES_DCHECK(hypers.size() == nfeatures, "# of features mismatch");
+  if (!n)
+    return;
+  MICROSCOPES_ASSERT(out);
+  const size_t rowsize = runtime_type::GetOffsetsAndSize(types).rowsize_;
+
+  // resolve the groups once, rather than doing a map lookup per row
+  const vector<size_t> active = groups.groups();
+  vector<const feature_groups_t *> fgroups;
+  fgroups.reserve(active.size());
+  for (auto gid : active) {
+    fgroups.push_back(&groups.group(gid).data_);
+    MICROSCOPES_ASSERT(fgroups.back()->size() == nfeatures);
+  }
+
+  nthreads = effective_nthreads(nthreads, n);
+  vector<rng_t> rngs;
+  rngs.reserve(nthreads);
+  for (unsigned t = 0; t < nthreads; t++)
+    rngs.emplace_back(rng());
+
+  run_sharded(n, nthreads, [&](unsigned t, size_t begin, size_t end) {
+    MICROSCOPES_TRACE_SPAN("shard");
+    auto &r = rngs[t];
+    for (size_t i = begin; i < end; i++) {
+      MICROSCOPES_TRACE_SPAN_ARG("entity", i);
+      const auto &fg = *fgroups[gid_index(active, gids[i])];
+      row_mutator mut(out + i * rowsize, &types);
+      for (size_t f = 0; f < nfeatures; f++, mut.bump()) {
+        value_mutator value = mut.set();
+        fg[f]->sample_value(*hypers[f], value, r);
+      }
+    }
+  });
+}
@@ -1,7 +1,10 @@
 #include <microscopes/common/recarray/dataview.hpp>
 #include <microscopes/common/util.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <limits>
 #include <sstream>
 #include <iostream>
 
@@ -141,5 +144,40 @@ row_major_dataview::get(size_t actual_pos) const
 void
 row_major_dataview::permute(rng_t &rng)
 {
+  MICROSCOPES_CHECK(size() <= numeric_limits<uint32_t>::max(),
+      "too many rows to permute");
   util::inplace_permute(pi_, size(), rng);
 }
+
+void
+row_major_dataview::permute_blocked(rng_t &rng, size_t blockrows)
+{
+  MICROSCOPES_CHECK(size() <= numeric_limits<uint32_t>::max(),
+      "too many rows to permute");
+  if (!blockrows)
+    blockrows = max(size_t(1), DefaultBlockBytes / max(size_t(1), rowsize()));
+  util::inplace_blocked_permute(pi_, blocks_, size(), blockrows, rng);
+}
+
+void
+row_major_dataview::copy_rows(size_t begin, size_t end,
+                              uint8_t *out, bool *mask_out) const
+{
+  MICROSCOPES_DCHECK(begin <= end && end <= size(), "invalid range");
+  const size_t n = end - begin;
+  const size_t rs = rowsize(), ms = maskrowsize();
+  if (pi_.empty()) {
+    memcpy(out, data_ + rs * begin, rs * n);
+    if (mask_out && mask_)
+      memcpy(mask_out, mask_ + ms * begin, ms * n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      const size_t pos = pi_[begin + i];
+      memcpy(out + rs * i, data_ + rs * pos, rs);
+      if (mask_out && mask_)
+        memcpy(mask_out + ms * i, mask_ + ms * pos, ms);
+    }
+  }
+  if (mask_out && !mask_)
+    fill(mask_out, mask_out + ms * n, false);
+}
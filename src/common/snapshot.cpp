@@ -0,0 +1,190 @@
+#include <microscopes/common/snapshot.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace microscopes::common;
+
+const uint32_t snapshot::Magic;
+const uint32_t snapshot::Version;
+const size_t snapshot::ArrayAlignment;
+
+static inline string
+errno_str(const string &what)
+{
+  return what + ": " + strerror(errno);
+}
+
+static inline size_t
+padding(size_t offset)
+{
+  const size_t r = offset % snapshot::ArrayAlignment;
+  return r ? snapshot::ArrayAlignment - r : 0;
+}
+
+snapshot_writer::snapshot_writer()
+  : fd_(-1), bufsize_(), buf_(), offset_()
+{
+  write_header();
+}
+
+snapshot_writer::snapshot_writer(const string &path, size_t bufsize)
+  : fd_(-1), bufsize_(bufsize), buf_(), offset_()
+{
+  MICROSCOPES_DCHECK(bufsize > 0, "empty buffer");
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  MICROSCOPES_CHECK(fd_ != -1, errno_str("could not open " + path));
+  buf_.reserve(bufsize_);
+  write_header();
+}
+
+snapshot_writer::~snapshot_writer()
+{
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+void
+snapshot_writer::write_header()
+{
+  write(snapshot::Magic);
+  write(snapshot::Version);
+}
+
+void
+snapshot_writer::write_raw(const void *p, size_t n)
+{
+  const char *px = reinterpret_cast<const char *>(p);
+  offset_ += n;
+  MICROSCOPES_METRIC_ADD(M_SNAPSHOT_BYTES_OUT, n);
+  if (fd_ == -1 || (buf_.size() + n) <= bufsize_) {
+    buf_.append(px, n);
+    return;
+  }
+  // large writes bypass the buffer
+  flush();
+  if (n >= bufsize_) {
+    while (n) {
+      const ssize_t ret = ::write(fd_, px, n);
+      if (ret == -1 && errno == EINTR)
+        continue;
+      MICROSCOPES_CHECK(ret > 0, errno_str("snapshot write failed"));
+      px += ret;
+      n -= ret;
+    }
+  } else {
+    buf_.append(px, n);
+  }
+}
+
+void
+snapshot_writer::pad()
+{
+  static const char zeros[snapshot::ArrayAlignment] = {0};
+  write_raw(zeros, padding(offset_));
+}
+
+void
+snapshot_writer::flush()
+{
+  if (fd_ == -1)
+    return;
+  const char *px = buf_.data();
+  size_t n = buf_.size();
+  while (n) {
+    const ssize_t ret = ::write(fd_, px, n);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    MICROSCOPES_CHECK(ret > 0, errno_str("snapshot write failed"));
+    px += ret;
+    n -= ret;
+  }
+  buf_.clear();
+}
+
+void
+snapshot_writer::close()
+{
+  if (fd_ == -1)
+    return;
+  flush();
+  const int fd = fd_;
+  fd_ = -1;
+  MICROSCOPES_CHECK(::close(fd) == 0, errno_str("snapshot close failed"));
+}
+
+void
+snapshot_writer::reset()
+{
+  MICROSCOPES_DCHECK(fd_ == -1, "not an in-memory writer");
+  buf_.clear();
+  offset_ = 0;
+  write_header();
+}
+
+snapshot_reader::snapshot_reader(const uint8_t *data, size_t size)
+  : data_(data), size_(size), pos_(), mapped_(false)
+{
+  read_header();
+}
+
+snapshot_reader::snapshot_reader(const string &path)
+  : data_(), size_(), pos_(), mapped_(false)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  MICROSCOPES_CHECK(fd != -1, errno_str("could not open " + path));
+  struct stat st;
+  if (::fstat(fd, &st) == -1) {
+    const string err = errno_str("could not stat " + path);
+    ::close(fd);
+    throw runtime_error(err);
+  }
+  size_ = st.st_size;
+  if (size_) {
+    void *px = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (px == MAP_FAILED) {
+      const string err = errno_str("could not mmap " + path);
+      ::close(fd);
+      throw runtime_error(err);
+    }
+    data_ = reinterpret_cast<const uint8_t *>(px);
+    mapped_ = true;
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+  try {
+    read_header();
+  } catch (...) {
+    if (mapped_)
+      ::munmap(const_cast<uint8_t *>(data_), size_);
+    throw;
+  }
+}
+
+snapshot_reader::~snapshot_reader()
+{
+  if (mapped_)
+    ::munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+void
+snapshot_reader::read_header()
+{
+  MICROSCOPES_CHECK(read<uint32_t>() == snapshot::Magic, "not a snapshot");
+  MICROSCOPES_CHECK(read<uint32_t>() == snapshot::Version,
+      "unsupported snapshot version");
+}
+
+void
+snapshot_reader::skip_pad()
+{
+  consume(padding(pos_));
+}
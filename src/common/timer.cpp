@@ -0,0 +1,32 @@
+#include <microscopes/common/timer.hpp>
+
+using namespace std;
+using namespace microscopes::common;
+
+#ifdef MICROSCOPES_HAVE_TSC
+
+static timer::tsc_calibration
+calibrate()
+{
+  // time ~10ms of ticks against CLOCK_MONOTONIC; the error of the rate is
+  // about that of two clock_gettime() calls over 10ms, i.e. < 10ppm
+  timer::tsc_calibration c;
+  c.nsec0_ = timer::monotonic_nsec();
+  c.ticks0_ = timer::rdtsc();
+  uint64_t nsec1, ticks1;
+  do {
+    nsec1 = timer::monotonic_nsec();
+    ticks1 = timer::rdtsc();
+  } while (nsec1 - c.nsec0_ < 10000000);
+  c.nsec_per_tick_ = double(nsec1 - c.nsec0_) / double(ticks1 - c.ticks0_);
+  return c;
+}
+
+const timer::tsc_calibration &
+timer::calibration()
+{
+  static const tsc_calibration c = calibrate();
+  return c;
+}
+
+#endif
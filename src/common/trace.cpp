@@ -0,0 +1,313 @@
+#include <microscopes/common/trace.hpp>
+#include <microscopes/common/timer.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::common::trace;
+
+atomic<bool> trace::detail::Enabled(false);
+
+namespace {
+
+// the events of one thread, oldest first
+struct thread_events {
+  unsigned tid_;
+  vector<detail::event> events_;
+};
+
+/**
+ * The buffers of live threads, and the events retired from the buffers of
+ * exited threads. The thread which called start() (the owner) gets
+ * capacity_ events, every other thread worker_capacity_.
+ */
+struct registry {
+  registry()
+    : capacity_(DefaultCapacity), worker_capacity_(DefaultWorkerCapacity),
+      owner_(this_thread::get_id()), next_tid_(), retained_() {}
+
+  size_t
+  capacity_of(thread::id id) const
+  {
+    return id == owner_ ? capacity_ : worker_capacity_;
+  }
+
+  mutex mutex_;
+  size_t capacity_;
+  size_t worker_capacity_;
+  thread::id owner_;
+  unsigned next_tid_;
+  vector<detail::buffer *> live_;
+  deque<thread_events> retired_; // earliest exited first
+  size_t retained_; // total events in retired_
+};
+
+registry &
+global()
+{
+  // leaked, so that buffers of threads exiting after main() can retire
+  static registry *r = new registry();
+  return *r;
+}
+
+// the events of the spans of events which both begin and end in it
+vector<detail::event>
+completed_events(const vector<detail::event> &events)
+{
+  vector<bool> keep(events.size());
+  vector<size_t> stack;
+  for (size_t i = 0; i < events.size(); i++) {
+    const auto &e = events[i];
+    if (e.begin_) {
+      stack.push_back(i);
+      continue;
+    }
+    if (stack.empty() || strcmp(events[stack.back()].name_, e.name_))
+      continue;
+    keep[stack.back()] = keep[i] = true;
+    stack.pop_back();
+  }
+  vector<detail::event> ret;
+  for (size_t i = 0; i < events.size(); i++)
+    if (keep[i])
+      ret.push_back(events[i]);
+  return ret;
+}
+
+// owns the calling thread's buffer, retiring it when the thread exits
+struct local_buffer {
+  ~local_buffer()
+  {
+    if (!b_)
+      return;
+    registry &r = global();
+    lock_guard<mutex> lk(r.mutex_);
+    r.live_.erase(find(r.live_.begin(), r.live_.end(), b_.get()));
+    auto events = completed_events(b_->events());
+    if (!events.empty()) {
+      r.retained_ += events.size();
+      r.retired_.push_back(thread_events{b_->tid(), move(events)});
+    }
+    while (r.retained_ > r.capacity_) {
+      r.retained_ -= r.retired_.front().events_.size();
+      r.retired_.pop_front();
+    }
+    b_.reset();
+  }
+
+  unique_ptr<detail::buffer> b_;
+};
+
+inline uint64_t
+to_nsec(uint64_t ticks)
+{
+#ifdef MICROSCOPES_HAVE_TSC
+  return timer::tsc_to_nsec(ticks);
+#else
+  return ticks;
+#endif
+}
+
+// a span whose begin and end are both retained
+struct completed_span {
+  const char *name_;
+  uint64_t arg_;
+  uint64_t begin_, end_; // nsec
+  uint64_t child_nsec_; // total of the immediate subspans
+};
+
+/**
+ * Matches up the begin/end events, calling
+ * emit(stack, span) as each span ends, where stack holds the enclosing
+ * spans (outermost first). Ends whose begin was overwritten, and spans
+ * still open, are dropped.
+ */
+template <typename Emit>
+void
+match_spans(const vector<detail::event> &events, Emit emit)
+{
+  vector<completed_span> stack;
+  for (const auto &e : events) {
+    if (e.begin_) {
+      stack.push_back(completed_span{e.name_, e.arg_, to_nsec(e.ticks_), 0, 0});
+      continue;
+    }
+    if (stack.empty() || strcmp(stack.back().name_, e.name_))
+      continue;
+    completed_span s = stack.back();
+    stack.pop_back();
+    s.end_ = to_nsec(e.ticks_);
+    if (!stack.empty())
+      stack.back().child_nsec_ += s.end_ - s.begin_;
+    emit(stack, s);
+  }
+}
+
+// the events of every thread, exited ones first
+vector<thread_events>
+snapshot()
+{
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  vector<thread_events> ret(r.retired_.begin(), r.retired_.end());
+  for (const auto *b : r.live_)
+    ret.push_back(thread_events{b->tid(), b->events()});
+  return ret;
+}
+
+string
+json_escape(const char *s)
+{
+  string ret;
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      ret += '\\';
+    ret += *s;
+  }
+  return ret;
+}
+
+} // namespace
+
+trace::detail::buffer::buffer(size_t capacity, unsigned tid, thread::id owner)
+  : events_(), mask_(), head_(), tid_(tid), owner_(owner)
+{
+  reset(capacity);
+}
+
+void
+trace::detail::buffer::reset(size_t capacity)
+{
+  size_t n = 1;
+  while (n < capacity)
+    n <<= 1;
+  if (events_.size() != n) {
+    events_.assign(n, event());
+    events_.shrink_to_fit();
+  }
+  mask_ = n - 1;
+  head_ = 0;
+}
+
+vector<trace::detail::event>
+trace::detail::buffer::events() const
+{
+  const size_t n = events_.size();
+  vector<event> ret;
+  const uint64_t first = head_ > n ? head_ - n : 0;
+  ret.reserve(head_ - first);
+  for (uint64_t i = first; i < head_; i++)
+    ret.push_back(events_[i & mask_]);
+  return ret;
+}
+
+trace::detail::buffer &
+trace::detail::local()
+{
+  static thread_local local_buffer lb;
+  if (unlikely(!lb.b_)) {
+    registry &r = global();
+    const auto id = this_thread::get_id();
+    lock_guard<mutex> lk(r.mutex_);
+    lb.b_.reset(new buffer(r.capacity_of(id), r.next_tid_++, id));
+    r.live_.push_back(lb.b_.get());
+  }
+  return *lb.b_;
+}
+
+size_t
+trace::detail::live_buffers()
+{
+  registry &r = global();
+  lock_guard<mutex> lk(r.mutex_);
+  return r.live_.size();
+}
+
+void
+trace::start(size_t capacity, size_t worker_capacity)
+{
+  MICROSCOPES_DCHECK(capacity > 0 && worker_capacity > 0,
+      "empty trace buffers");
+  {
+    registry &r = global();
+    lock_guard<mutex> lk(r.mutex_);
+    r.capacity_ = capacity;
+    r.worker_capacity_ = worker_capacity;
+    r.owner_ = this_thread::get_id();
+    for (auto *b : r.live_)
+      b->reset(r.capacity_of(b->owner()));
+    r.retired_.clear();
+    r.retained_ = 0;
+  }
+  detail::Enabled.store(true, memory_order_release);
+}
+
+void
+trace::stop()
+{
+  detail::Enabled.store(false, memory_order_release);
+}
+
+void
+trace::write_chrome_trace(ostream &os)
+{
+  const auto threads = snapshot();
+
+  // timestamps are relative to the earliest retained event
+  uint64_t t0 = ~uint64_t(0);
+  for (const auto &t : threads)
+    if (!t.events_.empty())
+      t0 = min(t0, to_nsec(t.events_.front().ticks_));
+
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << fixed << setprecision(3);
+  os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+  bool first = true;
+  for (const auto &t : threads) {
+    const unsigned tid = t.tid_;
+    match_spans(t.events_, [&](const vector<completed_span> &, const completed_span &s) {
+      os << (first ? "\n" : ",\n")
+         << "{\"name\": \"" << json_escape(s.name_) << "\", \"ph\": \"X\", "
+         << "\"pid\": 0, \"tid\": " << tid << ", "
+         << "\"ts\": " << (s.begin_ - t0) / 1e3 << ", "
+         << "\"dur\": " << (s.end_ - s.begin_) / 1e3;
+      if (s.arg_ != NoArg)
+        os << ", \"args\": {\"arg\": " << s.arg_ << "}";
+      os << "}";
+      first = false;
+    });
+  }
+  os << "\n]}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void
+trace::write_folded(ostream &os)
+{
+  map<string, uint64_t> stacks;
+  for (const auto &t : snapshot()) {
+    match_spans(t.events_, [&](const vector<completed_span> &stack, const completed_span &s) {
+      string path;
+      for (const auto &p : stack) {
+        path += p.name_;
+        path += ';';
+      }
+      path += s.name_;
+      const uint64_t nsec = s.end_ - s.begin_;
+      stacks[path] += (nsec > s.child_nsec_) ? nsec - s.child_nsec_ : 0;
+    });
+  }
+  for (const auto &p : stacks)
+    os << p.first << " " << p.second << "\n";
+}
@@ -0,0 +1,366 @@
+#include <microscopes/common/workload.hpp>
+#include <microscopes/common/runtime_value.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <distributions/random.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::common::workload;
+
+storage::storage(size_t nbytes, const string &path)
+  : data_(), size_(nbytes), path_(path)
+{
+  // mmap() does not allow empty mappings
+  const size_t len = max(nbytes, size_t(1));
+  void *p;
+  if (path.empty()) {
+    p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw runtime_error("could not open " + path);
+    if (ftruncate(fd, len)) {
+      close(fd);
+      throw runtime_error("could not resize " + path);
+    }
+    p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+  }
+  if (p == MAP_FAILED)
+    throw runtime_error("mmap() failed");
+  data_ = reinterpret_cast<uint8_t *>(p);
+}
+
+storage::~storage()
+{
+  munmap(data_, max(size_, size_t(1)));
+}
+
+void
+storage::sync() const
+{
+  if (!path_.empty())
+    msync(data_, max(size_, size_t(1)), MS_SYNC);
+}
+
+// the arrays of a workload are laid out back to back in one storage, each
+// starting at an 8 byte boundary
+static inline size_t
+place(size_t &off, size_t nbytes)
+{
+  const size_t ret = (off + 7) & ~size_t(7);
+  off = ret + nbytes;
+  return ret;
+}
+
+// fills value from a distribution determined by theta in [0, 1): bools are
+// Bernoulli(theta), floats Normal(10 theta - 5, 1) and integers
+// Poisson(1 + 9 theta), capped so they fit in every integer type
+static void
+fill_value(uint8_t *px, const runtime_type &type, float theta, rng_t &rng)
+{
+  value_mutator m(px, type);
+  for (unsigned i = 0; i < type.n(); i++) {
+    switch (type.t()) {
+      case TYPE_B:
+        m.set<bool>(distributions::sample_unif01(rng) < theta, i);
+        break;
+      case TYPE_F32:
+      case TYPE_F64:
+        m.set<float>(normal_distribution<float>(10. * theta - 5., 1.)(rng), i);
+        break;
+      default:
+        m.set<uint32_t>(
+            min(poisson_distribution<uint32_t>(1. + 9. * theta)(rng), 127U), i);
+        break;
+    }
+  }
+}
+
+static vector<float>
+sample_thetas(size_t n, rng_t &rng)
+{
+  vector<float> ret(n);
+  for (auto &t : ret)
+    t = distributions::sample_unif01(rng);
+  return ret;
+}
+
+vector<uint32_t>
+microscopes::common::workload::sample_assignments(
+    size_t n, const clustering &c, rng_t &rng)
+{
+  MICROSCOPES_DCHECK(c.clusters_ > 0, "no clusters");
+  vector<double> weights(c.clusters_);
+  for (size_t k = 0; k < c.clusters_; k++)
+    weights[k] = pow(double(k + 1), -double(c.zipf_s_));
+  discrete_distribution<uint32_t> d(weights.begin(), weights.end());
+  vector<uint32_t> ret(n);
+  for (auto &k : ret)
+    k = d(rng);
+  return ret;
+}
+
+vector<runtime_type>
+microscopes::common::workload::mixed_types(size_t n)
+{
+  const runtime_type cycle[] = {
+    runtime_type(TYPE_B),
+    runtime_type(TYPE_I32),
+    runtime_type(TYPE_F32),
+    runtime_type(TYPE_U32),
+    runtime_type(TYPE_F32, 3),
+  };
+  vector<runtime_type> ret;
+  ret.reserve(n);
+  for (size_t i = 0; i < n; i++)
+    ret.push_back(cycle[i % (sizeof(cycle) / sizeof(cycle[0]))]);
+  return ret;
+}
+
+recarray_workload::recarray_workload(const recarray_config &config, rng_t &rng)
+  : config_(config), assignments_(), storage_(), data_(), mask_()
+{
+  const auto layout = runtime_type::GetOffsetsAndSize(config.types_);
+  const size_t nfeatures = config.types_.size();
+  const bool masked = config.mask_density_ > 0.;
+
+  size_t nbytes = 0;
+  const size_t data_off = place(nbytes, config.rows_ * layout.rowsize_);
+  const size_t mask_off =
+    place(nbytes, masked ? config.rows_ * layout.maskrowsize_ : 0);
+  storage_.reset(new storage(nbytes, config.path_));
+  data_ = storage_->data() + data_off;
+  mask_ = masked ? reinterpret_cast<bool *>(storage_->data() + mask_off) : nullptr;
+
+  assignments_ = sample_assignments(config.rows_, config.clustering_, rng);
+  const vector<float> thetas =
+    sample_thetas(config.clustering_.clusters_ * nfeatures, rng);
+
+  uint8_t *px = data_;
+  bool *pmask = mask_;
+  for (size_t i = 0; i < config.rows_; i++) {
+    const float *theta = &thetas[assignments_[i] * nfeatures];
+    for (size_t f = 0; f < nfeatures; f++) {
+      const auto &type = config.types_[f];
+      fill_value(px, type, theta[f], rng);
+      px += type.size();
+      if (masked)
+        for (unsigned j = 0; j < type.n(); j++)
+          *pmask++ = distributions::sample_unif01(rng) < config.mask_density_;
+    }
+  }
+}
+
+shared_ptr<recarray::row_major_dataview>
+recarray_workload::dataview() const
+{
+  return make_shared<recarray::row_major_dataview>(
+      data_, mask_, config_.rows_, config_.types_);
+}
+
+variadic_workload::variadic_workload(const variadic_config &config, rng_t &rng)
+  : config_(config), assignments_(), ns_(), storage_()
+{
+  MICROSCOPES_DCHECK(config.mean_rowsize_ > 0., "rows must be non-empty on average");
+  assignments_ = sample_assignments(config.rows_, config.clustering_, rng);
+
+  // geometric on {0, 1, ...} with the given mean
+  geometric_distribution<unsigned> rowsize(1. / (1. + config.mean_rowsize_));
+  ns_.resize(config.rows_);
+  size_t nvalues = 0;
+  for (auto &n : ns_) {
+    n = rowsize(rng);
+    nvalues += n;
+  }
+
+  storage_.reset(new storage(nvalues * config.type_.size(), config.path_));
+  const vector<float> thetas = sample_thetas(config.clustering_.clusters_, rng);
+  uint8_t *px = storage_->data();
+  for (size_t i = 0; i < config.rows_; i++) {
+    const float theta = thetas[assignments_[i]];
+    for (unsigned j = 0; j < ns_[i]; j++) {
+      fill_value(px, config.type_, theta, rng);
+      px += config.type_.size();
+    }
+  }
+}
+
+shared_ptr<variadic::row_major_dataview>
+variadic_workload::dataview() const
+{
+  return make_shared<variadic::row_major_dataview>(
+      storage_->data(), ns_, config_.type_);
+}
+
+relation_workload::relation_workload(const relation_config &config, rng_t &rng)
+  : config_(config), row_assignments_(), col_assignments_(), thetas_(),
+    nnz_(), storage_(),
+    data_off_(), mask_off_(),
+    csr_indices_off_(), csr_indptr_off_(),
+    csc_data_off_(), csc_indices_off_(), csc_indptr_off_()
+{
+  MICROSCOPES_DCHECK(config.rows_ && config.cols_, "empty relation");
+  MICROSCOPES_DCHECK(config.density_ >= 0. && config.density_ <= 1.,
+      "density must be in [0, 1]");
+  MICROSCOPES_DCHECK(!config.sparse_ || config.cols_ <= 0xFFFFFFFFUL,
+      "too many columns for 32-bit indices");
+
+  row_assignments_ = sample_assignments(config.rows_, config.row_clustering_, rng);
+  col_assignments_ = sample_assignments(config.cols_, config.col_clustering_, rng);
+  thetas_ = sample_thetas(
+      config.row_clustering_.clusters_ * config.col_clustering_.clusters_, rng);
+
+  if (config.sparse_)
+    generate_sparse(rng);
+  else
+    generate_dense(rng);
+}
+
+void
+relation_workload::generate_dense(rng_t &rng)
+{
+  const size_t ncells = config_.rows_ * config_.cols_;
+  const size_t tsize = config_.type_.size();
+  const bool masked = config_.density_ < 1.;
+
+  size_t nbytes = 0;
+  data_off_ = place(nbytes, ncells * tsize);
+  mask_off_ = place(nbytes, masked ? ncells * config_.type_.n() : 0);
+  storage_.reset(new storage(nbytes, config_.path_));
+
+  uint8_t *px = storage_->data() + data_off_;
+  bool *pmask = reinterpret_cast<bool *>(storage_->data() + mask_off_);
+  const size_t ccs = config_.col_clustering_.clusters_;
+  for (size_t i = 0; i < config_.rows_; i++) {
+    const float *theta = &thetas_[row_assignments_[i] * ccs];
+    for (size_t j = 0; j < config_.cols_; j++) {
+      fill_value(px, config_.type_, theta[col_assignments_[j]], rng);
+      px += tsize;
+      if (masked) {
+        const bool observed = distributions::sample_unif01(rng) < config_.density_;
+        nnz_ += observed;
+        for (unsigned k = 0; k < config_.type_.n(); k++)
+          *pmask++ = !observed;
+      }
+    }
+  }
+  if (!masked)
+    nnz_ = ncells;
+}
+
+void
+relation_workload::generate_sparse(rng_t &rng)
+{
+  const size_t rows = config_.rows_, cols = config_.cols_;
+  const size_t tsize = config_.type_.size();
+
+  // draw each row's size first, so the arrays can be sized up front
+  binomial_distribution<size_t> rowsize(cols, config_.density_);
+  vector<size_t> ns(rows);
+  for (auto &n : ns) {
+    n = rowsize(rng);
+    nnz_ += n;
+  }
+  MICROSCOPES_DCHECK(nnz_ <= 0xFFFFFFFFUL, "too many entries for 32-bit indices");
+
+  size_t nbytes = 0;
+  data_off_ = place(nbytes, nnz_ * tsize);
+  csr_indices_off_ = place(nbytes, nnz_ * sizeof(uint32_t));
+  csr_indptr_off_ = place(nbytes, (rows + 1) * sizeof(uint32_t));
+  csc_data_off_ = place(nbytes, nnz_ * tsize);
+  csc_indices_off_ = place(nbytes, nnz_ * sizeof(uint32_t));
+  csc_indptr_off_ = place(nbytes, (cols + 1) * sizeof(uint32_t));
+  storage_.reset(new storage(nbytes, config_.path_));
+
+  uint8_t *base = storage_->data();
+  uint8_t *csr_data = base + data_off_;
+  uint32_t *csr_indices = reinterpret_cast<uint32_t *>(base + csr_indices_off_);
+  uint32_t *csr_indptr = reinterpret_cast<uint32_t *>(base + csr_indptr_off_);
+  uint8_t *csc_data = base + csc_data_off_;
+  uint32_t *csc_indices = reinterpret_cast<uint32_t *>(base + csc_indices_off_);
+  uint32_t *csc_indptr = reinterpret_cast<uint32_t *>(base + csc_indptr_off_);
+
+  // the columns of each row are a uniform sample without replacement: dense
+  // rows are drawn by selection sampling, sparse ones by Floyd's algorithm
+  const size_t ccs = config_.col_clustering_.clusters_;
+  unordered_set<uint32_t> chosen;
+  size_t pos = 0;
+  for (size_t i = 0; i < rows; i++) {
+    csr_indptr[i] = pos;
+    const size_t n = ns[i];
+    uint32_t *idx = csr_indices + pos;
+    if (4 * n >= cols) {
+      size_t needed = n;
+      for (size_t j = 0; j < cols && needed; j++)
+        if (distributions::sample_unif01(rng) * (cols - j) < needed) {
+          *idx++ = j;
+          needed--;
+        }
+    } else {
+      chosen.clear();
+      for (size_t j = cols - n; j < cols; j++) {
+        const uint32_t t = uniform_int_distribution<size_t>(0, j)(rng);
+        chosen.insert(chosen.count(t) ? j : t);
+      }
+      copy(chosen.begin(), chosen.end(), idx);
+      sort(idx, idx + n);
+    }
+    const float *theta = &thetas_[row_assignments_[i] * ccs];
+    for (size_t k = pos; k < pos + n; k++)
+      fill_value(csr_data + k * tsize, config_.type_,
+          theta[col_assignments_[csr_indices[k]]], rng);
+    pos += n;
+  }
+  csr_indptr[rows] = pos;
+
+  // transpose into CSC, visiting rows in order so the row indices of each
+  // column come out sorted
+  fill(csc_indptr, csc_indptr + cols + 1, 0);
+  for (size_t k = 0; k < nnz_; k++)
+    csc_indptr[csr_indices[k] + 1]++;
+  for (size_t j = 0; j < cols; j++)
+    csc_indptr[j + 1] += csc_indptr[j];
+  vector<uint32_t> next(csc_indptr, csc_indptr + cols);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t k = csr_indptr[i]; k < csr_indptr[i + 1]; k++) {
+      const uint32_t dst = next[csr_indices[k]]++;
+      csc_indices[dst] = i;
+      memcpy(csc_data + dst * tsize, csr_data + k * tsize, tsize);
+    }
+  }
+}
+
+shared_ptr<relation::dataview>
+relation_workload::dataview() const
+{
+  const uint8_t *base = storage_->data();
+  if (!config_.sparse_) {
+    const bool *mask = config_.density_ < 1. ?
+      reinterpret_cast<const bool *>(base + mask_off_) : nullptr;
+    return make_shared<relation::row_major_dense_dataview>(
+        base + data_off_, mask,
+        vector<size_t>({config_.rows_, config_.cols_}), config_.type_);
+  }
+  return make_shared<relation::compressed_2darray>(
+      base + data_off_,
+      reinterpret_cast<const uint32_t *>(base + csr_indices_off_),
+      reinterpret_cast<const uint32_t *>(base + csr_indptr_off_),
+      base + csc_data_off_,
+      reinterpret_cast<const uint32_t *>(base + csc_indices_off_),
+      reinterpret_cast<const uint32_t *>(base + csc_indptr_off_),
+      config_.rows_, config_.cols_, config_.type_);
+}
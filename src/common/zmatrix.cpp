@@ -0,0 +1,357 @@
+#include <microscopes/common/zmatrix.hpp>
+#include <microscopes/common/partition.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+#include <microscopes/common/trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+
+using namespace std;
+using namespace microscopes::common;
+
+// rows are handed out to the workers this many at a time
+static const size_t RowChunk = 64;
+
+static unsigned
+effective_nthreads(unsigned nthreads, size_t nitems)
+{
+  if (!nthreads)
+    nthreads = max(1U, thread::hardware_concurrency());
+  return max(size_t(1), min(size_t(nthreads), nitems));
+}
+
+// invokes fn(t, item) for each item in [0, nitems), on nthreads workers which
+// take the items in increasing order, rethrowing the first exception (if any)
+// raised by a worker
+static void
+parallel_for(size_t nitems,
+             unsigned nthreads,
+             const function<void(unsigned, size_t)> &fn)
+{
+  nthreads = effective_nthreads(nthreads, nitems);
+  if (nthreads == 1) {
+    for (size_t i = 0; i < nitems; i++)
+      fn(0, i);
+    return;
+  }
+  atomic<size_t> next(0);
+  vector<exception_ptr> errors(nthreads);
+  vector<thread> workers;
+  workers.reserve(nthreads);
+  for (unsigned t = 0; t < nthreads; t++) {
+    workers.emplace_back([&fn, &errors, &next, nitems, t]() {
+      try {
+        size_t i;
+        while ((i = next.fetch_add(1, memory_order_relaxed)) < nitems)
+          fn(t, i);
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+  }
+  for (auto &w : workers)
+    w.join();
+  for (auto &e : errors)
+    if (e)
+      rethrow_exception(e);
+}
+
+typedef pair<uint32_t, uint32_t> candidate_t; // (count, entity)
+
+// writes the (at most) k best of candidates, padding the rest with -1/0
+static void
+write_top_k(vector<candidate_t> &candidates,
+            size_t k,
+            size_t nsamples,
+            ssize_t *neighbors,
+            float *scores)
+{
+  const size_t m = min(k, candidates.size());
+  partial_sort(candidates.begin(), candidates.begin() + m, candidates.end(),
+      [](const candidate_t &a, const candidate_t &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+      });
+  for (size_t r = 0; r < m; r++) {
+    neighbors[r] = candidates[r].second;
+    scores[r] = float(candidates[r].first) / nsamples;
+  }
+  fill(neighbors + m, neighbors + k, -1);
+  fill(scores + m, scores + k, 0.f);
+}
+
+// adds, for each of the nbatch relabeled assignment vectors in batch, the
+// co-assignments of the pairs (i, j) in [i0, i1) x [j0, j1) with j >= i
+static void
+add_tile(uint32_t *counts,
+         size_t n,
+         const uint32_t *batch,
+         size_t nbatch,
+         size_t i0, size_t i1,
+         size_t j0, size_t j1)
+{
+  for (size_t s = 0; s < nbatch; s++) {
+    const uint32_t *a = batch + s * n;
+    for (size_t i = i0; i < i1; i++) {
+      const uint32_t ai = a[i];
+      uint32_t *row = counts + i * n;
+      for (size_t j = max(i, j0); j < j1; j++)
+        row[j] += (a[j] == ai);
+    }
+  }
+}
+
+dense_zmatrix::dense_zmatrix(size_t n, unsigned nthreads)
+  : n_(n), nthreads_(nthreads), nsamples_(),
+    counts_(), pending_(), npending_()
+{
+  MICROSCOPES_CHECK(n <= numeric_limits<uint32_t>::max(), "too many entities");
+  counts_.resize(n * n);
+  pending_.resize(BatchSize * n);
+}
+
+void
+dense_zmatrix::add(const vector<ssize_t> &assignment)
+{
+  MICROSCOPES_CHECK(assignment.size() == n_, "wrong # of entities");
+  partition::relabel(assignment, &pending_[npending_ * n_]);
+  nsamples_++;
+  if (++npending_ == BatchSize)
+    flush();
+}
+
+void
+dense_zmatrix::flush()
+{
+  if (!npending_)
+    return;
+  MICROSCOPES_TRACE_SPAN_ARG("dense_zmatrix::flush", npending_);
+  // tile row I has ntiles - I tiles in the upper triangle, so handing out
+  // the tile rows in increasing order starts the longest ones first
+  const size_t ntiles = (n_ + TileSize - 1) / TileSize;
+  parallel_for(ntiles, nthreads_, [this, ntiles](unsigned, size_t I) {
+    const size_t i0 = I * TileSize;
+    const size_t i1 = min(n_, i0 + TileSize);
+    for (size_t J = I; J < ntiles; J++)
+      add_tile(counts_.data(), n_, pending_.data(), npending_,
+               i0, i1, J * TileSize, min(n_, (J + 1) * TileSize));
+  });
+  npending_ = 0;
+}
+
+uint32_t
+dense_zmatrix::count(size_t i, size_t j)
+{
+  MICROSCOPES_DCHECK(i < n_ && j < n_, "invalid entity");
+  flush();
+  if (i > j)
+    swap(i, j);
+  return counts_[i * n_ + j];
+}
+
+void
+dense_zmatrix::copy_to(float *out)
+{
+  MICROSCOPES_CHECK(nsamples_, "no assignments added");
+  flush();
+  MICROSCOPES_TRACE_SPAN("dense_zmatrix::copy_to");
+  // a tile and its mirror image are written together, so the transposed
+  // writes stay in cache; tile row I writes tiles (I, J) and (J, I), J >= I
+  const size_t ntiles = (n_ + TileSize - 1) / TileSize;
+  parallel_for(ntiles, nthreads_, [this, out, ntiles](unsigned, size_t I) {
+    const size_t i0 = I * TileSize;
+    const size_t i1 = min(n_, i0 + TileSize);
+    for (size_t J = I; J < ntiles; J++) {
+      const size_t j1 = min(n_, (J + 1) * TileSize);
+      for (size_t i = i0; i < i1; i++)
+        for (size_t j = max(i, J * TileSize); j < j1; j++) {
+          const float z = float(counts_[i * n_ + j]) / nsamples_;
+          out[i * n_ + j] = z;
+          out[j * n_ + i] = z;
+        }
+    }
+  });
+}
+
+void
+dense_zmatrix::top_k(size_t k, ssize_t *neighbors, float *scores)
+{
+  flush();
+  MICROSCOPES_TRACE_SPAN("dense_zmatrix::top_k");
+  const size_t nchunks = (n_ + RowChunk - 1) / RowChunk;
+  const unsigned nthreads = effective_nthreads(nthreads_, nchunks);
+  vector<vector<candidate_t>> candidates(nthreads);
+  parallel_for(nchunks, nthreads, [&](unsigned t, size_t c) {
+    auto &cands = candidates[t];
+    for (size_t i = c * RowChunk; i < min(n_, (c + 1) * RowChunk); i++) {
+      cands.clear();
+      for (size_t j = 0; j < i; j++)
+        if (counts_[j * n_ + i])
+          cands.emplace_back(counts_[j * n_ + i], j);
+      for (size_t j = i + 1; j < n_; j++)
+        if (counts_[i * n_ + j])
+          cands.emplace_back(counts_[i * n_ + j], j);
+      write_top_k(cands, k, nsamples_, neighbors + i * k, scores + i * k);
+    }
+  });
+}
+
+sparse_zmatrix::sparse_zmatrix(size_t n, unsigned nthreads)
+  : n_(n), nthreads_(nthreads), samples_()
+{
+  MICROSCOPES_CHECK(n <= numeric_limits<uint32_t>::max(), "too many entities");
+}
+
+void
+sparse_zmatrix::add(const vector<ssize_t> &assignment)
+{
+  MICROSCOPES_CHECK(assignment.size() == n_, "wrong # of entities");
+  sample s;
+  s.labels_.resize(n_);
+  const uint32_t ngroups = partition::relabel(assignment, s.labels_.data());
+
+  // counting sort of the entities by group
+  s.offsets_.assign(ngroups + 1, 0);
+  for (auto g : s.labels_)
+    s.offsets_[g + 1]++;
+  for (uint32_t g = 0; g < ngroups; g++)
+    s.offsets_[g + 1] += s.offsets_[g];
+  vector<uint32_t> pos(s.offsets_.begin(), s.offsets_.end() - 1);
+  s.members_.resize(n_);
+  for (size_t i = 0; i < n_; i++)
+    s.members_[pos[s.labels_[i]]++] = i;
+
+  samples_.emplace_back(move(s));
+}
+
+uint32_t
+sparse_zmatrix::count(size_t i, size_t j) const
+{
+  MICROSCOPES_DCHECK(i < n_ && j < n_, "invalid entity");
+  uint32_t c = 0;
+  for (const auto &s : samples_)
+    c += (s.labels_[i] == s.labels_[j]);
+  return c;
+}
+
+void
+sparse_zmatrix::accumulate_row(size_t i,
+                               uint32_t *acc,
+                               vector<uint32_t> &touched) const
+{
+  for (const auto &s : samples_) {
+    const uint32_t g = s.labels_[i];
+    const uint32_t *p = s.members_.data() + s.offsets_[g];
+    const uint32_t *end = s.members_.data() + s.offsets_[g + 1];
+    for (; p != end; ++p)
+      if (!acc[*p]++)
+        touched.push_back(*p);
+  }
+}
+
+namespace {
+
+// a worker's scratch space: acc holds row counts, and is zeroed again after
+// each row by walking touched
+struct row_scratch {
+  vector<uint32_t> acc_;
+  vector<uint32_t> touched_;
+  vector<candidate_t> candidates_;
+};
+
+// the rows of a chunk of a thresholded matrix
+struct csr_chunk {
+  vector<size_t> rowsizes_;
+  vector<uint32_t> indices_;
+  vector<float> data_;
+};
+
+} // namespace
+
+void
+sparse_zmatrix::thresholded(float threshold,
+                            vector<size_t> &indptr,
+                            vector<uint32_t> &indices,
+                            vector<float> &data) const
+{
+  MICROSCOPES_TRACE_SPAN("sparse_zmatrix::thresholded");
+  const size_t nsamples = samples_.size();
+  const size_t nchunks = (n_ + RowChunk - 1) / RowChunk;
+  const unsigned nthreads = effective_nthreads(nthreads_, nchunks);
+  vector<row_scratch> scratch(nthreads);
+  vector<csr_chunk> chunks(nchunks);
+  parallel_for(nchunks, nthreads, [&](unsigned t, size_t c) {
+    auto &sc = scratch[t];
+    if (sc.acc_.empty())
+      sc.acc_.resize(n_);
+    auto &out = chunks[c];
+    for (size_t i = c * RowChunk; i < min(n_, (c + 1) * RowChunk); i++) {
+      sc.touched_.clear();
+      accumulate_row(i, sc.acc_.data(), sc.touched_);
+      sort(sc.touched_.begin(), sc.touched_.end());
+      size_t rowsize = 0;
+      for (auto j : sc.touched_) {
+        const float z = float(sc.acc_[j]) / nsamples;
+        sc.acc_[j] = 0;
+        if (z < threshold)
+          continue;
+        out.indices_.push_back(j);
+        out.data_.push_back(z);
+        rowsize++;
+      }
+      out.rowsizes_.push_back(rowsize);
+    }
+  });
+
+  // stitch the chunks together, in row order
+  size_t nnz = 0;
+  for (const auto &c : chunks)
+    nnz += c.indices_.size();
+  indptr.clear();
+  indptr.reserve(n_ + 1);
+  indptr.push_back(0);
+  indices.clear();
+  indices.reserve(nnz);
+  data.clear();
+  data.reserve(nnz);
+  for (auto &c : chunks) {
+    for (auto r : c.rowsizes_)
+      indptr.push_back(indptr.back() + r);
+    indices.insert(indices.end(), c.indices_.begin(), c.indices_.end());
+    data.insert(data.end(), c.data_.begin(), c.data_.end());
+    c = csr_chunk();
+  }
+  MICROSCOPES_ASSERT(indptr.size() == n_ + 1);
+}
+
+void
+sparse_zmatrix::top_k(size_t k, ssize_t *neighbors, float *scores) const
+{
+  MICROSCOPES_TRACE_SPAN("sparse_zmatrix::top_k");
+  const size_t nsamples = samples_.size();
+  const size_t nchunks = (n_ + RowChunk - 1) / RowChunk;
+  const unsigned nthreads = effective_nthreads(nthreads_, nchunks);
+  vector<row_scratch> scratch(nthreads);
+  parallel_for(nchunks, nthreads, [&](unsigned t, size_t c) {
+    auto &sc = scratch[t];
+    if (sc.acc_.empty())
+      sc.acc_.resize(n_);
+    for (size_t i = c * RowChunk; i < min(n_, (c + 1) * RowChunk); i++) {
+      sc.touched_.clear();
+      accumulate_row(i, sc.acc_.data(), sc.touched_);
+      sc.candidates_.clear();
+      for (auto j : sc.touched_) {
+        if (j != i)
+          sc.candidates_.emplace_back(sc.acc_[j], j);
+        sc.acc_[j] = 0;
+      }
+      write_top_k(sc.candidates_, k, nsamples,
+                  neighbors + i * k, scores + i * k);
+    }
+  });
+}
@@ -1,4 +1,5 @@
 #include <microscopes/models/bbnc.hpp>
+#include <microscopes/common/metrics.hpp>
 #include <microscopes/io/schema.pb.h>
 #include <microscopes/common/util.hpp>
 #include <distributions/random.hpp>
@@ -18,20 +19,41 @@ using namespace microscopes::models;
 typedef BetaBernoulliNonConj::Group group_message_type;
 typedef BetaBernoulliNonConj::Shared shared_message_type;
 
+namespace {
+struct bbnc_group_layout {
+  void *vtable_;
+  uint32_t heads_;
+  uint32_t tails_;
+  float p_;
+};
+} // namespace
+
+static_assert(sizeof(bbnc_group) == sizeof(bbnc_group_layout),
+              "bbnc_group has grown");
+
 void
 bbnc_group::add_value(const hypers &m, const value_accessor &value, rng_t &rng)
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_ADD_VALUE);
   MICROSCOPES_ASSERT(value.shape() == 1);
   MICROSCOPES_ASSERT(!value.ismasked(0));
-  if (value.get<bool>(0))
+  // the counts are 32-bit, so check (even in release builds) rather than
+  // silently wrap
+  if (value.get<bool>(0)) {
+    MICROSCOPES_CHECK(heads_ < numeric_limits<uint32_t>::max(),
+                      "bbnc heads overflow");
     heads_++;
-  else
+  } else {
+    MICROSCOPES_CHECK(tails_ < numeric_limits<uint32_t>::max(),
+                      "bbnc tails overflow");
     tails_++;
+  }
 }
 
 void
 bbnc_group::remove_value(const hypers &m, const value_accessor &value, rng_t &rng)
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_REMOVE_VALUE);
   MICROSCOPES_ASSERT(value.shape() == 1);
   MICROSCOPES_ASSERT(!value.ismasked(0));
   if (value.get<bool>(0)) {
@@ -46,6 +68,7 @@ bbnc_group::remove_value(const hypers &m, const value_accessor &value, rng_t &rn
 float
 bbnc_group::score_value(const hypers &m, const value_accessor &value, rng_t &rng) const
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_VALUE);
   MICROSCOPES_ASSERT(p_ >= 0.0 && p_ <= 1.0);
   MICROSCOPES_ASSERT(value.shape() == 1);
   MICROSCOPES_ASSERT(!value.ismasked(0));
@@ -61,14 +84,16 @@ fast_lbeta(float a, float b)
 float
 bbnc_group::score_data(const hypers &m, rng_t &rng) const
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_DATA);
   if (p_ < 0.0 || p_ > 1.0)
     return -numeric_limits<float>::infinity();
-  const float alpha = static_cast<const bbnc_hypers &>(m).alpha_;
-  const float beta = static_cast<const bbnc_hypers &>(m).beta_;
+  const bbnc_hypers &h = static_cast<const bbnc_hypers &>(m);
+  const float log_p = fast_log(p_);
+  const float log_1mp = fast_log(1.-p_);
   const float score_prior =
-    (alpha-1.)*fast_log(p_) + (beta-1.)*fast_log(1.-p_) - fast_lbeta(alpha, beta);
+    (h.alpha_-1.)*log_p + (h.beta_-1.)*log_1mp - h.lbeta();
   const float score_likelihood =
-    float(heads_)*fast_log(p_) + float(tails_)*fast_log(1.-p_);
+    float(heads_)*log_p + float(tails_)*log_1mp;
   return score_prior + score_likelihood;
 }
 
@@ -80,10 +105,23 @@ bbnc_group::sample_value(const hypers &m, value_mutator &value, rng_t &rng) cons
   value.set<bool>(sample_bernoulli(rng, p_), 0);
 }
 
+void
+bbnc_group::merge(const hypers &m, const group &g, rng_t &rng)
+{
+  // p is per-group state, not a suff stat, so it is left untouched
+  const bbnc_group &that = static_cast<const bbnc_group &>(g);
+  MICROSCOPES_CHECK(
+      uint64_t(heads_) + that.heads_ <= numeric_limits<uint32_t>::max() &&
+      uint64_t(tails_) + that.tails_ <= numeric_limits<uint32_t>::max(),
+      "bbnc counts overflow");
+  heads_ += that.heads_;
+  tails_ += that.tails_;
+}
+
 suffstats_bag_t
 bbnc_group::get_ss() const
 {
-  group_message_type m;
+  group_message_type &m = util::scratch_message<group_message_type>();
   m.set_p(p_);
   m.set_heads(heads_);
   m.set_tails(tails_);
@@ -93,7 +131,7 @@ bbnc_group::get_ss() const
 void
 bbnc_group::set_ss(const suffstats_bag_t &ss)
 {
-  group_message_type m;
+  group_message_type &m = util::scratch_message<group_message_type>();
   util::protobuf_from_string(m, ss);
   p_ = m.p();
   heads_ = m.heads();
@@ -106,6 +144,27 @@ bbnc_group::set_ss(const group &ss)
   *this = static_cast<const bbnc_group &>(ss);
 }
 
+void
+bbnc_group::dump_ss(snapshot_writer &w) const
+{
+  w.write<float>(p_);
+  w.write<uint64_t>(heads_);
+  w.write<uint64_t>(tails_);
+}
+
+void
+bbnc_group::load_ss(snapshot_reader &r)
+{
+  p_ = r.read<float>();
+  const uint64_t heads = r.read<uint64_t>();
+  const uint64_t tails = r.read<uint64_t>();
+  MICROSCOPES_CHECK(heads <= numeric_limits<uint32_t>::max() &&
+                    tails <= numeric_limits<uint32_t>::max(),
+                    "bbnc counts overflow");
+  heads_ = heads;
+  tails_ = tails;
+}
+
 value_mutator
 bbnc_group::get_ss_mutator(const string &key)
 {
@@ -129,13 +188,19 @@ shared_ptr<group>
 bbnc_hypers::create_group(rng_t &rng) const
 {
   CreateFeatureGroupInvocations_++;
+  return bbnc_hypers::create_scratch_group(rng);
+}
+
+shared_ptr<group>
+bbnc_hypers::create_scratch_group(rng_t &rng) const
+{
   return make_shared<bbnc_group>(sample_beta(rng, alpha_, beta_));
 }
 
 hyperparam_bag_t
 bbnc_hypers::get_hp() const
 {
-  shared_message_type m;
+  shared_message_type &m = util::scratch_message<shared_message_type>();
   m.set_alpha(alpha_);
   m.set_beta(beta_);
   return util::protobuf_to_string(m);
@@ -144,10 +209,11 @@ bbnc_hypers::get_hp() const
 void
 bbnc_hypers::set_hp(const hyperparam_bag_t &hp)
 {
-  shared_message_type m;
+  shared_message_type &m = util::scratch_message<shared_message_type>();
   util::protobuf_from_string(m, hp);
   alpha_ = m.alpha();
   beta_ = m.beta();
+  changed();
 }
 
 void
@@ -160,12 +226,26 @@ value_mutator
 bbnc_hypers::get_hp_mutator(const string &key)
 {
   if (key == "alpha")
-    return value_mutator(&alpha_);
+    return notifying(value_mutator(&alpha_));
   if (key == "beta")
-    return value_mutator(&beta_);
+    return notifying(value_mutator(&beta_));
   throw runtime_error("unknown key: " + key);
 }
 
+float
+bbnc_hypers::compute_lbeta() const
+{
+  return fast_lbeta(alpha_, beta_);
+}
+
+void
+bbnc_hypers::changed()
+{
+  lbeta_ = compute_lbeta();
+  lbeta_alpha_ = alpha_;
+  lbeta_beta_ = beta_;
+}
+
 string
 bbnc_hypers::debug_str() const
 {
@@ -174,8 +254,8 @@ bbnc_hypers::debug_str() const
   return oss.str();
 }
 
-size_t
-bbnc_hypers::CreateFeatureGroupInvocations_ = 0;
+atomic<size_t>
+bbnc_hypers::CreateFeatureGroupInvocations_(0);
 
 runtime_type
 bbnc_model::get_runtime_type() const
@@ -1,13 +1,63 @@
 #include <microscopes/models/distributions.hpp>
+
+#include <atomic>
+
+using namespace std;
 using namespace distributions;
 
 namespace distributions {
-template struct DirichletDiscrete<128>;
+#define DISTRIB_INSTANTIATE_DD(n) \
+  template struct DirichletDiscrete<n>;
+DISTRIB_FOR_EACH_DD_SIZE(DISTRIB_INSTANTIATE_DD)
+#undef DISTRIB_INSTANTIATE_DD
 }
 
 namespace microscopes {
 namespace models {
 
+uint64_t
+detail::next_hypers_stamp()
+{
+  static std::atomic<uint64_t> next(1);
+  return next++;
+}
+
+shared_ptr<hypers>
+detail::create_dd_hypers(unsigned dim)
+{
+#define DISTRIB_DD_CASE(n) \
+  if (dim <= n) \
+    return make_shared<models::distributions_hypers<DirichletDiscrete ## n>>(dim);
+  DISTRIB_FOR_EACH_DD_SIZE(DISTRIB_DD_CASE)
+#undef DISTRIB_DD_CASE
+  return make_shared<models::distributions_hypers<DirichletDiscreteV>>(dim);
+}
+
+namespace {
+template <typename T>
+struct group_layout {
+  void *vtable_;
+  typename T::Group repr_;
+};
+} // namespace
+
+// there may be millions of groups, so they should stay a vtable pointer plus
+// the distributions suff stats.
+//
+// there is no compact (uint16 counter) mode. it would only pay off for
+// GammaPoisson, going from 24 to 16 bytes (uint16 count/sum, float
+// log_prod); BetaBernoulli and BetaNegativeBinomial (16 bytes) and
+// NormalInverseChiSq (24, for its two floats) stay the same size once the
+// vtable pointer and 8 byte alignment are counted. promoting a group on
+// overflow would also mean replacing it, which we cannot do while callers
+// hold it through a shared_ptr<group>
+#define DISTRIB_CHECK_GROUP_SIZE(name, fields) \
+  static_assert( \
+      sizeof(distributions_group<name>) == sizeof(group_layout<name>), \
+      "distributions_group<" #name "> has grown");
+DISTRIB_FOR_EACH_DISTRIBUTION_WITH_SCALAR_GROUP_FIELDS(DISTRIB_CHECK_GROUP_SIZE)
+#undef DISTRIB_CHECK_GROUP_SIZE
+
 #define DISTRIB_EXPLICIT_INSTANTIATE(x) \
   template class distributions_group< x >; \
   template class distributions_hypers< x >; \
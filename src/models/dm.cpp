@@ -1,76 +1,192 @@
 #include <microscopes/models/dm.hpp>
+#include <microscopes/common/metrics.hpp>
+#include <microscopes/common/special.hpp>
+#include <microscopes/common/random.hpp>
 #include <distributions/special.hpp>
 
+#include <algorithm>
+
 using namespace std;
 using namespace distributions;
 using namespace microscopes::common;
 using namespace microscopes::models;
 
+const unsigned dm_group::SparseThreshold;
+
+// the nonzero entries of value, and their sum. the returned vector is
+// per-thread scratch space, valid until the next call
+static inline const dm_group::sparse_counts_t &
+nonzero_entries(const value_accessor &value, size_t k, unsigned &sum)
+{
+  static thread_local dm_group::sparse_counts_t xs;
+  xs.clear();
+  sum = 0;
+  for (size_t i = 0; i < k; i++) {
+    const unsigned xi = value.get<unsigned>(i);
+    if (!xi)
+      continue;
+    xs.emplace_back(i, xi);
+    sum += xi;
+  }
+  return xs;
+}
+
+// dst += src, in place
+static void
+merge_sparse(dm_group::sparse_counts_t &dst, const dm_group::sparse_counts_t &src)
+{
+  size_t nnew = 0;
+  for (size_t i = 0, j = 0; i < src.size(); i++) {
+    while (j < dst.size() && dst[j].first < src[i].first)
+      j++;
+    if (j == dst.size() || dst[j].first != src[i].first)
+      nnew++;
+  }
+
+  // merge from the back, so that nothing has to be shifted twice
+  ssize_t a = dst.size() - 1, b = src.size() - 1;
+  ssize_t out = dst.size() + nnew - 1;
+  dst.resize(dst.size() + nnew);
+  while (b >= 0) {
+    if (a >= 0 && dst[a].first > src[b].first) {
+      dst[out--] = dst[a--];
+    } else if (a >= 0 && dst[a].first == src[b].first) {
+      dst[out] = dst[a--];
+      dst[out--].second += src[b--].second;
+    } else {
+      dst[out--] = src[b--];
+    }
+  }
+}
+
+unsigned
+dm_group::count(size_t i) const
+{
+  MICROSCOPES_ASSERT(i < categories());
+  if (!sparse_)
+    return counts_[i];
+  const auto it = lower_bound(
+      nonzeros_.begin(), nonzeros_.end(), make_pair(unsigned(i), 0U));
+  return (it != nonzeros_.end() && it->first == i) ? it->second : 0;
+}
+
+void
+dm_group::set_counts(const vector<unsigned> &counts)
+{
+  MICROSCOPES_ASSERT(counts.size() == categories());
+  count_sum_ = 0;
+  for (auto c : counts)
+    count_sum_ += c;
+  if (!sparse_) {
+    counts_ = counts;
+    return;
+  }
+  nonzeros_.clear();
+  for (size_t i = 0; i < counts.size(); i++)
+    if (counts[i])
+      nonzeros_.emplace_back(i, counts[i]);
+}
+
 void
 dm_group::add_value(const hypers &m, const value_accessor &value, rng_t &rng)
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_ADD_VALUE);
   MICROSCOPES_ASSERT(value.shape() == categories());
-  unsigned count_sum = 0;
-  for (size_t i = 0; i < categories(); i++) {
-    const unsigned ni = value.get<unsigned>(i);
-    count_sum += ni;
-    counts_[i] += ni;
-    ratio_ -= fast_lgamma(ni + 1);
+  unsigned x_sum;
+  const auto &xs = nonzero_entries(value, categories(), x_sum);
+  // zero entries contribute lgamma(1) = 0 to the ratio
+  for (const auto &p : xs)
+    ratio_ -= special::lgamma_int(p.second + 1);
+  ratio_ += special::lgamma_int(x_sum + 1);
+  count_sum_ += x_sum;
+  if (sparse_) {
+    merge_sparse(nonzeros_, xs);
+  } else {
+    for (const auto &p : xs)
+      counts_[p.first] += p.second;
   }
-  ratio_ += fast_lgamma(count_sum + 1);
 }
 
 void
 dm_group::remove_value(const hypers &m, const value_accessor &value, rng_t &rng)
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_REMOVE_VALUE);
   MICROSCOPES_ASSERT(value.shape() == categories());
-  unsigned count_sum = 0;
-  for (size_t i = 0; i < categories(); i++) {
-    const unsigned ni = value.get<unsigned>(i);
-    count_sum += ni;
-    MICROSCOPES_ASSERT(counts_[i] >= ni);
-    counts_[i] -= ni;
-    ratio_ += fast_lgamma(ni + 1);
+  unsigned x_sum;
+  const auto &xs = nonzero_entries(value, categories(), x_sum);
+  for (const auto &p : xs)
+    ratio_ += special::lgamma_int(p.second + 1);
+  ratio_ -= special::lgamma_int(x_sum + 1);
+  MICROSCOPES_ASSERT(count_sum_ >= x_sum);
+  count_sum_ -= x_sum;
+  if (sparse_) {
+    size_t j = 0;
+    for (const auto &p : xs) {
+      while (j < nonzeros_.size() && nonzeros_[j].first < p.first)
+        j++;
+      MICROSCOPES_ASSERT(j < nonzeros_.size() && nonzeros_[j].first == p.first);
+      MICROSCOPES_ASSERT(nonzeros_[j].second >= p.second);
+      nonzeros_[j].second -= p.second;
+    }
+    nonzeros_.erase(
+        remove_if(nonzeros_.begin(), nonzeros_.end(),
+          [](const pair<unsigned, unsigned> &p) { return !p.second; }),
+        nonzeros_.end());
+  } else {
+    for (const auto &p : xs) {
+      MICROSCOPES_ASSERT(counts_[p.first] >= p.second);
+      counts_[p.first] -= p.second;
+    }
   }
-  ratio_ -= fast_lgamma(count_sum + 1);
 }
 
 float
 dm_group::score_value(const hypers &m, const value_accessor &value, rng_t &rng) const
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_VALUE);
   const dm_hypers &h = static_cast<const dm_hypers &>(m);
   MICROSCOPES_ASSERT(categories() == h.categories());
   MICROSCOPES_ASSERT(value.shape() == categories());
   // Sec. 3.2:
   // http://www2.math.su.se/matstat/reports/seriec/2014/rep6/report.pdf
+  //
+  // categories with xi = 0 contribute nothing, so we only visit the nonzero
+  // entries of value
 
-  float score = 0.;
-  unsigned x_sum = 0;
-  float a_sum = 0.;
-  unsigned n_sum = 0;
+  unsigned x_sum;
+  const auto &xs = nonzero_entries(value, categories(), x_sum);
+  const unsigned n_sum = count_sum_;
 
-  for (size_t i = 0; i < categories(); i++) {
-    const unsigned xi = value.get<unsigned>(i);
-    const float ai = h.alphas()[i];
-    const unsigned ni = counts_[i];
-    x_sum += xi;
-    a_sum += ai;
-    n_sum += ni;
+  const lgamma_shifted_table *t = h.lgamma_table(n_sum + x_sum);
+
+  float score = 0.;
+  size_t j = 0;
+  for (const auto &p : xs) {
+    const unsigned i = p.first;
+    const unsigned xi = p.second;
+    unsigned ni;
+    if (sparse_) {
+      while (j < nonzeros_.size() && nonzeros_[j].first < i)
+        j++;
+      ni = (j < nonzeros_.size() && nonzeros_[j].first == i) ?
+        nonzeros_[j].second : 0;
+    } else {
+      ni = counts_[i];
+    }
 
-    const float effective_ai = ai + ni;
-    score += fast_lgamma(effective_ai + xi)
-           - fast_lgamma(effective_ai);
+    score += t->lgamma(i, ni + xi)
+           - t->lgamma(i, ni);
 
     // partition denominator
-    score -= fast_lgamma(xi + 1);
+    score -= special::lgamma_int(xi + 1);
   }
 
   // partition numerator
-  score += fast_lgamma(x_sum + 1);
+  score += special::lgamma_int(x_sum + 1);
 
   // effective alpha sum
-  score += fast_lgamma(a_sum + n_sum)
-         - fast_lgamma(a_sum + n_sum + x_sum);
+  score += t->lgamma_sum(n_sum)
+         - t->lgamma_sum(n_sum + x_sum);
 
   return score;
 }
@@ -78,34 +194,156 @@ dm_group::score_value(const hypers &m, const value_accessor &value, rng_t &rng)
 float
 dm_group::score_data(const hypers &m, rng_t &rng) const
 {
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_DATA);
   const dm_hypers &h = static_cast<const dm_hypers &>(m);
   MICROSCOPES_ASSERT(categories() == h.categories());
+
+  const lgamma_shifted_table *t = h.lgamma_table(count_sum_);
   float score = ratio_;
-  float alpha_sum = 0.;
-  unsigned count_sum = 0;
-  for (size_t i = 0; i < categories(); i++) {
-    const float alpha = h.alphas()[i];
-    const unsigned count = counts_[i];
-    alpha_sum += alpha;
-    count_sum += count;
-    score += fast_lgamma(count + alpha)
-           - fast_lgamma(alpha);
+  // categories with a zero count contribute nothing
+  if (sparse_) {
+    for (const auto &p : nonzeros_)
+      score += t->lgamma(p.first, p.second)
+             - t->lgamma(p.first, 0);
+  } else {
+    for (size_t i = 0; i < categories(); i++)
+      if (counts_[i])
+        score += t->lgamma(i, counts_[i])
+               - t->lgamma(i, 0);
   }
-  score += fast_lgamma(alpha_sum)
-         - fast_lgamma(alpha_sum + count_sum);
+  score += t->lgamma_sum(0)
+         - t->lgamma_sum(count_sum_);
   return score;
 }
 
 void
 dm_group::sample_value(const hypers &m, value_mutator &value, rng_t &rng) const
+{
+  MICROSCOPES_ASSERT(value.shape() == categories());
+  // the # of trials is the row sum of the template row already in value
+  const value_accessor acc = value.accessor();
+  unsigned n = 0;
+  for (size_t i = 0; i < categories(); i++)
+    n += acc.get<unsigned>(i);
+  sample_value(m, n, value, rng);
+}
+
+void
+dm_group::sample_value(const hypers &m, unsigned n, value_mutator &value, rng_t &rng) const
 {
   const dm_hypers &h = static_cast<const dm_hypers &>(m);
-  (void)h;
   MICROSCOPES_ASSERT(categories() == h.categories());
   MICROSCOPES_ASSERT(value.shape() == categories());
-  // XXX: we need a way to specify n, the # of samples from a categorical
-  // distribution!
-  //
-  // sample_value() currently doesn't fit into our framework
-  throw runtime_error("multinomial sampling unimplemented");
+
+  static thread_local vector<float> posterior;
+  static thread_local vector<float> theta;
+  static thread_local vector<unsigned> xs;
+  const size_t k = categories();
+  posterior.assign(h.alphas().begin(), h.alphas().end());
+  if (sparse_) {
+    for (const auto &p : nonzeros_)
+      posterior[p.first] += p.second;
+  } else {
+    for (size_t i = 0; i < k; i++)
+      posterior[i] += counts_[i];
+  }
+  theta.resize(k);
+  xs.resize(k);
+
+  // the posterior predictive: theta ~ Dir(alpha + counts), x ~ Mult(n, theta)
+  random::sample_dirichlet(posterior.data(), k, theta.data(), rng);
+  random::sample_multinomial(n, theta.data(), k, xs.data(), rng);
+  for (size_t i = 0; i < k; i++)
+    value.set<unsigned>(xs[i], i);
+}
+
+void
+dm_group::merge(const hypers &m, const group &g, rng_t &rng)
+{
+  const dm_group &that = static_cast<const dm_group &>(g);
+  MICROSCOPES_ASSERT(categories() == that.categories());
+  if (sparse_) {
+    merge_sparse(nonzeros_, that.nonzeros_);
+  } else {
+    for (size_t i = 0; i < categories(); i++)
+      counts_[i] += that.counts_[i];
+  }
+  count_sum_ += that.count_sum_;
+  ratio_ += that.ratio_;
+}
+
+suffstats_bag_t
+dm_group::get_ss() const
+{
+  message_type &m = util::scratch_message<message_type>();
+  if (sparse_) {
+    size_t j = 0;
+    for (size_t i = 0; i < categories(); i++) {
+      if (j < nonzeros_.size() && nonzeros_[j].first == i)
+        m.add_counts(nonzeros_[j++].second);
+      else
+        m.add_counts(0);
+    }
+  } else {
+    for (auto c : counts_)
+      m.add_counts(c);
+  }
+  m.set_ratio(ratio_);
+  return util::protobuf_to_string(m);
+}
+
+void
+dm_group::set_ss(const suffstats_bag_t &ss)
+{
+  message_type &m = util::scratch_message<message_type>();
+  util::protobuf_from_string(m, ss);
+  MICROSCOPES_DCHECK(
+      (size_t)m.counts_size() == categories(),
+      "# categories mismatch");
+  MICROSCOPES_DCHECK(m.ratio() >= 0., "negative partition");
+  set_counts(vector<unsigned>(m.counts().begin(), m.counts().end()));
+  ratio_ = m.ratio();
+}
+
+void
+dm_group::dump_ss(snapshot_writer &w) const
+{
+  if (sparse_) {
+    vector<unsigned> indices, counts;
+    indices.reserve(nonzeros_.size());
+    counts.reserve(nonzeros_.size());
+    for (const auto &p : nonzeros_) {
+      indices.push_back(p.first);
+      counts.push_back(p.second);
+    }
+    w.write_array(indices);
+    w.write_array(counts);
+  } else {
+    w.write_array(counts_);
+  }
+  w.write(ratio_);
+}
+
+void
+dm_group::load_ss(snapshot_reader &r)
+{
+  size_t n;
+  if (sparse_) {
+    const unsigned *indices = r.read_array<unsigned>(n);
+    size_t n1;
+    const unsigned *counts = r.read_array<unsigned>(n1);
+    MICROSCOPES_DCHECK(n == n1, "corrupt sparse counts");
+    nonzeros_.clear();
+    count_sum_ = 0;
+    for (size_t i = 0; i < n; i++) {
+      MICROSCOPES_DCHECK(indices[i] < categories(), "corrupt sparse counts");
+      nonzeros_.emplace_back(indices[i], counts[i]);
+      count_sum_ += counts[i];
+    }
+  } else {
+    const unsigned *px = r.read_array<unsigned>(n);
+    MICROSCOPES_DCHECK(n == categories(), "# categories mismatch");
+    set_counts(vector<unsigned>(px, px + n));
+  }
+  ratio_ = r.read<float>();
 }
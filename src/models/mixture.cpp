@@ -0,0 +1,98 @@
+#include <microscopes/models/mixture.hpp>
+#include <microscopes/common/metrics.hpp>
+#include <microscopes/common/trace.hpp>
+
+#include <algorithm>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::models;
+
+shared_ptr<mixture>
+hypers::create_mixture() const
+{
+  return make_shared<mixture>();
+}
+
+size_t
+mixture::index(size_t gid) const
+{
+  const auto it = lower_bound(gids_.begin(), gids_.end(), gid);
+  MICROSCOPES_DCHECK(it != gids_.end() && *it == gid, "invalid gid");
+  return it - gids_.begin();
+}
+
+const group &
+mixture::create_group(size_t gid, const hypers &h, rng_t &rng)
+{
+  auto g = h.create_group(rng);
+  create_group(gid, g, h, rng);
+  return *g;
+}
+
+void
+mixture::create_group(size_t gid, const shared_ptr<group> &g,
+                      const hypers &h, rng_t &rng)
+{
+  MICROSCOPES_DCHECK(g, "no group");
+  // group_manager hands out increasing gids, so this is usually an append
+  const auto it = lower_bound(gids_.begin(), gids_.end(), gid);
+  MICROSCOPES_DCHECK(it == gids_.end() || *it != gid, "group exists");
+  const size_t i = it - gids_.begin();
+  gids_.insert(it, gid);
+  groups_.insert(groups_.begin() + i, g);
+  group_created(i, h, rng);
+  synced();
+}
+
+void
+mixture::delete_group(size_t gid)
+{
+  const size_t i = index(gid);
+  group_deleted(i);
+  gids_.erase(gids_.begin() + i);
+  groups_.erase(groups_.begin() + i);
+  synced();
+}
+
+void
+mixture::add_value(size_t gid, const hypers &h,
+                   const value_accessor &value, rng_t &rng)
+{
+  MICROSCOPES_TRACE_SPAN_ARG("mixture::add_value", gid);
+  const size_t i = index(gid);
+  groups_[i]->add_value(h, value, rng);
+  group_changed(i, h, rng);
+  synced();
+}
+
+void
+mixture::remove_value(size_t gid, const hypers &h,
+                      const value_accessor &value, rng_t &rng)
+{
+  MICROSCOPES_TRACE_SPAN_ARG("mixture::remove_value", gid);
+  const size_t i = index(gid);
+  groups_[i]->remove_value(h, value, rng);
+  group_changed(i, h, rng);
+  synced();
+}
+
+float
+mixture::score_value(size_t gid, const hypers &h, const value_accessor &value,
+                     rng_t &rng) const
+{
+  check_synced();
+  return groups_[index(gid)]->score_value(h, value, rng);
+}
+
+void
+mixture::score_value_all_groups(const hypers &h, const value_accessor &value,
+                                float *out, rng_t &rng) const
+{
+  MICROSCOPES_METRIC_INC(M_MIXTURE_SCORE_VALUE);
+  MICROSCOPES_TRACE_SPAN("mixture::score_value_all_groups");
+  MICROSCOPES_METRIC_OBSERVE(H_MIXTURE_GROUPS, groups_.size());
+  check_synced();
+  for (size_t i = 0; i < groups_.size(); i++)
+    out[i] = groups_[i]->score_value(h, value, rng);
+}
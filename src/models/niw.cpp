@@ -0,0 +1,429 @@
+#include <microscopes/models/niw.hpp>
+#include <microscopes/common/metrics.hpp>
+#include <microscopes/common/special.hpp>
+
+#include <cmath>
+#include <random>
+#include <sstream>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::models;
+
+static const double LogPi = 1.1447298858494002;
+
+// shared by all dimensions, so that stamps are globally unique
+static atomic<uint64_t> NextStamp(1);
+
+// values are copied into per-thread scratch, so the hot paths do not allocate
+template <typename Vector>
+static inline const Vector &
+read_value(const value_accessor &value, unsigned dim)
+{
+  static thread_local Vector x;
+  MICROSCOPES_ASSERT(value.shape() == dim);
+  MICROSCOPES_ASSERT(!value.anymasked());
+  x.resize(dim);
+  for (unsigned i = 0; i < dim; i++)
+    x(i) = value.get<double>(i);
+  return x;
+}
+
+template <typename Matrix>
+static inline double
+logdet(const Eigen::LLT<Matrix> &llt)
+{
+  return 2. * llt.matrixLLT().diagonal().array().log().sum();
+}
+
+template <int D>
+niw_group<D>::niw_group(const niw_hypers<D> &h)
+  : count_(),
+    sum_x_(vector_type::Zero(h.dim())),
+    sum_xxT_(matrix_type::Zero(h.dim(), h.dim())),
+    stamp_(0),
+    post_(),
+    refresh_mutex_()
+{
+  refresh(h);
+}
+
+template <int D>
+niw_group<D> &
+niw_group<D>::operator=(const niw_group &that)
+{
+  count_ = that.count_;
+  sum_x_ = that.sum_x_;
+  sum_xxT_ = that.sum_xxT_;
+  post_ = that.post_;
+  stamp_.store(that.stamp_.load(memory_order_acquire), memory_order_release);
+  return *this;
+}
+
+template <int D>
+void
+niw_group<D>::compute_posterior(const niw_hypers<D> &h, posterior &p) const
+{
+  p.kappa_ = h.kappa0() + count_;
+  p.nu_ = h.nu0() + count_;
+  p.mu_ = (h.kappa0() * h.mu0() + sum_x_) / p.kappa_;
+  matrix_type psi_n = h.psi0() + sum_xxT_;
+  psi_n.noalias() += h.kappa0() * h.mu0() * h.mu0().transpose();
+  psi_n.noalias() -= p.kappa_ * p.mu_ * p.mu_.transpose();
+  p.llt_.compute(psi_n);
+  MICROSCOPES_ASSERT(p.llt_.info() == Eigen::Success);
+  p.logdet_ = logdet(p.llt_);
+}
+
+template <int D>
+void
+niw_group<D>::refresh(const niw_hypers<D> &h)
+{
+  compute_posterior(h, post_);
+  stamp_.store(h.stamp(), memory_order_release);
+}
+
+template <int D>
+const typename niw_group<D>::posterior &
+niw_group<D>::current(const niw_hypers<D> &h) const
+{
+  if (likely(stamp_.load(memory_order_acquire) == h.stamp()))
+    return post_;
+  // first use since the hypers changed (or since set_ss()). Concurrent
+  // scorers of this group (which all score against the same hypers) wait
+  // for whichever of them refreshes it
+  lock_guard<mutex> lock(refresh_mutex_);
+  if (stamp_.load(memory_order_relaxed) != h.stamp()) {
+    compute_posterior(h, post_);
+    stamp_.store(h.stamp(), memory_order_release);
+  }
+  return post_;
+}
+
+template <int D>
+void
+niw_group<D>::add_value(const hypers &m, const value_accessor &value, rng_t &rng)
+{
+  MICROSCOPES_METRIC_INC(M_GROUP_ADD_VALUE);
+  const niw_hypers<D> &h = static_cast<const niw_hypers<D> &>(m);
+  if (unlikely(!cached(h)))
+    refresh(h);
+  const vector_type &x = read_value<vector_type>(value, dim());
+
+  // Psi_{n+1} = Psi_n + kappa_n/(kappa_n+1) (x - mu_n)(x - mu_n)^T
+  static thread_local vector_type diff;
+  diff = x - post_.mu_;
+  const double k = post_.kappa_;
+  post_.llt_.rankUpdate(diff, k / (k + 1.));
+  post_.mu_ = (k * post_.mu_ + x) / (k + 1.);
+  post_.kappa_ += 1.;
+  post_.nu_ += 1.;
+  post_.logdet_ = logdet(post_.llt_);
+
+  count_++;
+  sum_x_ += x;
+  sum_xxT_.noalias() += x * x.transpose();
+}
+
+template <int D>
+void
+niw_group<D>::remove_value(const hypers &m, const value_accessor &value, rng_t &rng)
+{
+  MICROSCOPES_METRIC_INC(M_GROUP_REMOVE_VALUE);
+  const niw_hypers<D> &h = static_cast<const niw_hypers<D> &>(m);
+  MICROSCOPES_ASSERT(count_ > 0);
+  const vector_type &x = read_value<vector_type>(value, dim());
+
+  count_--;
+  sum_x_ -= x;
+  sum_xxT_.noalias() -= x * x.transpose();
+
+  if (unlikely(!cached(h)) || !count_) {
+    // an empty group is reset exactly, dropping any accumulated rounding
+    refresh(h);
+    return;
+  }
+
+  // the inverse of add_value(): with (kappa_n, mu_n) the posterior after
+  // removal, Psi_n = Psi_{n+1} - kappa_n/(kappa_n+1) (x - mu_n)(x - mu_n)^T
+  const double k = post_.kappa_ - 1.;
+  post_.mu_ = (post_.kappa_ * post_.mu_ - x) / k;
+  static thread_local vector_type diff;
+  diff = x - post_.mu_;
+  post_.llt_.rankUpdate(diff, -k / (k + 1.));
+  post_.kappa_ = k;
+  post_.nu_ -= 1.;
+  if (unlikely(post_.llt_.info() != Eigen::Success)) {
+    // the downdate lost positive definiteness to rounding
+    refresh(h);
+    return;
+  }
+  post_.logdet_ = logdet(post_.llt_);
+}
+
+template <int D>
+float
+niw_group<D>::score_value(const hypers &m, const value_accessor &value, rng_t &rng) const
+{
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_VALUE);
+  // the posterior predictive is a multivariate t with nu_n - d + 1 degrees of
+  // freedom, location mu_n and scale Psi_n (kappa_n + 1)/(kappa_n dof)
+  const niw_hypers<D> &h = static_cast<const niw_hypers<D> &>(m);
+  const posterior &p = current(h);
+  const double d = dim();
+  const double dof = p.nu_ - d + 1.;
+  const double c = (p.kappa_ + 1.) / (p.kappa_ * dof);
+
+  static thread_local vector_type z;
+  z = read_value<vector_type>(value, dim()) - p.mu_;
+  p.llt_.matrixL().solveInPlace(z);
+  const double q = z.squaredNorm() / c;
+  const double logdet_sigma = p.logdet_ + d * log(c);
+
+  return lgamma(0.5 * (dof + d)) - lgamma(0.5 * dof)
+       - 0.5 * d * (log(dof) + LogPi)
+       - 0.5 * logdet_sigma
+       - 0.5 * (dof + d) * log1p(q / dof);
+}
+
+template <int D>
+float
+niw_group<D>::score_data(const hypers &m, rng_t &rng) const
+{
+  MICROSCOPES_METRIC_INC(M_GROUP_SCORE_DATA);
+  const niw_hypers<D> &h = static_cast<const niw_hypers<D> &>(m);
+  const posterior &p = current(h);
+  const unsigned d = dim();
+  return -0.5 * double(count_) * d * LogPi
+       + special::lmultigamma(d, 0.5 * p.nu_)
+       - special::lmultigamma(d, 0.5 * h.nu0())
+       + 0.5 * h.nu0() * h.logdet_psi0()
+       - 0.5 * p.nu_ * p.logdet_
+       + 0.5 * d * (log(h.kappa0()) - log(p.kappa_));
+}
+
+template <int D>
+void
+niw_group<D>::sample_value(const hypers &m, value_mutator &value, rng_t &rng) const
+{
+  // draw from the multivariate t posterior predictive (see score_value()):
+  // x = mu_n + sqrt(c dof / w) L z, with z ~ N(0, I), w ~ chi^2(dof)
+  const niw_hypers<D> &h = static_cast<const niw_hypers<D> &>(m);
+  MICROSCOPES_ASSERT(value.shape() == dim());
+  const posterior &p = current(h);
+  const double d = dim();
+  const double dof = p.nu_ - d + 1.;
+  const double c = (p.kappa_ + 1.) / (p.kappa_ * dof);
+
+  static thread_local vector_type z;
+  z.resize(dim());
+  normal_distribution<double> norm;
+  for (unsigned i = 0; i < dim(); i++)
+    z(i) = norm(rng);
+  const double w = chi_squared_distribution<double>(dof)(rng);
+  z = p.llt_.matrixL() * z;
+  z *= sqrt(c * dof / w);
+  z += p.mu_;
+  for (unsigned i = 0; i < dim(); i++)
+    value.set<double>(z(i), i);
+}
+
+template <int D>
+void
+niw_group<D>::merge(const hypers &m, const group &g, rng_t &rng)
+{
+  const niw_group<D> &that = static_cast<const niw_group<D> &>(g);
+  MICROSCOPES_ASSERT(dim() == that.dim());
+  count_ += that.count_;
+  sum_x_ += that.sum_x_;
+  sum_xxT_ += that.sum_xxT_;
+  refresh(static_cast<const niw_hypers<D> &>(m));
+}
+
+template <int D>
+suffstats_bag_t
+niw_group<D>::get_ss() const
+{
+  message_type &m = util::scratch_message<message_type>();
+  m.set_count(count_);
+  for (unsigned i = 0; i < dim(); i++)
+    m.add_sum_x(sum_x_(i));
+  for (unsigned i = 0; i < dim(); i++)
+    for (unsigned j = 0; j < dim(); j++)
+      m.add_sum_xxt(sum_xxT_(i, j));
+  return util::protobuf_to_string(m);
+}
+
+template <int D>
+void
+niw_group<D>::set_ss(const suffstats_bag_t &ss)
+{
+  message_type &m = util::scratch_message<message_type>();
+  util::protobuf_from_string(m, ss);
+  MICROSCOPES_DCHECK((unsigned)m.sum_x_size() == dim(), "dimension mismatch");
+  MICROSCOPES_DCHECK(
+      (unsigned)m.sum_xxt_size() == dim() * dim(), "dimension mismatch");
+  count_ = m.count();
+  for (unsigned i = 0; i < dim(); i++)
+    sum_x_(i) = m.sum_x(i);
+  for (unsigned i = 0; i < dim(); i++)
+    for (unsigned j = 0; j < dim(); j++)
+      sum_xxT_(i, j) = m.sum_xxt(i * dim() + j);
+  stamp_ = 0;
+}
+
+template <int D>
+void
+niw_group<D>::dump_ss(snapshot_writer &w) const
+{
+  w.write<uint32_t>(count_);
+  w.write_array(sum_x_.data(), sum_x_.size());
+  w.write_array(sum_xxT_.data(), sum_xxT_.size());
+}
+
+template <int D>
+void
+niw_group<D>::load_ss(snapshot_reader &r)
+{
+  count_ = r.read<uint32_t>();
+  size_t n;
+  const double *px = r.read_array<double>(n);
+  MICROSCOPES_DCHECK(n == dim(), "dimension mismatch");
+  sum_x_ = Eigen::Map<const vector_type>(px, n);
+  px = r.read_array<double>(n);
+  MICROSCOPES_DCHECK(n == dim() * dim(), "dimension mismatch");
+  sum_xxT_ = Eigen::Map<const matrix_type>(px, dim(), dim());
+  stamp_ = 0;
+}
+
+template <int D>
+string
+niw_group<D>::debug_str() const
+{
+  ostringstream oss;
+  oss << "{count:" << count_
+      << ", sum_x:" << sum_x_.transpose()
+      << ", sum_xxT:" << sum_xxT_
+      << "}";
+  return oss.str();
+}
+
+template <int D>
+niw_hypers<D>::niw_hypers(unsigned dim)
+  : mu0_(vector_type::Zero(dim)),
+    kappa0_(1.),
+    psi0_(matrix_type::Identity(dim, dim)),
+    nu0_(dim),
+    logdet_psi0_(),
+    stamp_()
+{
+  changed();
+}
+
+template <int D>
+void
+niw_hypers<D>::changed()
+{
+  Eigen::LLT<matrix_type> llt(psi0_);
+  MICROSCOPES_ASSERT(llt.info() == Eigen::Success);
+  logdet_psi0_ = logdet(llt);
+  stamp_ = NextStamp++;
+}
+
+template <int D>
+void
+niw_hypers<D>::set_hp(const hypers &m)
+{
+  const auto &that = static_cast<const niw_hypers<D> &>(m);
+  MICROSCOPES_DCHECK(dim() == that.dim(), "dimension mismatch");
+  mu0_ = that.mu0_;
+  kappa0_ = that.kappa0_;
+  psi0_ = that.psi0_;
+  nu0_ = that.nu0_;
+  changed();
+}
+
+template <int D>
+hyperparam_bag_t
+niw_hypers<D>::get_hp() const
+{
+  message_type &m = util::scratch_message<message_type>();
+  for (unsigned i = 0; i < dim(); i++)
+    m.add_mu(mu0_(i));
+  m.set_kappa(kappa0_);
+  for (unsigned i = 0; i < dim(); i++)
+    for (unsigned j = 0; j < dim(); j++)
+      m.add_psi(psi0_(i, j));
+  m.set_nu(nu0_);
+  return util::protobuf_to_string(m);
+}
+
+template <int D>
+void
+niw_hypers<D>::set_hp(const hyperparam_bag_t &hp)
+{
+  message_type &m = util::scratch_message<message_type>();
+  util::protobuf_from_string(m, hp);
+  MICROSCOPES_CHECK((unsigned)m.mu_size() == dim(), "dimension mismatch");
+  MICROSCOPES_CHECK(
+      (unsigned)m.psi_size() == dim() * dim(), "dimension mismatch");
+  MICROSCOPES_CHECK(m.kappa() > 0., "kappa must be positive");
+  MICROSCOPES_CHECK(m.nu() > double(dim()) - 1., "nu must be > dim - 1");
+  matrix_type psi(dim(), dim());
+  for (unsigned i = 0; i < dim(); i++)
+    for (unsigned j = 0; j < dim(); j++)
+      psi(i, j) = m.psi(i * dim() + j);
+  MICROSCOPES_CHECK(
+      psi.isApprox(psi.transpose()) &&
+      Eigen::LLT<matrix_type>(psi).info() == Eigen::Success,
+      "psi must be symmetric positive definite");
+  for (unsigned i = 0; i < dim(); i++)
+    mu0_(i) = m.mu(i);
+  kappa0_ = m.kappa();
+  psi0_ = psi;
+  nu0_ = m.nu();
+  changed();
+}
+
+template <int D>
+string
+niw_hypers<D>::debug_str() const
+{
+  ostringstream oss;
+  oss << "{mu:" << mu0_.transpose()
+      << ", kappa:" << kappa0_
+      << ", psi:" << psi0_
+      << ", nu:" << nu0_
+      << "}";
+  return oss.str();
+}
+
+shared_ptr<hypers>
+niw_model::create_hypers() const
+{
+  switch (dim_) {
+#define MICROSCOPES_NIW_CASE(d) \
+  case d: return make_shared<niw_hypers<d>>(dim_);
+  MICROSCOPES_NIW_CASE(2)
+  MICROSCOPES_NIW_CASE(3)
+  MICROSCOPES_NIW_CASE(4)
+  MICROSCOPES_NIW_CASE(5)
+  MICROSCOPES_NIW_CASE(6)
+  MICROSCOPES_NIW_CASE(7)
+  MICROSCOPES_NIW_CASE(8)
+#undef MICROSCOPES_NIW_CASE
+  default: return make_shared<niw_hypers<Eigen::Dynamic>>(dim_);
+  }
+}
+
+namespace microscopes {
+namespace models {
+
+#define MICROSCOPES_NIW_EXPLICIT_INSTANTIATE(d) \
+  template class niw_group<d>; \
+  template class niw_hypers<d>;
+MICROSCOPES_NIW_FOR_EACH_DIM(MICROSCOPES_NIW_EXPLICIT_INSTANTIATE)
+#undef MICROSCOPES_NIW_EXPLICIT_INSTANTIATE
+
+} // namespace models
+} // namespace microscopes
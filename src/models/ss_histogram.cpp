@@ -0,0 +1,58 @@
+#include <microscopes/models/ss_histogram.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/common/assert.hpp>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::models;
+
+const string &
+ss_histogram::key(const group &g)
+{
+  w_.reset();
+  g.dump_ss(w_);
+  key_ = w_.buffer();
+  return key_;
+}
+
+void
+ss_histogram::add(const group &g, rng_t &rng)
+{
+  auto &e = entries_[key(g)];
+  if (!e.count_) {
+    if (spare_.empty()) {
+      e.repr_ = h_->create_scratch_group(rng);
+    } else {
+      e.repr_ = std::move(spare_.back());
+      spare_.pop_back();
+    }
+    e.repr_->set_ss(g);
+  }
+  e.count_++;
+}
+
+void
+ss_histogram::clear()
+{
+  for (auto &p : entries_)
+    spare_.emplace_back(std::move(p.second.repr_));
+  entries_.clear();
+}
+
+float
+ss_histogram::score_data(const hypers &h, rng_t &rng) const
+{
+  float sum = 0.;
+  for (const auto &p : entries_)
+    sum += float(p.second.count_) * p.second.repr_->score_data(h, rng);
+  return sum;
+}
+
+size_t
+ss_histogram::count() const
+{
+  size_t n = 0;
+  for (const auto &p : entries_)
+    n += p.second.count_;
+  return n;
+}
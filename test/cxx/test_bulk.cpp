@@ -0,0 +1,147 @@
+#include <microscopes/common/recarray/bulk.hpp>
+#include <microscopes/common/recarray/dataview.hpp>
+#include <microscopes/models/distributions.hpp>
+#include <microscopes/models/bbnc.hpp>
+#include <microscopes/common/util.hpp>
+
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <vector>
+#include <memory>
+
+using namespace std;
+using namespace distributions;
+using namespace microscopes;
+using namespace microscopes::common;
+using namespace microscopes::common::recarray;
+
+static vector<shared_ptr<models::hypers>>
+make_hypers()
+{
+  vector<shared_ptr<models::hypers>> hypers;
+  hypers.emplace_back(models::distributions_model<BetaBernoulli>().create_hypers());
+  hypers.back()->get_hp_mutator("alpha").set<float>(2.0);
+  hypers.back()->get_hp_mutator("beta").set<float>(2.0);
+  hypers.emplace_back(models::bbnc_model().create_hypers());
+  hypers.back()->get_hp_mutator("alpha").set<float>(1.0);
+  hypers.back()->get_hp_mutator("beta").set<float>(1.0);
+  return hypers;
+}
+
+static void
+create_groups(bulk::groups_t &groups,
+              const vector<shared_ptr<models::hypers>> &hypers,
+              size_t ngroups,
+              rng_t &r)
+{
+  for (size_t i = 0; i < ngroups; i++) {
+    auto &fgroups = groups.create_group().second;
+    for (const auto &h : hypers)
+      fgroups.emplace_back(h->create_group(r));
+  }
+}
+
+static void
+test_add_values_matches_serial(unsigned nthreads)
+{
+  rng_t r(5849343);
+
+  const size_t N = 1000;
+  const size_t D = 2;
+  unique_ptr<bool []> data(new bool[N*D]);
+  unique_ptr<bool []> mask(new bool[N*D]);
+  for (size_t i = 0; i < N*D; i++) {
+    data[i] = bernoulli_distribution(0.3)(r);
+    mask[i] = bernoulli_distribution(0.1)(r);
+  }
+  const vector<runtime_type> types(D, runtime_type(TYPE_B));
+  row_major_dataview view(
+      reinterpret_cast<const uint8_t *>(data.get()), mask.get(), N, types);
+
+  const auto hypers = make_hypers();
+  const auto assignments = util::random_assignment_vector(N, r, 13);
+  const size_t ngroups = *max_element(assignments.begin(), assignments.end()) + 1;
+
+  bulk::groups_t serial(N);
+  create_groups(serial, hypers, ngroups, r);
+  for (size_t i = 0; i < N; i++) {
+    auto &fgroups = serial.add_value(assignments[i], i);
+    row_accessor acc = view.get(i);
+    for (size_t f = 0; f < D; f++, acc.bump())
+      if (!acc.anymasked())
+        fgroups[f]->add_value(*hypers[f], acc.get(), r);
+  }
+
+  bulk::groups_t parallel(N);
+  create_groups(parallel, hypers, ngroups, r);
+  // the thread-local groups are scratch groups, which bbnc doesn't count
+  const size_t created = models::bbnc_hypers::CreateFeatureGroupInvocations();
+  bulk::add_values(parallel, hypers, view, assignments, r, nthreads);
+  MICROSCOPES_CHECK(
+      models::bbnc_hypers::CreateFeatureGroupInvocations() == created,
+      "add_values() counted its scratch groups");
+
+  MICROSCOPES_CHECK(serial.assignments() == parallel.assignments(),
+      "assignments differ");
+  for (auto gid : serial.groups()) {
+    MICROSCOPES_CHECK(serial.groupsize(gid) == parallel.groupsize(gid),
+        "group sizes differ");
+    const auto &a = serial.group(gid).data_;
+    const auto &b = parallel.group(gid).data_;
+    // bb suff stats are exact; bbnc's p is sampled per group, so only compare
+    // its counts
+    MICROSCOPES_CHECK(a[0]->debug_str() == b[0]->debug_str(),
+        "bb suffstats differ");
+    const string sa = a[1]->debug_str(), sb = b[1]->debug_str();
+    MICROSCOPES_CHECK(
+        sa.substr(sa.find(',')) == sb.substr(sb.find(',')),
+        "bbnc suffstats differ");
+  }
+}
+
+static void
+test_sample_values(unsigned nthreads)
+{
+  rng_t r(3349);
+  const auto hypers = make_hypers();
+  bulk::groups_t groups(0);
+  create_groups(groups, hypers, 3, r);
+
+  // group 1 is (almost) all heads, group 2 (almost) all tails
+  bool t = true, f = false;
+  for (size_t i = 0; i < 100; i++) {
+    for (size_t k = 0; k < hypers.size(); k++) {
+      groups.group(1).data_[k]->add_value(*hypers[k], value_accessor(&t), r);
+      groups.group(2).data_[k]->add_value(*hypers[k], value_accessor(&f), r);
+    }
+  }
+
+  const size_t N = 10000;
+  const size_t D = hypers.size();
+  vector<size_t> gids(N);
+  for (size_t i = 0; i < N; i++)
+    gids[i] = 1 + (i % 2);
+  const vector<runtime_type> types(D, runtime_type(TYPE_B));
+  unique_ptr<bool []> out(new bool[N*D]);
+  bulk::sample_values(groups, hypers, types, gids,
+      reinterpret_cast<uint8_t *>(out.get()), r, nthreads);
+
+  // only the bb feature is checked, since bbnc's p is a random draw
+  size_t heads[3] = {0};
+  for (size_t i = 0; i < N; i++)
+    heads[gids[i]] += out[i*D];
+  MICROSCOPES_CHECK(heads[1] > 0.9 * N / 2, "group 1 should be mostly heads");
+  MICROSCOPES_CHECK(heads[2] < 0.1 * N / 2, "group 2 should be mostly tails");
+}
+
+int
+main(void)
+{
+  test_add_values_matches_serial(1);
+  test_add_values_matches_serial(4);
+  test_add_values_matches_serial(0);
+  test_sample_values(1);
+  test_sample_values(0);
+  return 0;
+}
@@ -0,0 +1,496 @@
+#include <microscopes/models/distributions.hpp>
+#include <microscopes/common/random_fwd.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <typeinfo>
+#include <vector>
+
+using namespace std;
+using namespace distributions;
+using namespace microscopes;
+using namespace microscopes::common;
+using namespace microscopes::models;
+using microscopes::models::group;
+
+static inline bool
+almost_eq(float a, float b)
+{
+  return fabs(a - b) <= 1e-4 * max(1.f, fabs(a));
+}
+
+// a mixture scoring a group through its cached Scorer must agree with the
+// group itself
+template <typename T>
+static void
+test_mixture_score_value_dd(unsigned k)
+{
+  rng_t r(3311);
+  dd_model model(k);
+  distributions::protobuf::DirichletDiscrete_Shared m;
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(0.5 + i);
+  auto h = model.create_hypers();
+  auto h1 = model.create_hypers();
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  MICROSCOPES_CHECK(
+      dynamic_cast<distributions_hypers<T> *>(h.get()), "unexpected hypers");
+
+  auto mix = h->create_mixture();
+  mix->create_group(0, *h, r);
+  auto g1 = h1->create_group(r);
+  auto check = [&](const char *msg) {
+    for (uint32_t v = 0; v < k; v++) {
+      value_accessor acc(&v);
+      MICROSCOPES_CHECK(
+          almost_eq(mix->score_value(0, *h, acc, r),
+                    g1->score_value(*h1, acc, r)), msg);
+    }
+  };
+
+  check("empty group");
+  for (size_t n = 0; n < 100; n++) {
+    uint32_t v = uniform_int_distribution<uint32_t>(0, k - 1)(r);
+    mix->add_value(0, *h, value_accessor(&v), r);
+    g1->add_value(*h1, value_accessor(&v), r);
+    check("after add_value");
+    if (n % 3 == 0) {
+      mix->remove_value(0, *h, value_accessor(&v), r);
+      g1->remove_value(*h1, value_accessor(&v), r);
+      check("after remove_value");
+    }
+  }
+
+  // changing the hypers must not use the stale scorer
+  m.clear_alphas();
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(3.0);
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  check("after set_hp");
+  mix->refresh(*h, r);
+  check("after refresh");
+}
+
+// serializing into a caller owned buffer matches the allocating versions,
+// whatever the buffer held before
+static void
+test_serialize_into()
+{
+  rng_t r(5);
+  distributions_model<BetaBernoulli> model;
+  auto h = model.create_hypers();
+  auto g = h->create_group(r);
+  for (size_t n = 0; n < 10; n++) {
+    bool v = n % 3;
+    g->add_value(*h, value_accessor(&v), r);
+  }
+  string buf(1024, 'x');
+  g->get_ss(buf);
+  MICROSCOPES_CHECK(buf == g->get_ss(), "get_ss(out) mismatch");
+  h->get_hp(buf);
+  MICROSCOPES_CHECK(buf == h->get_hp(), "get_hp(out) mismatch");
+}
+
+// DirichletDiscreteV caches its alpha sum, which every way of setting the
+// hypers must keep up to date
+static void
+test_ddv_alpha_sum()
+{
+  rng_t r(3311);
+  const unsigned k = 200;
+  distributions_model<DirichletDiscreteV> model(k);
+  distributions::protobuf::DirichletDiscrete_Shared m;
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(0.5 + i);
+  auto h = model.create_hypers();
+  h->set_hp(util::protobuf_to_string(m));
+
+  auto g = h->create_group(r);
+  vector<uint32_t> counts(k, 0);
+  for (size_t n = 0; n < 100; n++) {
+    uint32_t v = uniform_int_distribution<uint32_t>(0, k - 1)(r);
+    g->add_value(*h, value_accessor(&v), r);
+    counts[v]++;
+  }
+  auto check = [&](const hypers &hh, const char *msg) {
+    const auto &alphas =
+      static_cast<const distributions_hypers<DirichletDiscreteV> &>(hh).repr_.alphas;
+    float alpha_sum = 0.;
+    for (float a : alphas)
+      alpha_sum += a;
+    for (uint32_t v = 0; v < k; v++)
+      MICROSCOPES_CHECK(
+          almost_eq(g->score_value(hh, value_accessor(&v), r),
+                    log((alphas[v] + counts[v]) / (alpha_sum + 100.))), msg);
+  };
+
+  check(*h, "after set_hp");
+  auto alphas = h->get_hp_mutator("alphas");
+  for (unsigned i = 0; i < k; i += 7)
+    alphas.set(3.0f * i + 1.0f, i);
+  check(*h, "after mutator writes");
+  auto h1 = model.create_hypers();
+  h1->set_hp(*h);
+  check(*h1, "after set_hp(hypers)");
+}
+
+// a group scoring through its own cached Scorer must agree with a plain one
+static void
+test_scorer_cache_dd()
+{
+  rng_t r(3311);
+  const unsigned k = 10;
+  distributions_model<DirichletDiscrete16> model(k);
+  distributions::protobuf::DirichletDiscrete_Shared m;
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(0.5 + i);
+  auto h = model.create_hypers();
+  auto h1 = model.create_hypers();
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  static_cast<distributions_hypers<DirichletDiscrete16> &>(*h).set_scorer_cache(true);
+
+  auto g = h->create_group(r);
+  auto g1 = h1->create_group(r);
+  auto &cg = dynamic_cast<cached_distributions_group<DirichletDiscrete16> &>(*g);
+  MICROSCOPES_CHECK(
+      !dynamic_cast<cached_distributions_group<DirichletDiscrete16> *>(g1.get()),
+      "cache not opt-in");
+  MICROSCOPES_CHECK(
+      !dynamic_cast<cached_distributions_group<DirichletDiscrete16> *>(
+        h->create_scratch_group(r).get()),
+      "scratch groups should not be cached");
+  auto check = [&](const char *msg) {
+    for (uint32_t v = 0; v < k; v++) {
+      value_accessor acc(&v);
+      MICROSCOPES_CHECK(
+          almost_eq(g->score_value(*h, acc, r), g1->score_value(*h1, acc, r)), msg);
+    }
+  };
+
+  MICROSCOPES_CHECK(cg.cached(*h), "new group not cached");
+  check("empty group");
+  for (size_t n = 0; n < 100; n++) {
+    uint32_t v = uniform_int_distribution<uint32_t>(0, k - 1)(r);
+    g->add_value(*h, value_accessor(&v), r);
+    g1->add_value(*h1, value_accessor(&v), r);
+    check("after add_value");
+    if (n % 3 == 0) {
+      g->remove_value(*h, value_accessor(&v), r);
+      g1->remove_value(*h1, value_accessor(&v), r);
+      check("after remove_value");
+    }
+  }
+  MICROSCOPES_CHECK(cg.cached(*h), "scorer not kept up to date");
+
+  // changing the hypers must not use the stale scorer
+  m.clear_alphas();
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(3.0);
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  MICROSCOPES_CHECK(!cg.cached(*h), "stale scorer used");
+  check("after set_hp");
+
+  auto g2 = h->create_group(r);
+  g2->set_ss(g->get_ss());
+  for (uint32_t v = 0; v < k; v++) {
+    value_accessor acc(&v);
+    MICROSCOPES_CHECK(
+        almost_eq(g2->score_value(*h, acc, r), g1->score_value(*h1, acc, r)),
+        "after set_ss");
+  }
+
+  // as must writes through the suff stats mutator
+  uint32_t v = 1;
+  g->add_value(*h, value_accessor(&v), r);
+  g1->add_value(*h1, value_accessor(&v), r);
+  MICROSCOPES_CHECK(cg.cached(*h), "scorer not rebuilt");
+  for (auto px : {g.get(), g1.get()}) {
+    px->get_ss_mutator("counts").set<uint32_t>(50, 0);
+    px->get_ss_mutator("count_sum").set<uint32_t>(
+        px->get_ss_mutator("count_sum").accessor().get<uint32_t>(0) + 50, 0);
+  }
+  MICROSCOPES_CHECK(!cg.cached(*h), "get_ss_mutator() writes not noticed");
+  check("after get_ss_mutator");
+}
+
+static void
+test_scorer_cache_bb()
+{
+  rng_t r(98);
+  distributions_model<BetaBernoulli> model;
+  distributions::protobuf::BetaBernoulli_Shared m;
+  m.set_alpha(1.5);
+  m.set_beta(2.);
+  auto h = model.create_hypers();
+  auto h1 = model.create_hypers();
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  static_cast<distributions_hypers<BetaBernoulli> &>(*h).set_scorer_cache(true);
+  auto g = h->create_group(r);
+  auto g1 = h1->create_group(r);
+  bool t = true, f = false;
+  for (size_t n = 0; n < 20; n++) {
+    g->add_value(*h, value_accessor(n % 3 ? &t : &f), r);
+    g1->add_value(*h1, value_accessor(n % 3 ? &t : &f), r);
+    MICROSCOPES_CHECK(
+        almost_eq(g->score_value(*h, value_accessor(&t), r),
+                  g1->score_value(*h1, value_accessor(&t), r)),
+        "score_value mismatch");
+  }
+
+  // writes through a hp mutator are noticed
+  h->get_hp_mutator("alpha").set<float>(4.);
+  h1->get_hp_mutator("alpha").set<float>(4.);
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_value(*h, value_accessor(&t), r),
+                g1->score_value(*h1, value_accessor(&t), r)),
+      "stale scorer after hp mutator");
+}
+
+// dd_model picks the smallest representation which fits, while the
+// DirichletDiscrete<N> models keep to N
+static void
+test_dd_dispatch()
+{
+  rng_t r(44);
+  auto check = [&](unsigned k, const hypers &h, bool ok) {
+    MICROSCOPES_CHECK(ok, "wrong DirichletDiscrete type");
+    auto g = h.create_group(r);
+    uint32_t v = k - 1;
+    g->add_value(h, value_accessor(&v), r);
+    MICROSCOPES_CHECK(
+        g->get_ss_mutator("counts").shape() == k, "wrong # of categories");
+  };
+  auto h2 = dd_model(2).create_hypers();
+  check(2, *h2, dynamic_cast<distributions_hypers<DirichletDiscrete2> *>(h2.get()));
+  auto h5 = dd_model(5).create_hypers();
+  check(5, *h5, dynamic_cast<distributions_hypers<DirichletDiscrete8> *>(h5.get()));
+  auto h100 = dd_model(100).create_hypers();
+  check(100, *h100, dynamic_cast<distributions_hypers<DirichletDiscrete128> *>(h100.get()));
+  auto h1000 = dd_model(1000).create_hypers();
+  check(1000, *h1000, dynamic_cast<distributions_hypers<DirichletDiscreteV> *>(h1000.get()));
+
+  auto h128 = distributions_model_dd128(5).create_hypers();
+  check(5, *h128, typeid(*h128) == typeid(distributions_hypers<DirichletDiscrete128>));
+  auto h16 = distributions_model<DirichletDiscrete16>(5).create_hypers();
+  check(5, *h16, typeid(*h16) == typeid(distributions_hypers<DirichletDiscrete16>));
+}
+
+static void
+test_mixture_score_value_bb()
+{
+  rng_t r(98);
+  distributions_model<BetaBernoulli> model;
+  distributions::protobuf::BetaBernoulli_Shared m;
+  m.set_alpha(1.5);
+  m.set_beta(2.);
+  auto h = model.create_hypers();
+  auto h1 = model.create_hypers();
+  h->set_hp(util::protobuf_to_string(m));
+  h1->set_hp(util::protobuf_to_string(m));
+  auto mix = h->create_mixture();
+  mix->create_group(0, *h, r);
+  auto g1 = h1->create_group(r);
+  bool t = true, f = false;
+  for (size_t n = 0; n < 20; n++) {
+    mix->add_value(0, *h, value_accessor(n % 3 ? &t : &f), r);
+    g1->add_value(*h1, value_accessor(n % 3 ? &t : &f), r);
+    MICROSCOPES_CHECK(
+        almost_eq(mix->score_value(0, *h, value_accessor(&t), r),
+                  g1->score_value(*h1, value_accessor(&t), r)),
+        "score_value mismatch");
+  }
+}
+
+// the mixture's Scorers are used until the hypers change, and again after
+// refresh()
+static void
+test_mixture_cached()
+{
+  rng_t r(77);
+  distributions_model<BetaBernoulli> model;
+  auto h = model.create_hypers();
+  h->get_hp_mutator("alpha").set<float>(1.);
+  h->get_hp_mutator("beta").set<float>(1.);
+  h->hp_changed();
+  auto mix = h->create_mixture();
+  bool t = true, f = false;
+  for (size_t gid = 0; gid < 3; gid++) {
+    mix->create_group(gid, *h, r);
+    for (size_t n = 0; n < 5 + gid; n++)
+      mix->add_value(gid, *h, value_accessor(n % 2 ? &t : &f), r);
+  }
+  auto check = [&](bool cached, const char *msg) {
+    for (auto gid : mix->gids()) {
+      MICROSCOPES_CHECK(mix->cached(gid, *h) == cached, msg);
+      MICROSCOPES_CHECK(
+          almost_eq(mix->score_value(gid, *h, value_accessor(&t), r),
+                    mix->get_group(gid).score_value(*h, value_accessor(&t), r)),
+          "score mismatch");
+    }
+  };
+  check(true, "new groups should be cached");
+
+  // merely resolving a mutator (e.g. for an hp_handle) changes nothing
+  h->get_hp_mutator("alpha");
+  check(true, "get_hp_mutator() invalidated the scorers");
+
+  h->get_hp_mutator("alpha").set<float>(3.);
+  h->hp_changed();
+  check(false, "hp_changed() did not invalidate the scorers");
+  mix->refresh(*h, r);
+  check(true, "refresh() did not rebuild the scorers");
+
+  distributions::protobuf::BetaBernoulli_Shared m;
+  m.set_alpha(0.5);
+  m.set_beta(2.);
+  h->set_hp(util::protobuf_to_string(m));
+  check(false, "set_hp() did not invalidate the scorers");
+  mix->add_value(0, *h, value_accessor(&t), r);
+  MICROSCOPES_CHECK(mix->cached(0, *h), "add_value() did not rebuild the scorer");
+
+  // scorers built against other hypers are never used
+  auto h1 = model.create_hypers();
+  h1->set_hp(*h);
+  MICROSCOPES_CHECK(!mix->cached(0, *h1), "scorer used for other hypers");
+}
+
+static void
+check_mixture(const mixture &mix,
+              const group_manager<shared_ptr<group>> &gm,
+              const hypers &h, const value_accessor &value, rng_t &r)
+{
+  MICROSCOPES_CHECK(mix.ngroups() == gm.ngroups(), "ngroups mismatch");
+  vector<float> scores(mix.ngroups());
+  mix.score_value_all_groups(h, value, scores.data(), r);
+  size_t i = 0;
+  for (const auto &p : gm) {
+    MICROSCOPES_CHECK(mix.gids()[i] == p.first, "gid mismatch");
+    MICROSCOPES_CHECK(
+        almost_eq(scores[i++], p.second.data_->score_value(h, value, r)),
+        "score mismatch");
+  }
+}
+
+static void
+test_mixture()
+{
+  rng_t r(1234);
+  const unsigned k = 6;
+  dd_model model(k);
+  auto h = model.create_hypers();
+  distributions::protobuf::DirichletDiscrete_Shared m;
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(1.0 + i);
+  h->set_hp(util::protobuf_to_string(m));
+
+  // the mixture shares the groups of gm, and changes them for us
+  const size_t n = 200;
+  group_manager<shared_ptr<group>> gm(n);
+  auto mix = h->create_mixture();
+  MICROSCOPES_CHECK(
+      dynamic_cast<distributions_mixture<DirichletDiscrete8> *>(mix.get()),
+      "expected a distributions_mixture");
+  auto group_of = [](const shared_ptr<group> &g) { return g; };
+  mix->reset(gm, group_of, *h, r);
+
+  vector<uint32_t> data(n);
+  for (size_t eid = 0; eid < n; eid++) {
+    data[eid] = uniform_int_distribution<uint32_t>(0, k - 1)(r);
+    value_accessor acc(&data[eid]);
+    if (gm.empty_groups().empty()) {
+      auto p = gm.create_group();
+      p.second = h->create_group(r);
+      mix->create_group(p.first, p.second, *h, r);
+    }
+    // score against all groups, then pick the one with the best score
+    vector<float> scores(mix->ngroups());
+    mix->score_value_all_groups(*h, acc, scores.data(), r);
+    const size_t best = max_element(scores.begin(), scores.end()) - scores.begin();
+    const size_t gid = (eid % 7 == 0) ? *gm.empty_groups().begin() : mix->gids()[best];
+    gm.add_value(gid, eid);
+    mix->add_value(gid, *h, acc, r);
+  }
+  uint32_t v = 2;
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+  for (const auto &p : gm)
+    MICROSCOPES_CHECK(&mix->get_group(p.first) == p.second.data_.get(),
+        "groups not shared");
+
+  // empty out and delete a group
+  const size_t victim = mix->gids()[1];
+  for (size_t eid = 0; eid < n; eid++) {
+    if (gm.assignments()[eid] != ssize_t(victim))
+      continue;
+    gm.remove_value(eid);
+    mix->remove_value(victim, *h, value_accessor(&data[eid]), r);
+  }
+  gm.delete_group(victim);
+  mix->delete_group(victim);
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+
+  // other changes go through update()
+  const size_t target = mix->gids()[0];
+  auto extra = h->create_group(r);
+  auto expected = h->create_group(r);
+  expected->set_ss(*gm.group(target).data_);
+  for (size_t i = 0; i < 10; i++)
+    extra->add_value(*h, value_accessor(&data[i]), r);
+  expected->merge(*h, *extra, r);
+  mix->update(target, *h, r, [&](group &g) { g.merge(*h, *extra, r); });
+  MICROSCOPES_CHECK(
+      mix->get_group(target).debug_str() == expected->debug_str(),
+      "update() not applied");
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+
+  // new hypers are scored correctly before and after refresh()
+  m.clear_alphas();
+  for (unsigned i = 0; i < k; i++)
+    m.add_alphas(0.25);
+  h->set_hp(util::protobuf_to_string(m));
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+  mix->refresh(*h, r);
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+
+  // rebuilt from the group manager
+  auto mix1 = h->create_mixture();
+  mix1->reset(gm, group_of, *h, r);
+  check_mixture(*mix1, gm, *h, value_accessor(&v), r);
+
+  // a change to gm which skips the mixture is caught
+  const size_t eid = 0;
+  const size_t gid = gm.assignments()[eid];
+  gm.remove_value(eid);
+  bool threw = false;
+  try {
+    vector<float> scores(mix->ngroups());
+    mix->score_value_all_groups(*h, value_accessor(&v), scores.data(), r);
+  } catch (runtime_error &) {
+    threw = true;
+  }
+  MICROSCOPES_CHECK(threw, "stale mixture not detected");
+  mix->remove_value(gid, *h, value_accessor(&data[eid]), r);
+  check_mixture(*mix, gm, *h, value_accessor(&v), r);
+}
+
+int
+main(void)
+{
+  test_dd_dispatch();
+  test_serialize_into();
+  test_ddv_alpha_sum();
+  test_scorer_cache_dd();
+  test_scorer_cache_bb();
+  test_mixture_score_value_dd<DirichletDiscrete16>(10);
+  test_mixture_score_value_dd<DirichletDiscreteV>(300);
+  test_mixture_score_value_bb();
+  test_mixture_cached();
+  test_mixture();
+  return 0;
+}
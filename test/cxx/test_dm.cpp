@@ -0,0 +1,231 @@
+#include <microscopes/models/dm.hpp>
+#include <microscopes/common/lgamma_cache.hpp>
+#include <microscopes/common/random_fwd.hpp>
+
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace microscopes;
+using namespace microscopes::common;
+
+static inline bool
+almost_eq(float a, float b)
+{
+  return fabs(a - b) <= 1e-3 * max(1.f, fabs(a));
+}
+
+// the dirichlet-multinomial marginal likelihood of rows, computed directly
+static float
+naive_score_data(const vector<float> &alphas, const vector<vector<unsigned>> &rows)
+{
+  const size_t k = alphas.size();
+  vector<unsigned> counts(k);
+  double score = 0.;
+  for (const auto &row : rows) {
+    unsigned n = 0;
+    for (size_t i = 0; i < k; i++) {
+      counts[i] += row[i];
+      n += row[i];
+      score -= lgamma(row[i] + 1.);
+    }
+    score += lgamma(n + 1.);
+  }
+  double alpha_sum = 0.;
+  unsigned count_sum = 0;
+  for (size_t i = 0; i < k; i++) {
+    alpha_sum += alphas[i];
+    count_sum += counts[i];
+    score += lgamma(counts[i] + double(alphas[i])) - lgamma(double(alphas[i]));
+  }
+  score += lgamma(alpha_sum) - lgamma(alpha_sum + count_sum);
+  return score;
+}
+
+static void
+test_score_data(size_t k, size_t nnz)
+{
+  rng_t r(7392);
+  models::dm_model model(k);
+  auto h = model.create_hypers();
+  vector<float> alphas(k);
+  for (size_t i = 0; i < k; i++) {
+    alphas[i] = uniform_real_distribution<float>(0.1, 4.0)(r);
+    h->get_hp_mutator("alphas").set<float>(alphas[i], i);
+  }
+  h->hp_changed();
+
+  auto g = h->create_group(r);
+  MICROSCOPES_CHECK(
+      static_cast<models::dm_group &>(*g).sparse() ==
+        (k >= models::dm_group::SparseThreshold),
+      "wrong representation");
+
+  vector<vector<unsigned>> rows;
+  for (size_t n = 0; n < 200; n++) {
+    rows.emplace_back(k);
+    for (size_t j = 0; j < nnz; j++)
+      rows.back()[uniform_int_distribution<size_t>(0, k - 1)(r)] +=
+        uniform_int_distribution<unsigned>(1, 20)(r);
+    const auto &row = rows.back();
+    value_accessor acc(
+        reinterpret_cast<const uint8_t *>(row.data()), nullptr,
+        runtime_type(TYPE_U32, k));
+
+    // score_value() is the predictive, so it is the score_data() delta
+    const float before = g->score_data(*h, r);
+    const float pred = g->score_value(*h, acc, r);
+    g->add_value(*h, acc, r);
+    MICROSCOPES_CHECK(
+        almost_eq(g->score_data(*h, r) - before, pred), "predictive mismatch");
+  }
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_data(*h, r), naive_score_data(alphas, rows)),
+      "score_data mismatch");
+
+  // remove every other row
+  vector<vector<unsigned>> kept;
+  for (size_t n = 0; n < rows.size(); n++) {
+    if (n % 2) {
+      kept.push_back(rows[n]);
+      continue;
+    }
+    value_accessor acc(
+        reinterpret_cast<const uint8_t *>(rows[n].data()), nullptr,
+        runtime_type(TYPE_U32, k));
+    g->remove_value(*h, acc, r);
+  }
+  rows.swap(kept);
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_data(*h, r), naive_score_data(alphas, rows)),
+      "score_data mismatch after removal");
+
+  // round trips
+  auto g1 = h->create_group(r);
+  g1->set_ss(g->get_ss());
+  MICROSCOPES_CHECK(g->debug_str() == g1->debug_str(), "get_ss/set_ss");
+  snapshot_writer w;
+  g->dump_ss(w);
+  snapshot_reader rd(
+      reinterpret_cast<const uint8_t *>(w.buffer().data()), w.buffer().size());
+  auto g2 = h->create_group(r);
+  g2->load_ss(rd);
+  MICROSCOPES_CHECK(g->debug_str() == g2->debug_str(), "dump_ss/load_ss");
+
+  // writes through a mutator, followed by hp_changed(), must not be served
+  // stale tables
+  alphas[2] = 7.0;
+  h->get_hp_mutator("alphas").set<float>(alphas[2], 2);
+  h->hp_changed();
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_data(*h, r), naive_score_data(alphas, rows)),
+      "stale lgamma table");
+}
+
+static void
+test_sample_value(size_t k)
+{
+  rng_t r(5534);
+  models::dm_model model(k);
+  auto h = model.create_hypers();
+  for (size_t i = 0; i < k; i++)
+    h->get_hp_mutator("alphas").set<float>(0.5, i);
+  h->hp_changed();
+
+  // a group concentrated on the first 3 categories
+  auto g = h->create_group(r);
+  vector<unsigned> row(k);
+  row[0] = 500; row[1] = 300; row[2] = 200;
+  value_accessor acc(
+      reinterpret_cast<const uint8_t *>(row.data()), nullptr,
+      runtime_type(TYPE_U32, k));
+  g->add_value(*h, acc, r);
+
+  const float alpha_sum = 0.5 * k + 1000.;
+  const size_t nsamples = 2000;
+  const unsigned n = 40;
+  vector<double> means(k);
+  for (size_t s = 0; s < nsamples; s++) {
+    // the template row determines the # of trials
+    vector<unsigned> out(k);
+    out[k - 1] = n;
+    value_mutator mut(
+        reinterpret_cast<uint8_t *>(out.data()), runtime_type(TYPE_U32, k));
+    g->sample_value(*h, mut, r);
+    unsigned sum = 0;
+    for (size_t i = 0; i < k; i++) {
+      sum += out[i];
+      means[i] += double(out[i]) / (n * nsamples);
+    }
+    MICROSCOPES_CHECK(sum == n, "wrong # of trials");
+  }
+  for (size_t i = 0; i < 3; i++) {
+    const double expected = (0.5 + row[i]) / alpha_sum;
+    MICROSCOPES_CHECK(fabs(means[i] - expected) < 0.02, "posterior mean");
+  }
+}
+
+// the cache never gives up, and finds the tables of recent alphas again
+static void
+test_lgamma_cache()
+{
+  lgamma_cache cache;
+  auto alphas_of = [](size_t i) { return vector<float>{0.5f + i, 2.f, 3.f}; };
+  auto check = [](const lgamma_shifted_table *t, const vector<float> &alphas) {
+    MICROSCOPES_CHECK(t, "no table");
+    MICROSCOPES_CHECK(t->alphas() == alphas, "table for the wrong alphas");
+    for (size_t i = 0; i < alphas.size(); i++)
+      for (unsigned n = 0; n < 20; n++)
+        MICROSCOPES_CHECK(
+            almost_eq(t->lgamma(i, n), lgamma(n + double(alphas[i]))),
+            "wrong lgamma");
+  };
+
+  vector<const lgamma_shifted_table *> tables;
+  for (size_t i = 0; i < 2 * lgamma_cache::MaxTables; i++) {
+    cache.invalidate();
+    const auto alphas = alphas_of(i);
+    tables.push_back(cache.get(alphas, 16));
+    check(tables.back(), alphas);
+  }
+
+  // the most recent alphas are still cached
+  const size_t i = 2 * lgamma_cache::MaxTables - 2;
+  cache.invalidate();
+  MICROSCOPES_CHECK(cache.get(alphas_of(i), 16) == tables[i], "table not reused");
+  check(tables[i], alphas_of(i));
+
+  // growing the table
+  const auto *t = cache.get(alphas_of(i), 64);
+  MICROSCOPES_CHECK(t->size() >= 64, "table not grown");
+  check(t, alphas_of(i));
+
+  // lookups agree before and after a row is built, even concurrently
+  const float direct = t->lgamma(1, 3);
+  vector<thread> threads;
+  vector<int> ok(4, 1);
+  for (size_t j = 0; j < ok.size(); j++)
+    threads.emplace_back([&, j]() {
+      for (unsigned m = 0; m < 4 * t->size(); m++)
+        ok[j] &= t->lgamma(1, 3) == direct && t->lgamma_sum(m % t->size()) ==
+          t->lgamma_sum(m % t->size());
+    });
+  for (auto &th : threads)
+    th.join();
+  for (auto b : ok)
+    MICROSCOPES_CHECK(b, "lookups changed once the row was built");
+  check(t, alphas_of(i));
+}
+
+int
+main(void)
+{
+  test_lgamma_cache();
+  test_score_data(5, 5);
+  test_score_data(5000, 10);
+  test_sample_value(4);
+  test_sample_value(2000);
+  return 0;
+}
@@ -1,5 +1,8 @@
 #include <microscopes/common/group_manager.hpp>
 
+#include <cstdio>
+#include <unistd.h>
+
 using namespace std;
 using namespace microscopes::common;
 
@@ -58,9 +61,132 @@ test_serialization()
     MICROSCOPES_CHECK(g.group(gid) == g1.group(gid), "group count/data");
 }
 
+static group
+make_group()
+{
+  group g(10);
+  g.get_hp_mutator("alpha").set<float>(2.0, 0);
+  const vector<ssize_t> assignment_vec({
+      -1, 2, 1, 0, 6, 1, 2, -1, -1, 5
+  });
+  for (size_t i = 0; i < 7; i++)
+    g.create_group();
+  g.delete_group(3);
+  for (size_t i = 0; i < assignment_vec.size(); i++) {
+    if (assignment_vec[i] == -1)
+      continue;
+    g.add_value(assignment_vec[i], i) += 10;
+  }
+  return g;
+}
+
+static void
+assert_groups_equal(group &g, group &g1)
+{
+  MICROSCOPES_CHECK(
+      almost_eq(
+        g.get_hp_mutator("alpha").accessor().get<float>(0),
+        g1.get_hp_mutator("alpha").accessor().get<float>(0)),
+    "did not save alpha properly");
+  assert_vectors_equal(g.assignments(), g1.assignments());
+  MICROSCOPES_CHECK(g.empty_groups() == g1.empty_groups(), "empty groups");
+  MICROSCOPES_CHECK(g.ngroups() == g1.ngroups(), "ngroups");
+  for (auto gid : g.groups())
+    MICROSCOPES_CHECK(g.group(gid) == g1.group(gid), "group count/data");
+}
+
+static void
+test_snapshot()
+{
+  group g = make_group();
+  auto dump_fn = [](size_t i, snapshot_writer &w) { w.write<uint64_t>(i); };
+  auto load_fn = [](snapshot_reader &r) -> size_t { return r.read<uint64_t>(); };
+
+  // in memory
+  snapshot_writer w;
+  g.dump(w, dump_fn);
+  const string &buf = w.buffer();
+  snapshot_reader r(reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
+  group g1(r, load_fn);
+  MICROSCOPES_CHECK(r.eof(), "trailing bytes");
+  assert_groups_equal(g, g1);
+
+  // through a (tiny buffered) file
+  char path[] = "/tmp/test_group_manager.XXXXXX";
+  const int fd = mkstemp(path);
+  MICROSCOPES_CHECK(fd != -1, "mkstemp");
+  close(fd);
+  {
+    snapshot_writer fw(path, 16);
+    g.dump(fw, dump_fn);
+    fw.close();
+    MICROSCOPES_CHECK(fw.tell() == buf.size(), "file/memory size mismatch");
+  }
+  {
+    snapshot_reader fr(path);
+    group g2(fr, load_fn);
+    MICROSCOPES_CHECK(fr.eof(), "trailing bytes");
+    assert_groups_equal(g, g2);
+  }
+  unlink(path);
+}
+
+// corrupt snapshots must be rejected in release builds too
+static void
+test_snapshot_corrupt()
+{
+  auto load_fn = [](snapshot_reader &r) -> size_t { return r.read<uint64_t>(); };
+  auto rejected = [&](const snapshot_writer &w) {
+    const string &buf = w.buffer();
+    snapshot_reader r(reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
+    try {
+      group g(r, load_fn);
+    } catch (runtime_error &) {
+      return true;
+    }
+    return false;
+  };
+
+  // an assignment count whose size in bytes wraps around to 8, followed by
+  // the padding, a single unassigned entity and no groups
+  snapshot_writer w;
+  w.write<float>(1.);
+  w.write<uint64_t>(1);
+  w.write<uint64_t>((uint64_t(1) << 61) + 1);
+  w.write<uint32_t>(0);
+  w.write<int64_t>(-1);
+  w.write<uint64_t>(0);
+  MICROSCOPES_CHECK(rejected(w), "huge array accepted");
+
+  // group counts which disagree with the assignments
+  const vector<int64_t> assignments = {0, 0, -1};
+  w.reset();
+  w.write<float>(1.);
+  w.write<uint64_t>(1);
+  w.write_array(assignments);
+  w.write<uint64_t>(1);
+  w.write<uint64_t>(0);
+  w.write<uint64_t>(3);
+  w.write<uint64_t>(0);
+  MICROSCOPES_CHECK(rejected(w), "bad group count accepted");
+
+  // an assignment to a group which was never written
+  w.reset();
+  w.write<float>(1.);
+  w.write<uint64_t>(2);
+  w.write_array(assignments);
+  w.write<uint64_t>(1);
+  w.write<uint64_t>(1);
+  w.write<uint64_t>(0);
+  w.write<uint64_t>(0);
+  MICROSCOPES_CHECK(rejected(w), "missing group accepted");
+}
+
 int
 main(void)
 {
   test_serialization();
+  test_snapshot();
+  test_snapshot_corrupt();
   return 0;
 }
@@ -0,0 +1,370 @@
+#include <microscopes/models/hp_handle.hpp>
+#include <microscopes/models/distributions.hpp>
+#include <microscopes/models/dm.hpp>
+#include <microscopes/models/bbnc.hpp>
+#include <microscopes/common/entity_state.hpp>
+#include <microscopes/common/random_fwd.hpp>
+
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+using namespace distributions;
+using namespace microscopes;
+using namespace microscopes::common;
+
+static inline bool
+almost_eq(float a, float b)
+{
+  return fabs(a - b) <= 1e-5;
+}
+
+/**
+ * A state with one group per component, and no entities: just enough of an
+ * entity_based_state_object to reach the component hypers the way sampling
+ * kernels do, through get_component_hp_mutator()
+ */
+class components_state : public entity_based_state_object {
+public:
+  components_state(const vector<shared_ptr<models::hypers>> &hypers, rng_t &rng)
+    : hypers_(hypers)
+  {
+    for (auto &h : hypers_)
+      groups_.push_back(h->create_group(rng));
+  }
+
+  size_t nentities() const override { return 0; }
+  size_t ngroups() const override { return 1; }
+  size_t ncomponents() const override { return hypers_.size(); }
+  vector<ssize_t> assignments() const override { return {}; }
+  vector<size_t> groups() const override { return {0}; }
+  size_t groupsize(size_t gid) const override { return 0; }
+
+  hyperparam_bag_t get_cluster_hp() const override { unsupported(); return ""; }
+  void set_cluster_hp(const hyperparam_bag_t &hp) override { unsupported(); }
+  value_mutator
+  get_cluster_hp_mutator(const string &key) override
+  {
+    unsupported();
+    return value_mutator();
+  }
+
+  hyperparam_bag_t
+  get_component_hp(size_t component) const override
+  {
+    return hypers_[component]->get_hp();
+  }
+
+  void
+  set_component_hp(size_t component, const hyperparam_bag_t &hp) override
+  {
+    hypers_[component]->set_hp(hp);
+  }
+
+  void
+  set_component_hp(size_t component, const models::hypers &proto) override
+  {
+    hypers_[component]->set_hp(proto);
+  }
+
+  value_mutator
+  get_component_hp_mutator(size_t component, const string &key) override
+  {
+    return hypers_[component]->get_hp_mutator(key);
+  }
+
+  vector<ident_t> suffstats_identifiers(size_t component) const override { return {0}; }
+
+  suffstats_bag_t
+  get_suffstats(size_t component, ident_t id) const override
+  {
+    return groups_[component]->get_ss();
+  }
+
+  void
+  set_suffstats(size_t component, ident_t id, const suffstats_bag_t &ss) override
+  {
+    groups_[component]->set_ss(ss);
+  }
+
+  value_mutator
+  get_suffstats_mutator(size_t component, ident_t id, const string &key) override
+  {
+    return groups_[component]->get_ss_mutator(key);
+  }
+
+  void
+  add_value(size_t gid, size_t eid, rng_t &rng) override
+  {
+    unsupported();
+  }
+
+  size_t remove_value(size_t eid, rng_t &rng) override { unsupported(); return 0; }
+
+  void
+  inplace_score_value(pair<vector<size_t>, vector<float>> &scores,
+                      size_t eid, rng_t &rng) const override
+  {
+    unsupported();
+  }
+
+  float score_assignment() const override { return 0.; }
+
+  using entity_based_state_object::score_likelihood;
+
+  float
+  score_likelihood(size_t component, ident_t id, rng_t &rng) const override
+  {
+    return groups_[component]->score_data(*hypers_[component], rng);
+  }
+
+  vector<size_t> empty_groups() const override { return {}; }
+  size_t create_group(rng_t &rng) override { unsupported(); return 0; }
+  void delete_group(size_t gid) override { unsupported(); }
+
+  inline models::group & group(size_t component) { return *groups_[component]; }
+  inline models::hypers & hypers(size_t component) { return *hypers_[component]; }
+
+private:
+  static void unsupported() { throw runtime_error("not supported"); }
+
+  vector<shared_ptr<models::hypers>> hypers_;
+  vector<shared_ptr<models::group>> groups_;
+};
+
+static void
+test_hp_handle()
+{
+  auto h = models::distributions_model<BetaBernoulli>().create_hypers();
+  models::hp_handle<float> alpha(*h, "alpha");
+  alpha.set(3.0);
+  MICROSCOPES_CHECK(
+      almost_eq(h->get_hp_mutator("alpha").accessor().get<float>(0), 3.0),
+      "handle did not write through");
+  h->get_hp_mutator("alpha").set<float>(4.0);
+  MICROSCOPES_CHECK(almost_eq(alpha.get(), 4.0), "handle did not read through");
+
+  bool threw = false;
+  try {
+    models::hp_handle<double> bad(*h, "alpha");
+  } catch (runtime_error &) {
+    threw = true;
+  }
+  MICROSCOPES_CHECK(threw, "type mismatch not detected");
+}
+
+// resolving a handle leaves caches alone; set() invalidates them
+static void
+test_hp_handle_invalidates()
+{
+  rng_t r(1290);
+  auto h = models::distributions_model<BetaBernoulli>().create_hypers();
+  h->get_hp_mutator("alpha").set<float>(1.0);
+  h->get_hp_mutator("beta").set<float>(1.0);
+  h->hp_changed();
+  auto mix = h->create_mixture();
+  mix->create_group(0, *h, r);
+  models::hp_handle<float> alpha(*h, "alpha");
+  MICROSCOPES_CHECK(mix->cached(0, *h), "resolving a handle disabled caching");
+  alpha.set(2.0);
+  MICROSCOPES_CHECK(!mix->cached(0, *h), "set() did not invalidate");
+  mix->refresh(*h, r);
+  MICROSCOPES_CHECK(mix->cached(0, *h), "not cached after refresh()");
+
+  // dm trusts its lgamma tables to be cleared on every change
+  const size_t k = 4;
+  auto dh = models::dm_model(k).create_hypers();
+  vector<models::hp_handle<float>> alphas;
+  for (size_t i = 0; i < k; i++) {
+    alphas.emplace_back(*dh, "alphas", i);
+    alphas.back().set(1.0);
+  }
+  auto g = dh->create_group(r);
+  vector<unsigned> row = {3, 0, 1, 2};
+  g->add_value(*dh,
+      value_accessor(reinterpret_cast<const uint8_t *>(row.data()), nullptr,
+                     runtime_type(TYPE_U32, k)), r);
+  const float before = g->score_data(*dh, r);
+  alphas[0].set(5.0);
+  const float after = g->score_data(*dh, r);
+  auto dh1 = models::dm_model(k).create_hypers();
+  dh1->set_hp(*dh);
+  MICROSCOPES_CHECK(!almost_eq(before, after), "stale lgamma table");
+  MICROSCOPES_CHECK(almost_eq(after, g->score_data(*dh1, r)), "score mismatch");
+}
+
+static void
+test_feature_rescorer()
+{
+  rng_t r(3472);
+  auto h = models::distributions_model<BetaBernoulli>().create_hypers();
+  models::hp_handle<float> alpha(*h, "alpha"), beta(*h, "beta");
+  alpha.set(1.0);
+  beta.set(1.0);
+
+  vector<shared_ptr<models::group>> groups;
+  for (size_t i = 0; i < 10; i++) {
+    groups.emplace_back(h->create_group(r));
+    for (size_t j = 0; j < i; j++) {
+      bool v = j % 3;
+      groups.back()->add_value(*h, value_accessor(&v), r);
+    }
+  }
+
+  auto naive = [&]() {
+    float sum = 0.;
+    for (const auto &g : groups)
+      sum += g->score_data(*h, r);
+    return sum;
+  };
+
+  models::feature_rescorer rescorer(*h, {"alpha", "beta"});
+  const float s0 = rescorer.score_data(groups, r);
+  MICROSCOPES_CHECK(almost_eq(s0, naive()), "score mismatch");
+
+  alpha.set(2.0);
+  const float s1 = rescorer.score_data(groups, r);
+  MICROSCOPES_CHECK(almost_eq(s1, naive()), "score mismatch");
+  MICROSCOPES_CHECK(!almost_eq(s0, s1), "score did not change");
+
+  alpha.set(1.0);
+  MICROSCOPES_CHECK(rescorer.score_data(groups, r) == s0, "cache miss");
+
+  // after invalidation the groups are rescored
+  bool v = true;
+  groups[0]->add_value(*h, value_accessor(&v), r);
+  rescorer.invalidate();
+  MICROSCOPES_CHECK(almost_eq(rescorer.score_data(groups, r), naive()),
+      "stale score");
+}
+
+static void
+test_ss_histogram()
+{
+  rng_t r(9832);
+  auto h = models::distributions_model<GammaPoisson>().create_hypers();
+  h->get_hp_mutator("alpha").set<float>(1.0);
+  h->get_hp_mutator("inv_beta").set<float>(1.0);
+
+  // many groups, few distinct suff stats
+  vector<shared_ptr<models::group>> groups;
+  for (size_t i = 0; i < 100; i++) {
+    groups.emplace_back(h->create_group(r));
+    for (size_t j = 0; j < i % 5; j++) {
+      unsigned v = j;
+      groups.back()->add_value(*h, value_accessor(&v), r);
+    }
+  }
+  models::ss_histogram hist(*h);
+  hist.build(groups, r);
+  MICROSCOPES_CHECK(hist.size() == 5, "suff stats not collapsed");
+  MICROSCOPES_CHECK(hist.count() == groups.size(), "wrong # of groups");
+
+  auto naive = [&]() {
+    float sum = 0.;
+    for (const auto &g : groups)
+      sum += g->score_data(*h, r);
+    return sum;
+  };
+
+  models::feature_rescorer rescorer(*h, {"alpha", "inv_beta"});
+  for (float alpha : {0.5, 1.0, 2.0}) {
+    h->get_hp_mutator("alpha").set<float>(alpha);
+    MICROSCOPES_CHECK(
+        almost_eq(rescorer.score_data(hist, r), naive()), "score mismatch");
+  }
+
+  // rebuilt after the groups change
+  unsigned v = 7;
+  groups[0]->add_value(*h, value_accessor(&v), r);
+  hist.build(groups, r);
+  rescorer.invalidate();
+  MICROSCOPES_CHECK(hist.count() == groups.size(), "wrong # of groups");
+  MICROSCOPES_CHECK(hist.size() == 6, "wrong # of distinct suff stats");
+  MICROSCOPES_CHECK(
+      almost_eq(rescorer.score_data(hist, r), naive()), "score mismatch");
+}
+
+// kernels write hypers through the state's mutators, and never call
+// hp_changed(); the scores must follow regardless
+static void
+test_state_hp_mutator_bbnc()
+{
+  rng_t r(5512);
+  auto h = models::bbnc_model().create_hypers();
+  h->get_hp_mutator("alpha").set<float>(1.0);
+  h->get_hp_mutator("beta").set<float>(1.0);
+  components_state s({h}, r);
+  bool t = true, f = false;
+  for (size_t i = 0; i < 10; i++)
+    s.group(0).add_value(s.hypers(0), value_accessor(i % 3 ? &t : &f), r);
+
+  auto fresh = models::bbnc_model().create_hypers();
+  for (float alpha : {1.0, 2.5, 0.5}) {
+    s.get_component_hp_mutator(0, "alpha").set<float>(alpha);
+    s.get_component_hp_mutator(0, "beta").set<float>(alpha + 1.);
+    fresh->set_hp(s.get_component_hp(0));
+    MICROSCOPES_CHECK(
+        almost_eq(s.score_likelihood(0, r), s.group(0).score_data(*fresh, r)),
+        "stale bbnc score_data");
+  }
+}
+
+// as above, for the models which cache against a hypers stamp or their
+// alphas: dm's lgamma tables and alpha sum, and a distributions mixture
+static void
+test_state_hp_mutator_cached()
+{
+  rng_t r(6631);
+  const size_t k = 4;
+  auto dh = models::dm_model(k).create_hypers();
+  auto bh = models::distributions_model<BetaBernoulli>().create_hypers();
+  for (size_t i = 0; i < k; i++)
+    dh->get_hp_mutator("alphas").set<float>(1.0, i);
+  bh->get_hp_mutator("alpha").set<float>(1.0);
+  bh->get_hp_mutator("beta").set<float>(1.0);
+  components_state s({dh, bh}, r);
+
+  vector<unsigned> row = {3, 0, 1, 2};
+  s.group(0).add_value(s.hypers(0),
+      value_accessor(reinterpret_cast<const uint8_t *>(row.data()), nullptr,
+                     runtime_type(TYPE_U32, k)), r);
+  auto mix = bh->create_mixture();
+  mix->create_group(0, *bh, r);
+  bool t = true;
+  mix->add_value(0, *bh, value_accessor(&t), r);
+
+  auto dh1 = models::dm_model(k).create_hypers();
+  auto bh1 = models::distributions_model<BetaBernoulli>().create_hypers();
+  for (float alpha : {1.0, 3.0, 0.5}) {
+    for (size_t i = 0; i < k; i++)
+      s.get_component_hp_mutator(0, "alphas").set<float>(alpha * (i + 1), i);
+    dh1->set_hp(s.get_component_hp(0));
+    MICROSCOPES_CHECK(
+        almost_eq(s.score_likelihood(0, r), s.group(0).score_data(*dh1, r)),
+        "stale dm score_data");
+
+    s.get_component_hp_mutator(1, "alpha").set<float>(alpha);
+    MICROSCOPES_CHECK(!mix->cached(0, *bh), "stale mixture scorer");
+    bh1->set_hp(s.get_component_hp(1));
+    MICROSCOPES_CHECK(
+        almost_eq(mix->score_value(0, *bh, value_accessor(&t), r),
+                  mix->get_group(0).score_value(*bh1, value_accessor(&t), r)),
+        "stale mixture score");
+    mix->refresh(*bh, r);
+  }
+}
+
+int
+main(void)
+{
+  test_hp_handle();
+  test_state_hp_mutator_bbnc();
+  test_state_hp_mutator_cached();
+  test_hp_handle_invalidates();
+  test_feature_rescorer();
+  test_ss_histogram();
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <microscopes/common/metrics.hpp>
+#include <microscopes/common/util.hpp>
+#include <microscopes/common/macros.hpp>
+#include <microscopes/io/schema.pb.h>
+
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace microscopes;
+using namespace microscopes::common;
+
+static void
+test_threads()
+{
+  metrics::reset();
+  MICROSCOPES_METRIC_ADD(M_GROUP_ADD_VALUE, 3);
+  thread t([]() {
+    for (size_t i = 0; i < 1000; i++)
+      MICROSCOPES_METRIC_INC(M_GROUP_ADD_VALUE);
+    MICROSCOPES_METRIC_OBSERVE(H_MIXTURE_GROUPS, 5);
+  });
+  t.join();
+
+  // includes the exited thread
+  auto r = metrics::aggregate();
+  MICROSCOPES_CHECK(r.counters_["group.add_value"] == 1003, "wrong count");
+  MICROSCOPES_CHECK(r.counters_["group.remove_value"] == 0, "wrong count");
+  const auto &h = r.histograms_["mixture.groups_scored"];
+  MICROSCOPES_CHECK(h.size() == metrics::NBuckets, "wrong # of buckets");
+  MICROSCOPES_CHECK(h[3] == 1, "5 belongs in [4, 8)");
+
+  metrics::reset();
+  r = metrics::aggregate();
+  MICROSCOPES_CHECK(r.counters_["group.add_value"] == 0, "not reset");
+  MICROSCOPES_CHECK(r.histograms_["mixture.groups_scored"][3] == 0, "not reset");
+}
+
+static void
+test_buckets()
+{
+  MICROSCOPES_CHECK(metrics::bucket(0) == 0, "bad bucket");
+  MICROSCOPES_CHECK(metrics::bucket(1) == 1, "bad bucket");
+  MICROSCOPES_CHECK(metrics::bucket(2) == 2, "bad bucket");
+  MICROSCOPES_CHECK(metrics::bucket(3) == 2, "bad bucket");
+  MICROSCOPES_CHECK(metrics::bucket(1024) == 11, "bad bucket");
+  MICROSCOPES_CHECK(metrics::bucket(~uint64_t(0)) == 64, "bad bucket");
+}
+
+static void
+test_protobuf_bytes()
+{
+  metrics::reset();
+  io::CRP m;
+  m.set_alpha(2.);
+  const string s = util::protobuf_to_string(m);
+  util::protobuf_from_string(m, s);
+  auto r = metrics::aggregate();
+  MICROSCOPES_CHECK(
+      r.counters_["protobuf.bytes_serialized"] == s.size(), "wrong # of bytes");
+  MICROSCOPES_CHECK(
+      r.counters_["protobuf.bytes_deserialized"] == s.size(), "wrong # of bytes");
+}
+
+int
+main(void)
+{
+  test_threads();
+  test_buckets();
+  test_protobuf_bytes();
+  cout << "metrics compiled into the library: " << metrics::enabled() << endl;
+  return 0;
+}
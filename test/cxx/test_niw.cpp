@@ -0,0 +1,153 @@
+#include <microscopes/models/niw.hpp>
+#include <microscopes/common/random_fwd.hpp>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace microscopes;
+using namespace microscopes::common;
+
+static inline bool
+almost_eq(float a, float b)
+{
+  return fabs(a - b) <= 1e-3 * max(1.f, fabs(a));
+}
+
+static void
+test_incremental(unsigned dim)
+{
+  rng_t r(4418);
+  models::niw_model model(dim);
+  auto h = model.create_hypers();
+
+  normal_distribution<float> norm;
+  vector<vector<float>> rows;
+  auto g = h->create_group(r);
+  for (size_t n = 0; n < 300; n++) {
+    rows.emplace_back(dim);
+    for (unsigned i = 0; i < dim; i++)
+      rows.back()[i] = 3. * norm(r) + i;
+    value_accessor acc(
+        reinterpret_cast<const uint8_t *>(rows.back().data()), nullptr,
+        runtime_type(TYPE_F32, dim));
+
+    // score_value() is the predictive, so it is the score_data() delta
+    const float before = g->score_data(*h, r);
+    const float pred = g->score_value(*h, acc, r);
+    g->add_value(*h, acc, r);
+    MICROSCOPES_CHECK(
+        almost_eq(g->score_data(*h, r) - before, pred), "predictive mismatch");
+  }
+
+  // remove every other row; the updated factor must agree with one computed
+  // from scratch (by set_ss())
+  for (size_t n = 0; n < rows.size(); n += 2) {
+    value_accessor acc(
+        reinterpret_cast<const uint8_t *>(rows[n].data()), nullptr,
+        runtime_type(TYPE_F32, dim));
+    g->remove_value(*h, acc, r);
+  }
+  auto g1 = h->create_group(r);
+  g1->set_ss(g->get_ss());
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_data(*h, r), g1->score_data(*h, r)),
+      "score_data mismatch after removal");
+  value_accessor acc0(
+      reinterpret_cast<const uint8_t *>(rows[0].data()), nullptr,
+      runtime_type(TYPE_F32, dim));
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_value(*h, acc0, r), g1->score_value(*h, acc0, r)),
+      "score_value mismatch after removal");
+
+  // removing everything gets us back to the prior
+  for (size_t n = 1; n < rows.size(); n += 2) {
+    value_accessor acc(
+        reinterpret_cast<const uint8_t *>(rows[n].data()), nullptr,
+        runtime_type(TYPE_F32, dim));
+    g->remove_value(*h, acc, r);
+  }
+  auto empty = h->create_group(r);
+  MICROSCOPES_CHECK(
+      almost_eq(g->score_value(*h, acc0, r), empty->score_value(*h, acc0, r)),
+      "empty group mismatch");
+
+  // changing the hypers invalidates the cached factors
+  g1->add_value(*h, acc0, r);
+  auto g2 = h->create_group(r);
+  g2->set_ss(g1->get_ss());
+  distributions::protobuf::NormalInverseWishart_Shared m;
+  util::protobuf_from_string(m, h->get_hp());
+  m.set_kappa(2.5);
+  m.set_nu(dim + 3.);
+  h->set_hp(util::protobuf_to_string(m));
+  MICROSCOPES_CHECK(
+      almost_eq(g1->score_data(*h, r), g2->score_data(*h, r)),
+      "stale posterior");
+}
+
+// the fixed size instantiations must agree with the dynamic one
+template <int D>
+static void
+test_fixed_vs_dynamic()
+{
+  rng_t r(832);
+  models::niw_hypers<D> h(D);
+  models::niw_hypers<Eigen::Dynamic> hd(D);
+  models::niw_group<D> g(h);
+  models::niw_group<Eigen::Dynamic> gd(hd);
+
+  normal_distribution<float> norm;
+  float x[D];
+  value_accessor acc(
+      reinterpret_cast<const uint8_t *>(x), nullptr, runtime_type(TYPE_F32, D));
+  for (size_t n = 0; n < 50; n++) {
+    for (unsigned i = 0; i < D; i++)
+      x[i] = norm(r) - i;
+    MICROSCOPES_CHECK(
+        almost_eq(g.score_value(h, acc, r), gd.score_value(hd, acc, r)),
+        "score_value mismatch");
+    g.add_value(h, acc, r);
+    gd.add_value(hd, acc, r);
+  }
+  MICROSCOPES_CHECK(
+      almost_eq(g.score_data(h, r), gd.score_data(hd, r)),
+      "score_data mismatch");
+  MICROSCOPES_CHECK(g.get_ss() == gd.get_ss(), "suff stats mismatch");
+
+  // set_hp() (and set_ss()) leave groups to refresh their posterior when
+  // next used, and scoring keeps the refreshed posterior
+  models::niw_group<D> g1(h);
+  g1.set_ss(g.get_ss());
+  MICROSCOPES_CHECK(!g1.cached(h), "set_ss() kept the old posterior");
+  distributions::protobuf::NormalInverseWishart_Shared m;
+  util::protobuf_from_string(m, h.get_hp());
+  m.set_kappa(3.);
+  m.set_nu(D + 2.);
+  h.set_hp(util::protobuf_to_string(m));
+  hd.set_hp(util::protobuf_to_string(m));
+  MICROSCOPES_CHECK(!g.cached(h) && !gd.cached(hd),
+      "set_hp() refreshed groups eagerly");
+  MICROSCOPES_CHECK(
+      almost_eq(g.score_value(h, acc, r), gd.score_value(hd, acc, r)),
+      "score_value mismatch after set_hp");
+  MICROSCOPES_CHECK(
+      almost_eq(g1.score_data(h, r), gd.score_data(hd, r)),
+      "score_data mismatch after set_hp");
+  MICROSCOPES_CHECK(g.cached(h) && g1.cached(h) && gd.cached(hd),
+      "scoring did not refresh the posterior");
+}
+
+int
+main(void)
+{
+  test_incremental(1);
+  test_incremental(3);
+  test_incremental(8);
+  test_incremental(12);
+  test_fixed_vs_dynamic<2>();
+  test_fixed_vs_dynamic<5>();
+  test_fixed_vs_dynamic<8>();
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <microscopes/common/partition.hpp>
+#include <microscopes/common/random_fwd.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace microscopes::common;
+
+static void
+test_labels()
+{
+  const vector<ssize_t> avec({34, 34, 5, 11, 5, 5433, -1});
+  MICROSCOPES_CHECK(partition::canonical(avec) ==
+      vector<ssize_t>({0, 0, 1, 2, 1, 3, 4}), "wrong canonical labels");
+  MICROSCOPES_CHECK(partition::canonical(partition::canonical(avec)) ==
+      partition::canonical(avec), "canonical labels not a fixed point");
+
+  const auto groups = partition::groups(avec);
+  MICROSCOPES_CHECK(groups.ngroups() == 5, "wrong # of groups");
+  MICROSCOPES_CHECK(groups.offsets_ ==
+      vector<size_t>({0, 2, 4, 5, 6, 7}), "wrong offsets");
+  MICROSCOPES_CHECK(groups.members_ ==
+      vector<size_t>({0, 1, 2, 4, 3, 5, 6}), "wrong members");
+
+  MICROSCOPES_CHECK(partition::size_histogram(avec) ==
+      vector<size_t>({0, 3, 2}), "wrong histogram");
+  MICROSCOPES_CHECK(partition::size_histogram({}) ==
+      vector<size_t>({0}), "wrong empty histogram");
+}
+
+// the definitions, over all pairs of entities
+static double
+pairwise_ari(const vector<ssize_t> &a, const vector<ssize_t> &b)
+{
+  double tp = 0, fp = 0, fn = 0, tn = 0;
+  for (size_t i = 0; i < a.size(); i++)
+    for (size_t j = i + 1; j < a.size(); j++) {
+      const bool sa = a[i] == a[j], sb = b[i] == b[j];
+      tp += sa && sb;
+      fp += !sa && sb;
+      fn += sa && !sb;
+      tn += !sa && !sb;
+    }
+  return 2. * (tp * tn - fn * fp) / ((tp + fn) * (fn + tn) + (tp + fp) * (fp + tn));
+}
+
+static double
+entropy_vi(const vector<ssize_t> &a, const vector<ssize_t> &b)
+{
+  map<ssize_t, double> pa, pb;
+  map<pair<ssize_t, ssize_t>, double> pab;
+  const double n = a.size();
+  for (size_t i = 0; i < a.size(); i++) {
+    pa[a[i]] += 1. / n;
+    pb[b[i]] += 1. / n;
+    pab[make_pair(a[i], b[i])] += 1. / n;
+  }
+  double ha = 0, hb = 0, hab = 0;
+  for (auto &p : pa)
+    ha -= p.second * log(p.second);
+  for (auto &p : pb)
+    hb -= p.second * log(p.second);
+  for (auto &p : pab)
+    hab -= p.second * log(p.second);
+  return 2. * hab - ha - hb;
+}
+
+static void
+test_metrics()
+{
+  const vector<ssize_t> a({0, 0, 1, 1}), b({0, 0, 1, 2});
+  MICROSCOPES_CHECK(fabs(partition::adjusted_rand_index(a, b) - 4. / 7.) < 1e-9,
+      "wrong ARI");
+  MICROSCOPES_CHECK(
+      fabs(partition::variation_of_information(a, b) - log(2.) / 2.) < 1e-9,
+      "wrong VI");
+
+  // equal partitions, up to labels
+  const vector<ssize_t> c({7, 7, -3, -3});
+  MICROSCOPES_CHECK(partition::adjusted_rand_index(a, c) == 1., "ARI not 1");
+  MICROSCOPES_CHECK(partition::variation_of_information(a, c) == 0., "VI not 0");
+  MICROSCOPES_CHECK(partition::adjusted_rand_index({1, 1, 1}, {2, 2, 2}) == 1.,
+      "ARI of one group not 1");
+  MICROSCOPES_CHECK(partition::adjusted_rand_index({1, 2, 3}, {3, 1, 2}) == 1.,
+      "ARI of singletons not 1");
+
+  // few groups (a dense contingency table) and many (a hashed one)
+  rng_t r(7);
+  for (size_t k : {3, 200}) {
+    uniform_int_distribution<ssize_t> d(-5, k - 6);
+    vector<ssize_t> x(1000), y(1000);
+    for (size_t i = 0; i < x.size(); i++) {
+      x[i] = d(r);
+      y[i] = (i % 3) ? x[i] * 3 : d(r);
+    }
+    const double ari = partition::adjusted_rand_index(x, y);
+    const double vi = partition::variation_of_information(x, y);
+    MICROSCOPES_CHECK(fabs(ari - pairwise_ari(x, y)) < 1e-9, "wrong ARI");
+    MICROSCOPES_CHECK(fabs(vi - entropy_vi(x, y)) < 1e-9, "wrong VI");
+    MICROSCOPES_CHECK(ari == partition::adjusted_rand_index(y, x), "ARI not symmetric");
+    MICROSCOPES_CHECK(vi > 0. && vi <= log(1000.), "VI out of range");
+  }
+}
+
+int
+main(void)
+{
+  test_labels();
+  test_metrics();
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <microscopes/common/util.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace microscopes::common;
+
+static bool
+is_permutation_of_range(const vector<uint32_t> &pi, size_t n)
+{
+  if (pi.size() != n)
+    return false;
+  vector<bool> seen(n);
+  for (auto i : pi) {
+    if (i >= n || seen[i])
+      return false;
+    seen[i] = true;
+  }
+  return true;
+}
+
+static void
+test_bounded_rand()
+{
+  rng_t r(5);
+  for (uint32_t range : {1u, 2u, 3u, 7u, 1000u, 0x80000001u, 0xFFFFFFFFu})
+    for (size_t i = 0; i < 1000; i++)
+      MICROSCOPES_CHECK(util::bounded_rand(r, range) < range, "out of range");
+
+  // roughly uniform: a chi-squared statistic, 9 degrees of freedom
+  const size_t ndraws = 100000;
+  vector<size_t> counts(10);
+  for (size_t i = 0; i < ndraws; i++)
+    counts[util::bounded_rand(r, 10)]++;
+  double chi2 = 0.;
+  for (auto c : counts)
+    chi2 += (c - ndraws / 10.) * (c - ndraws / 10.) / (ndraws / 10.);
+  MICROSCOPES_CHECK(chi2 < 30., "not uniform");
+}
+
+static void
+test_permute()
+{
+  rng_t r(11);
+  vector<uint32_t> pi;
+  for (size_t n : {0, 1, 2, 1000}) {
+    util::inplace_permute(pi, n, r);
+    MICROSCOPES_CHECK(is_permutation_of_range(pi, n), "not a permutation");
+  }
+
+  // every element lands in every position about equally often
+  const size_t n = 5, ntrials = 50000;
+  vector<size_t> counts(n * n);
+  for (size_t t = 0; t < ntrials; t++) {
+    util::inplace_permute(pi, n, r);
+    for (size_t i = 0; i < n; i++)
+      counts[i * n + pi[i]]++;
+  }
+  for (auto c : counts)
+    MICROSCOPES_CHECK(fabs(double(c) / ntrials - 1. / n) < 0.01, "biased shuffle");
+}
+
+static void
+test_blocked_permute()
+{
+  rng_t r(13);
+  vector<uint32_t> pi, blocks;
+  for (size_t n : {0, 1, 64, 1000})
+    for (size_t blocksize : {1, 7, 64, 5000}) {
+      util::inplace_blocked_permute(pi, blocks, n, blocksize, r);
+      MICROSCOPES_CHECK(is_permutation_of_range(pi, n), "not a permutation");
+
+      // each block is visited in one stretch
+      for (size_t i = 0; i < n;) {
+        const size_t begin = pi[i] / blocksize * blocksize;
+        const size_t end = min(n, begin + blocksize);
+        for (size_t j = i; j < i + end - begin; j++)
+          MICROSCOPES_CHECK(pi[j] >= begin && pi[j] < end, "block split up");
+        i += end - begin;
+      }
+    }
+
+  // the order of the blocks is random
+  size_t firsts = 0;
+  for (size_t t = 0; t < 1000; t++) {
+    util::inplace_blocked_permute(pi, blocks, 100, 10, r);
+    firsts += pi[0] < 10;
+  }
+  MICROSCOPES_CHECK(firsts > 50 && firsts < 150, "blocks not shuffled");
+}
+
+int
+main(void)
+{
+  test_bounded_rand();
+  test_permute();
+  test_blocked_permute();
+  return 0;
+}
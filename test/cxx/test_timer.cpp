@@ -0,0 +1,79 @@
+#include <microscopes/common/timer.hpp>
+#include <microscopes/common/profiler.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace microscopes::common;
+
+static void
+test_clocks()
+{
+  for (auto m : {timer::T_CLK_MONOTONIC, timer::T_CLK_TSC}) {
+    uint64_t prev = timer::cur_nsec(m);
+    for (size_t i = 0; i < 1000; i++) {
+      const uint64_t cur = timer::cur_nsec(m);
+      MICROSCOPES_CHECK(cur >= prev, "clock went backwards");
+      prev = cur;
+    }
+  }
+
+  // the TSC agrees with the monotonic clock
+  timer mono(timer::T_CLK_MONOTONIC), tsc(timer::T_CLK_TSC);
+  this_thread::sleep_for(chrono::milliseconds(20));
+  const double a = mono.elapsed_nsec(), b = tsc.elapsed_nsec();
+  MICROSCOPES_CHECK(a >= 20e6, "slept too little");
+  MICROSCOPES_CHECK(fabs(a - b) / a < 0.05, "TSC is off");
+}
+
+static void
+work(size_t n)
+{
+  volatile double x = 0.;
+  for (size_t i = 0; i < n; i++)
+    x = x + sqrt(double(i));
+}
+
+static void
+test_profiler()
+{
+  profiler &p = profiler::local();
+  p.reset();
+  for (size_t i = 0; i < 10; i++) {
+    MICROSCOPES_PROFILE_REGION("outer");
+    work(1000);
+    for (size_t j = 0; j < 5; j++) {
+      MICROSCOPES_PROFILE_REGION("inner");
+      work(1000);
+    }
+  }
+  {
+    MICROSCOPES_PROFILE_REGION("inner"); // a different node than outer/inner
+  }
+
+  const auto &root = p.root();
+  MICROSCOPES_CHECK(root.children_.size() == 2, "wrong # of top level regions");
+  const auto &outer = *root.children_[0];
+  MICROSCOPES_CHECK(outer.count_ == 10, "wrong outer count");
+  MICROSCOPES_CHECK(outer.children_.size() == 1, "wrong # of subregions");
+  const auto &inner = *outer.children_[0];
+  MICROSCOPES_CHECK(inner.count_ == 50, "wrong inner count");
+  MICROSCOPES_CHECK(inner.ticks_ <= outer.ticks_, "subregion longer than region");
+  MICROSCOPES_CHECK(root.children_[1]->count_ == 1, "wrong count");
+  cout << p.report();
+
+  p.reset();
+  MICROSCOPES_CHECK(p.root().children_.empty(), "not reset");
+}
+
+int
+main(void)
+{
+  test_clocks();
+  test_profiler();
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <microscopes/common/trace.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace microscopes::common;
+
+static size_t
+count(const string &s, const string &needle)
+{
+  size_t n = 0;
+  for (size_t pos = s.find(needle); pos != string::npos; pos = s.find(needle, pos + 1))
+    n++;
+  return n;
+}
+
+// the folded lines, as stack -> nsec
+static map<string, uint64_t>
+folded()
+{
+  ostringstream oss;
+  trace::write_folded(oss);
+  istringstream iss(oss.str());
+  map<string, uint64_t> ret;
+  string stack;
+  uint64_t nsec;
+  while (iss >> stack >> nsec)
+    ret[stack] = nsec;
+  return ret;
+}
+
+static void
+sweep(size_t n)
+{
+  MICROSCOPES_TRACE_SPAN("sweep");
+  for (size_t i = 0; i < n; i++) {
+    MICROSCOPES_TRACE_SPAN_ARG("entity", i);
+    {
+      MICROSCOPES_TRACE_SPAN("score");
+    }
+    {
+      MICROSCOPES_TRACE_SPAN("add_value");
+    }
+  }
+}
+
+static void
+test_nesting()
+{
+  sweep(10); // not traced
+
+  trace::start(1024);
+  sweep(10);
+  thread t([]() { sweep(5); });
+  t.join();
+  trace::stop();
+
+  ostringstream oss;
+  trace::write_chrome_trace(oss);
+  const string s = oss.str();
+  // 2 sweeps, 15 entities, 30 leaves
+  MICROSCOPES_CHECK(count(s, "\"ph\": \"X\"") == 47, "wrong # of spans");
+  MICROSCOPES_CHECK(count(s, "\"name\": \"sweep\"") == 2, "wrong # of sweeps");
+  MICROSCOPES_CHECK(count(s, "\"args\": {\"arg\": 9}") == 1, "missing arg");
+
+  const auto stacks = folded();
+  MICROSCOPES_CHECK(stacks.size() == 4, "wrong # of stacks");
+  MICROSCOPES_CHECK(stacks.count("sweep;entity;score"), "missing stack");
+  MICROSCOPES_CHECK(stacks.count("sweep;entity;add_value"), "missing stack");
+}
+
+static void
+test_overwrite()
+{
+  // the ring only holds the last 16 events; sweep's begin is lost, so only
+  // complete entity spans survive
+  trace::start(16);
+  sweep(100);
+  trace::stop();
+
+  const auto stacks = folded();
+  MICROSCOPES_CHECK(!stacks.count("sweep"), "sweep should have been dropped");
+  MICROSCOPES_CHECK(stacks.count("entity;score"), "missing stack");
+
+  ostringstream oss;
+  trace::write_chrome_trace(oss);
+  MICROSCOPES_CHECK(count(oss.str(), "\"name\": \"entity\"") <= 3, "too many spans");
+
+  // restarting clears the buffers
+  trace::start(16);
+  trace::stop();
+  MICROSCOPES_CHECK(folded().empty(), "not cleared");
+}
+
+static void
+test_exited_threads()
+{
+  // each sweep(1) is 8 events; a thread's buffer is freed when it exits, and
+  // only the last 64 retired events (those of 8 threads) are kept
+  trace::start(64, 16);
+  const size_t live = trace::detail::live_buffers();
+  for (size_t i = 0; i < 20; i++) {
+    thread t([]() { sweep(1); });
+    t.join();
+  }
+  MICROSCOPES_CHECK(trace::detail::live_buffers() == live, "buffers leaked");
+  trace::stop();
+
+  ostringstream oss;
+  trace::write_chrome_trace(oss);
+  MICROSCOPES_CHECK(count(oss.str(), "\"name\": \"sweep\"") == 8,
+      "wrong # of retained sweeps");
+
+  // worker buffers are sized by worker_capacity: of sweep(5)'s 32 events
+  // only the last 16 (2 whole entities, and the end of sweep) are kept
+  trace::start(1024, 16);
+  thread t([]() { sweep(5); });
+  t.join();
+  trace::stop();
+  oss.str("");
+  trace::write_chrome_trace(oss);
+  MICROSCOPES_CHECK(count(oss.str(), "\"name\": \"entity\"") == 2,
+      "wrong # of worker entities");
+  MICROSCOPES_CHECK(count(oss.str(), "\"name\": \"sweep\"") == 0,
+      "sweep should be overwritten");
+}
+
+int
+main(void)
+{
+  test_nesting();
+  test_overwrite();
+  test_exited_threads();
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include <microscopes/common/workload.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+
+using namespace std;
+using namespace microscopes::common;
+using namespace microscopes::common::workload;
+
+static void
+test_recarray()
+{
+  recarray_config config;
+  config.rows_ = 5000;
+  config.types_ = mixed_types(7);
+  config.mask_density_ = 0.2;
+  config.clustering_ = clustering(10, 1.5);
+
+  rng_t r0(73);
+  recarray_workload w(config, r0);
+  auto view = w.dataview();
+  MICROSCOPES_CHECK(view->size() == config.rows_, "wrong # of rows");
+
+  size_t masked = 0, total = 0;
+  for (view->reset(); !view->end(); view->next()) {
+    auto acc = view->get();
+    for (acc.reset(); !acc.end(); acc.bump())
+      for (size_t i = 0; i < acc.curshape(); i++, total++)
+        masked += acc.ismasked(i);
+  }
+  MICROSCOPES_CHECK(fabs(float(masked) / total - 0.2) < 0.02, "wrong mask density");
+
+  // zipf distributed cluster sizes
+  vector<size_t> sizes(10);
+  for (auto k : w.assignments())
+    sizes[k]++;
+  MICROSCOPES_CHECK(sizes[0] > 4 * sizes[9], "cluster sizes not heavy tailed");
+
+  // copy_rows() matches row by row access, permuted (fully or blocked) or not
+  for (size_t pass = 0; pass < 3; pass++) {
+    if (pass == 1)
+      view->permute(r0);
+    else if (pass == 2)
+      view->permute_blocked(r0, 16);
+    const size_t begin = 100, end = 200;
+    vector<uint8_t> rows((end - begin) * view->rowsize());
+    unique_ptr<bool[]> masks(new bool[(end - begin) * view->maskrowsize()]);
+    view->copy_rows(begin, end, rows.data(), masks.get());
+    view->reset();
+    for (size_t i = 0; i < begin; i++)
+      view->next();
+    for (size_t i = 0; i < end - begin; i++, view->next()) {
+      const size_t pos = view->index();
+      MICROSCOPES_CHECK(!memcmp(&rows[i * view->rowsize()],
+          w.data() + pos * view->rowsize(), view->rowsize()), "rows differ");
+      MICROSCOPES_CHECK(!memcmp(&masks[i * view->maskrowsize()],
+          w.mask() + pos * view->maskrowsize(), view->maskrowsize()), "masks differ");
+    }
+  }
+  view->reset_permutation();
+
+  // reproducible, and the same whether backed by memory or a file
+  config.path_ = "/tmp/microscopes_test_workload.bin";
+  rng_t r1(73);
+  recarray_workload w1(config, r1);
+  MICROSCOPES_CHECK(w1.nbytes() == w.nbytes(), "sizes differ");
+  MICROSCOPES_CHECK(
+      !memcmp(w1.data(), w.data(), w.nbytes()), "workloads differ");
+  remove(config.path_.c_str());
+}
+
+static void
+test_variadic()
+{
+  variadic_config config;
+  config.rows_ = 10000;
+  config.mean_rowsize_ = 10.;
+  config.clustering_ = clustering(5, 1.);
+
+  rng_t r(12);
+  variadic_workload w(config, r);
+  auto view = w.dataview();
+  MICROSCOPES_CHECK(view->size() == config.rows_, "wrong # of rows");
+  size_t nvalues = 0;
+  for (size_t i = 0; i < view->size(); i++)
+    nvalues += view->get(i).n();
+  MICROSCOPES_CHECK(
+      fabs(float(nvalues) / config.rows_ - 10.) < 0.5, "wrong mean row size");
+}
+
+static void
+test_relation(bool sparse, float density)
+{
+  relation_config config;
+  config.rows_ = 300;
+  config.cols_ = 200;
+  config.density_ = density;
+  config.sparse_ = sparse;
+  config.row_clustering_ = clustering(4, 1.);
+  config.col_clustering_ = clustering(3, 0.);
+
+  rng_t r(5);
+  relation_workload w(config, r);
+  auto view = w.dataview();
+  MICROSCOPES_CHECK(
+      fabs(float(w.nnz()) / (config.rows_ * config.cols_) - density) < 0.02,
+      "wrong density");
+
+  // the row slices and the column slices agree
+  map<pair<size_t, size_t>, bool> cells;
+  for (size_t i = 0; i < config.rows_; i++)
+    for (auto &p : view->slice(0, i)) {
+      MICROSCOPES_CHECK(p.first[0] == i, "not a valid slice");
+      cells[make_pair(p.first[0], p.first[1])] = p.second.get<bool>(0);
+    }
+  MICROSCOPES_CHECK(cells.size() == w.nnz(), "wrong # of entries");
+  size_t n = 0;
+  for (size_t j = 0; j < config.cols_; j++)
+    for (auto &p : view->slice(1, j)) {
+      MICROSCOPES_CHECK(p.first[1] == j, "not a valid slice");
+      const auto it = cells.find(make_pair(p.first[0], p.first[1]));
+      MICROSCOPES_CHECK(it != cells.end(), "entry missing from rows");
+      MICROSCOPES_CHECK(it->second == p.second.get<bool>(0), "values differ");
+      n++;
+    }
+  MICROSCOPES_CHECK(n == w.nnz(), "wrong # of entries");
+}
+
+int
+main(void)
+{
+  test_recarray();
+  test_variadic();
+  test_relation(false, 1.);
+  test_relation(false, 0.3);
+  test_relation(true, 0.05);
+  test_relation(true, 0.6);
+  return 0;
+}
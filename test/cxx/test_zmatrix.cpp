@@ -0,0 +1,114 @@
+#include <microscopes/common/zmatrix.hpp>
+#include <microscopes/common/random_fwd.hpp>
+#include <microscopes/common/macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace microscopes::common;
+
+static vector<vector<ssize_t>>
+random_assignments(size_t n, size_t nsamples, rng_t &r)
+{
+  vector<vector<ssize_t>> ret;
+  for (size_t s = 0; s < nsamples; s++) {
+    // a few big groups in some samples, many small ones in others, with
+    // labels that are negative or larger than n in some
+    const size_t ngroups = 1 + r() % (s % 2 ? 5 : n / 3 + 1);
+    const ssize_t offset = (s % 3 == 0) ? -7 : (s % 3 == 1) ? 0 : 1000003;
+    uniform_int_distribution<size_t> dist(0, ngroups - 1);
+    vector<ssize_t> avec(n);
+    for (auto &g : avec)
+      g = offset + ssize_t(dist(r));
+    ret.push_back(avec);
+  }
+  return ret;
+}
+
+static void
+test_zmatrix(size_t n, size_t nsamples, unsigned nthreads)
+{
+  rng_t r(n + nsamples);
+  const auto assignments = random_assignments(n, nsamples, r);
+
+  dense_zmatrix dense(n, nthreads);
+  sparse_zmatrix sparse(n, nthreads);
+  for (const auto &avec : assignments) {
+    dense.add(avec);
+    sparse.add(avec);
+  }
+  MICROSCOPES_CHECK(dense.nsamples() == nsamples, "wrong # of samples");
+  MICROSCOPES_CHECK(sparse.nsamples() == nsamples, "wrong # of samples");
+
+  // brute force
+  vector<uint32_t> counts(n * n);
+  for (const auto &avec : assignments)
+    for (size_t i = 0; i < n; i++)
+      for (size_t j = 0; j < n; j++)
+        counts[i * n + j] += (avec[i] == avec[j]);
+
+  vector<float> z(n * n);
+  dense.copy_to(z.data());
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++) {
+      const uint32_t c = counts[i * n + j];
+      MICROSCOPES_CHECK(dense.count(i, j) == c, "dense count wrong");
+      MICROSCOPES_CHECK(sparse.count(i, j) == c, "sparse count wrong");
+      MICROSCOPES_CHECK(
+          fabs(z[i * n + j] - float(c) / nsamples) < 1e-6, "dense z wrong");
+    }
+
+  // thresholded entries are exactly those at least the threshold
+  const float threshold = 0.5;
+  vector<size_t> indptr;
+  vector<uint32_t> indices;
+  vector<float> data;
+  sparse.thresholded(threshold, indptr, indices, data);
+  MICROSCOPES_CHECK(indptr.size() == n + 1, "wrong indptr size");
+  MICROSCOPES_CHECK(indptr.back() == indices.size(), "wrong # of entries");
+  for (size_t i = 0; i < n; i++) {
+    size_t k = indptr[i];
+    for (size_t j = 0; j < n; j++) {
+      if (z[i * n + j] < threshold || !counts[i * n + j])
+        continue;
+      MICROSCOPES_CHECK(k < indptr[i + 1] && indices[k] == j, "entry missing");
+      MICROSCOPES_CHECK(fabs(data[k] - z[i * n + j]) < 1e-6, "wrong value");
+      k++;
+    }
+    MICROSCOPES_CHECK(k == indptr[i + 1], "extra entries");
+  }
+
+  // dense and sparse agree on the neighbors, which are the best candidates
+  const size_t k = 5;
+  vector<ssize_t> dense_neighbors(n * k), sparse_neighbors(n * k);
+  vector<float> dense_scores(n * k), sparse_scores(n * k);
+  dense.top_k(k, dense_neighbors.data(), dense_scores.data());
+  sparse.top_k(k, sparse_neighbors.data(), sparse_scores.data());
+  MICROSCOPES_CHECK(dense_neighbors == sparse_neighbors, "neighbors differ");
+  MICROSCOPES_CHECK(dense_scores == sparse_scores, "scores differ");
+  for (size_t i = 0; i < n; i++) {
+    vector<pair<float, ssize_t>> expected;
+    for (size_t j = 0; j < n; j++)
+      if (j != i && counts[i * n + j])
+        expected.emplace_back(-z[i * n + j], j);
+    sort(expected.begin(), expected.end());
+    for (size_t r = 0; r < k; r++) {
+      const ssize_t j = r < expected.size() ? expected[r].second : -1;
+      MICROSCOPES_CHECK(dense_neighbors[i * k + r] == j, "wrong neighbor");
+    }
+  }
+}
+
+int
+main(void)
+{
+  test_zmatrix(1, 1, 1);
+  test_zmatrix(10, 3, 1);
+  test_zmatrix(300, 37, 1); // several tiles and batches
+  test_zmatrix(300, 37, 4);
+  test_zmatrix(257, 16, 0);
+  return 0;
+}
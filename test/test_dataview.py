@@ -15,6 +15,7 @@ import pickle
 import itertools as it
 import operator as op
 import hashlib
+import threading
 from scipy.sparse import coo_matrix, csr_matrix, csc_matrix
 
 from nose.tools import (
@@ -26,6 +27,7 @@ from nose.tools import (
     assert_true,
 )
 from microscopes.common.testutil import assert_1d_lists_almost_equals
+from microscopes.common.rng import rng
 
 
 def test_recarray_numpy_dataview():
@@ -76,6 +78,72 @@ def test_recarray_numpy_dataview_masked():
             assert_equals(aval, bval)
 
 
+def test_recarray_numpy_dataview_rows():
+    x = np.array([(i % 2 == 0, float(i), (i, -i)) for i in xrange(100)],
+                 dtype=[('', bool), ('', float), ('', np.int32, (2,))])
+    x = ma.masked_array(x, mask=[(i % 3 == 0, False, (False, i % 5 == 0))
+                                 for i in xrange(100)])
+    view = recarray_numpy_dataview(x)
+
+    def assert_rows_equal(actual, expected):
+        assert_true(np.array_equal(actual.data, expected.data))
+        assert_true(np.array_equal(actual.mask, expected.mask))
+
+    assert_rows_equal(view.rows(), x)
+    assert_rows_equal(view.rows(10, 20), x[10:20])
+    assert_rows_equal(view.rows(10, 20, copy=False), x[10:20])
+    assert_equals(len(view.rows(5, 5)), 0)
+
+    # rows follow the iteration order; the (unmasked) second field gives
+    # each row's original position
+    view.permute(rng(3))
+    order = [int(row[1]) for row in view]
+    assert_list_equal(sorted(order), range(100))
+    assert_rows_equal(view.rows(), x[order])
+    assert_rows_equal(view.rows(7, 31), x[order[7:31]])
+    view.reset_permutation()
+    assert_rows_equal(view.rows(copy=False), x)
+
+    # blocks of 8 consecutive rows, each visited in one stretch
+    view.permute_blocked(rng(3), 8)
+    order = [int(row[1]) for row in view]
+    assert_list_equal(sorted(order), range(100))
+    i = 0
+    while i < 100:
+        begin = order[i] // 8 * 8
+        end = min(begin + 8, 100)
+        assert_list_equal(sorted(order[i:i + end - begin]), range(begin, end))
+        i += end - begin
+    assert_rows_equal(view.rows(), x[order])
+
+
+
+def test_recarray_numpy_dataview_threads():
+    # permute() and rows() run without the GIL; independent dataviews driven
+    # from several threads give the same rows as when run one at a time
+    x = np.array([(i, float(i)) for i in xrange(10000)],
+                 dtype=[('', np.int32), ('', float)])
+
+    def run(seed):
+        view = recarray_numpy_dataview(x)
+        view.permute(rng(seed))
+        return view.rows()
+
+    expected = [run(seed) for seed in xrange(4)]
+    actual = [None] * len(expected)
+
+    def work(seed):
+        actual[seed] = run(seed)
+
+    threads = [threading.Thread(target=work, args=(seed,))
+               for seed in xrange(len(expected))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for a, e in zip(actual, expected):
+        assert_true(np.array_equal(a, e))
+
 def test_recarray_numpy_dataview_pickle():
     # not masked, int32
     y = np.array([(1, 2, 3, 4, 5), (5, 4, 3, 2, 1)],
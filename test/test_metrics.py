@@ -0,0 +1,12 @@
+from microscopes.common import metrics
+
+
+def test_aggregate():
+    metrics.reset()
+    r = metrics.aggregate()
+    assert 'group.add_value' in r['counters']
+    assert 'protobuf.message_bytes' in r['histograms']
+    assert all(v == 0 for v in r['counters'].values())
+    for buckets in r['histograms'].values():
+        assert len(buckets) == 65
+        assert not sum(buckets)
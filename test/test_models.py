@@ -30,6 +30,7 @@ def test_models_pickle():
         gp,
         nich,
         dd(4),
+        dd(300),
         bbnc,
         niw(3),
         dm(5),
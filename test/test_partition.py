@@ -0,0 +1,67 @@
+import numpy as np
+import math
+from microscopes.common import partition
+
+from nose.tools import (
+    assert_equals,
+    assert_list_equal,
+    assert_almost_equals,
+    assert_raises,
+)
+
+
+def test_canonical():
+    avec = [34, 34, 5, 11, 5, 5433, -1]
+    assert_list_equal(
+        partition.canonical(avec).tolist(), [0, 0, 1, 2, 1, 3, 4])
+    assert_list_equal(
+        partition.canonical(np.array(avec)).tolist(), [0, 0, 1, 2, 1, 3, 4])
+    assert_equals(len(partition.canonical([])), 0)
+
+
+def test_groups():
+    offsets, members = partition.groups([34, 34, 5, 11, 5, 5433])
+    assert_list_equal(offsets.tolist(), [0, 2, 4, 5, 6])
+    assert_list_equal(members.tolist(), [0, 1, 2, 4, 3, 5])
+
+
+def test_size_histogram():
+    hist = partition.size_histogram([34, 34, 5, 11, 5, 5433])
+    assert_list_equal(hist.tolist(), [0, 2, 2])
+
+
+def _pairwise_ari(a, b):
+    tp = fp = fn = tn = 0.
+    for i in xrange(len(a)):
+        for j in xrange(i + 1, len(a)):
+            sa, sb = a[i] == a[j], b[i] == b[j]
+            tp += sa and sb
+            fp += sb and not sa
+            fn += sa and not sb
+            tn += not sa and not sb
+    return 2. * (tp * tn - fn * fp) / \
+        ((tp + fn) * (fn + tn) + (tp + fp) * (fp + tn))
+
+
+def test_adjusted_rand_index():
+    assert_almost_equals(
+        partition.adjusted_rand_index([0, 0, 1, 1], [0, 0, 1, 2]), 4. / 7.)
+    assert_equals(
+        partition.adjusted_rand_index([0, 0, 1, 1], [5, 5, -2, -2]), 1.)
+    a = np.random.randint(10, size=200)
+    b = np.where(np.arange(200) % 2, a, np.random.randint(10, size=200))
+    assert_almost_equals(
+        partition.adjusted_rand_index(a, b), _pairwise_ari(a, b))
+    assert_raises(
+        ValueError, partition.adjusted_rand_index, [0, 1], [0, 1, 2])
+
+
+def test_variation_of_information():
+    assert_almost_equals(
+        partition.variation_of_information([0, 0, 1, 1], [0, 0, 1, 2]),
+        math.log(2.) / 2.)
+    assert_equals(
+        partition.variation_of_information([0, 0, 1, 1], [5, 5, -2, -2]), 0.)
+    # one group vs all singletons is the maximum
+    assert_almost_equals(
+        partition.variation_of_information([0] * 8, range(8)), math.log(8.))
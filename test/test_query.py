@@ -34,6 +34,67 @@ def test_zmatrix():
     assert_true(query._is_square_ndarray(zmat))
 
 
+def _brute_force_zmatrix(assignments):
+    n = len(assignments[0])
+    zmat = np.zeros((n, n))
+    for avec in assignments:
+        for i in xrange(n):
+            for j in xrange(n):
+                zmat[i, j] += avec[i] == avec[j]
+    return zmat / len(assignments)
+
+
+def _random_assignments(n, nsamples):
+    # some labels are negative, some larger than n
+    return [np.random.randint(-3, 5 if s % 2 else 1000, size=n)
+            for s in xrange(nsamples)]
+
+
+def test_zmatrix_values():
+    assignments = _random_assignments(200, 21)
+    truth = _brute_force_zmatrix(assignments)
+    zmat = query.zmatrix(assignments)
+    assert_equals(zmat.dtype, np.float32)
+    assert_almost_equals(np.abs(zmat - truth).max(), 0., places=5)
+    zmat = query.zmatrix(assignments, nthreads=3)
+    assert_almost_equals(np.abs(zmat - truth).max(), 0., places=5)
+
+
+def test_zmatrix_sparse():
+    assignments = _random_assignments(150, 10)
+    truth = _brute_force_zmatrix(assignments)
+    for threshold in (0., 0.25, 1.):
+        zmat = query.zmatrix_sparse(assignments, threshold)
+        expected = truth * (truth >= threshold)
+        assert_equals(zmat.nnz, np.count_nonzero(expected))
+        assert_almost_equals(
+            np.abs(zmat.toarray() - expected).max(), 0., places=5)
+
+
+def test_zmatrix_top_k():
+    assignments = [
+        [2, 345, 2, 2],
+        [3, 345, 2, 2],
+        [3, 9, 1, 1],
+    ]
+    neighbors, scores = query.zmatrix_top_k(assignments, 2)
+    assert_equals(neighbors.tolist(),
+                  [[2, 3], [-1, -1], [3, 0], [2, 0]])
+    truth = _brute_force_zmatrix(assignments)
+    assert_almost_equals(scores[2, 1], truth[2, 0], places=5)
+    assert_equals(scores[1].tolist(), [0., 0.])
+
+    assignments = _random_assignments(100, 8)
+    neighbors, scores = query.zmatrix_top_k(assignments, 10)
+    truth = _brute_force_zmatrix(assignments)
+    for i in xrange(100):
+        row = truth[i].copy()
+        row[i] = 0.
+        expected = sorted(row, reverse=True)[:10]
+        assert_almost_equals(
+            np.abs(np.array(expected) - scores[i]).max(), 0., places=5)
+
+
 def test_zmatrix_reorder():
     assignments = [
         [2, 345, 2, 2],